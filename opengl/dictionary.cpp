@@ -0,0 +1,908 @@
+#define TINYEXR_IMPLEMENTATION
+
+#include "dictionary.h"
+#include "halffloat.h"
+#include "parallel.h"
+#include "tinyexr.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char PackMagic[4] = { 'G', 'D', 'I', 'C' };
+	const uint64_t PackAlignment = 64;
+
+	// Serialize error messages of the decoding threads
+	std::mutex logMutex;
+
+	size_t valueSize(uint32_t valueType)
+	{
+		switch (static_cast<DictionaryValueType>(valueType)) {
+		case DictionaryValueType::Float32:
+			return sizeof(float);
+		case DictionaryValueType::Float16:
+		case DictionaryValueType::UNorm16:
+			return sizeof(uint16_t);
+		case DictionaryValueType::UNorm8:
+			return sizeof(uint8_t);
+		default:
+			return 0;
+		}
+	}
+
+	template <typename T>
+	void quantizeRow(const float* rgba, int width, float maxValue, T* values, float* scaleOffset)
+	{
+		for (int c = 0; c < 3; ++c) {
+			float lo = rgba[c], hi = rgba[c];
+			for (int t = 1; t < width; ++t) {
+				lo = std::min(lo, rgba[4 * t + c]);
+				hi = std::max(hi, rgba[4 * t + c]);
+			}
+			float scale = hi - lo;
+			float invScale = scale > 0.f ? maxValue / scale : 0.f;
+			for (int t = 0; t < width; ++t)
+				values[3 * t + c] = T(std::lround(std::min((rgba[4 * t + c] - lo) * invScale, maxValue)));
+			scaleOffset[c] = scale;
+			scaleOffset[3 + c] = lo;
+		}
+	}
+
+	template <typename T>
+	void dequantizeRow(const T* values, const float* scaleOffset, int width, float maxValue, float* rgb)
+	{
+		for (int t = 0; t < width; ++t)
+			for (int c = 0; c < 3; ++c)
+				rgb[3 * t + c] = scaleOffset[3 + c] + scaleOffset[c] * (float(values[3 * t + c]) / maxValue);
+	}
+
+	// 64 bits FNV-1a
+	struct Hash {
+		uint64_t value = 14695981039346656037ull;
+
+		void add(const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				value ^= bytes[i];
+				value *= 1099511628211ull;
+			}
+		}
+		template <typename T>
+		void add(const T& v) { add(&v, sizeof(v)); }
+		void add(const std::string& s) { add(s.data(), s.size()); }
+	};
+
+	// Heap allocations of the EXR decoding, see DictionaryIO::exrAllocationCount
+	std::atomic<size_t> exrAllocations(0);
+
+	// Temporary name of a pack being written, unique to the process and the call: two processes (or threads) caching
+	// the same EXR set write their own file, and the last rename wins with a complete pack
+	std::string temporaryPackName(const std::string& fileName)
+	{
+		static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+		unsigned long pid = GetCurrentProcessId();
+#else
+		unsigned long pid = (unsigned long)getpid();
+#endif
+		return fileName + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+	}
+
+	// RGBA floats of an EXR file, to release with free. Errors are logged.
+	float* decodeEXR(const std::string& fileName, int& width, int& height)
+	{
+		++exrAllocations;
+		float* data;
+		const char* err = nullptr;
+		if (LoadEXR(&data, &width, &height, fileName.c_str(), &err) != TINYEXR_SUCCESS) {
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cerr << "Load EXR err: " << (err ? err : fileName.c_str()) << std::endl;
+			if (err)
+				FreeEXRErrorMessage(err);
+			return nullptr;
+		}
+		return data;
+	}
+
+	DictionaryIO::EXRDecodeArena& threadArena()
+	{
+		thread_local DictionaryIO::EXRDecodeArena arena;
+		return arena;
+	}
+
+	// Read a whole file into data, grown if smaller. size is the size of the file.
+	bool readFile(const char* fileName, std::vector<unsigned char>& data, size_t& size)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		bool ok = GetFileSizeEx(file, &fileSize) != 0;
+		if (ok) {
+			size = size_t(fileSize.QuadPart);
+			if (data.size() < size) {
+				data.resize(size);
+				++exrAllocations;
+			}
+			DWORD read = 0;
+			ok = ReadFile(file, data.data(), DWORD(size), &read, NULL) && read == size;
+		}
+		CloseHandle(file);
+		return ok;
+#else
+		int fd = ::open(fileName, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		bool ok = fstat(fd, &info) == 0;
+		if (ok) {
+			size = size_t(info.st_size);
+			if (data.size() < size) {
+				data.resize(size);
+				++exrAllocations;
+			}
+			for (size_t done = 0; ok && done < size;) {
+				ssize_t n = ::read(fd, data.data() + done, size - done);
+				ok = n > 0;
+				done += ok ? size_t(n) : 0;
+			}
+		}
+		::close(fd);
+		return ok;
+#endif
+	}
+
+	uint32_t readUInt32(const unsigned char* p)
+	{
+		return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+	}
+
+	// Pointer past the null terminated string at p, nullptr if it is not terminated before end
+	const unsigned char* skipString(const unsigned char* p, const unsigned char* end)
+	{
+		const void* zero = memchr(p, 0, size_t(end - p));
+		return zero ? static_cast<const unsigned char*>(zero) + 1 : nullptr;
+	}
+
+	// Values of the R, G, B and A channels of a single line EXR file, in the file
+	struct EXRScanline {
+		int width;
+		const unsigned char* values[4]; // nullptr for an absent channel
+		int valueSize[4];               // 2 for halves, 4 for floats
+	};
+
+	// Parse the header of a single part, scanline EXR file holding one uncompressed line of R, G, B (and A)
+	// half or float channels. Any other file is left to tinyexr.
+	bool parseEXRScanline(const unsigned char* data, size_t size, EXRScanline& line)
+	{
+		// Magic number, version 2, no tiles, long names, deep data or multiple parts
+		if (size < 8 || readUInt32(data) != 20000630 || (readUInt32(data + 4) & 0x1eff) != 2)
+			return false;
+
+		const unsigned char* end = data + size;
+		const unsigned char* p = data + 8;
+		int channelCount = 0;
+		int channelIndex[4];
+		int channelSize[4];
+		int32_t dataWindow[4] = { 0, 0, -1, -1 };
+		// Attributes: name, type name, size, value. An empty name ends the header.
+		for (;;) {
+			if (p >= end)
+				return false;
+			if (*p == 0) {
+				++p;
+				break;
+			}
+			const unsigned char* name = p;
+			const unsigned char* typeName = skipString(name, end);
+			const unsigned char* attrSize = typeName ? skipString(typeName, end) : nullptr;
+			if (attrSize == nullptr || end - attrSize < 4)
+				return false;
+			const unsigned char* value = attrSize + 4;
+			uint32_t valueSize = readUInt32(attrSize);
+			if (valueSize > size_t(end - value))
+				return false;
+
+			if (strcmp(reinterpret_cast<const char*>(name), "channels") == 0) {
+				// Channels sorted by name: name, pixel type, linear flag, 3 reserved bytes, x and y sampling
+				const unsigned char* q = value;
+				const unsigned char* channelsEnd = value + valueSize;
+				while (q < channelsEnd && *q != 0) {
+					const unsigned char* next = skipString(q, channelsEnd);
+					if (next == nullptr || channelsEnd - next < 16 || next - q != 2 || channelCount == 4)
+						return false;
+					const char* rgba = strchr("RGBA", char(*q));
+					uint32_t pixelType = readUInt32(next);
+					if (rgba == nullptr || (pixelType != 1 && pixelType != 2) || readUInt32(next + 8) != 1 || readUInt32(next + 12) != 1)
+						return false;
+					channelIndex[channelCount] = int(rgba - "RGBA");
+					channelSize[channelCount] = pixelType == 1 ? 2 : 4;
+					++channelCount;
+					q = next + 16;
+				}
+			}
+			else if (strcmp(reinterpret_cast<const char*>(name), "dataWindow") == 0 && valueSize == 16) {
+				for (int k = 0; k < 4; ++k)
+					dataWindow[k] = int32_t(readUInt32(value + 4 * k));
+			}
+			p = value + valueSize;
+		}
+
+		line.width = dataWindow[2] - dataWindow[0] + 1;
+		if (line.width <= 0 || dataWindow[3] != dataWindow[1] || channelCount == 0)
+			return false;
+
+		// Offset table of the single line, then the line: y, size of the pixels, each channel in turn.
+		// Whatever the compression of the file, lines that would not shrink are stored as is: the dictionary files,
+		// a few hundred bytes, are PIZ files of uncompressed lines.
+		size_t pixelSize = 0;
+		for (int c = 0; c < channelCount; ++c)
+			pixelSize += channelSize[c];
+		if (end - p < 8)
+			return false;
+		uint64_t offset = uint64_t(readUInt32(p)) | uint64_t(readUInt32(p + 4)) << 32;
+		if (offset > size || size - offset < 8 || readUInt32(data + offset + 4) != pixelSize * line.width
+			|| size - offset - 8 < pixelSize * line.width)
+			return false;
+
+		for (int c = 0; c < 4; ++c)
+			line.values[c] = nullptr;
+		const unsigned char* values = data + offset + 8;
+		for (int c = 0; c < channelCount; ++c) {
+			line.values[channelIndex[c]] = values;
+			line.valueSize[channelIndex[c]] = channelSize[c];
+			values += size_t(channelSize[c]) * line.width;
+		}
+		// Gray or partial images are left to tinyexr
+		return line.values[0] && line.values[1] && line.values[2];
+	}
+
+	void decodeEXRScanline(const EXRScanline& line, float* rgba)
+	{
+		for (int t = 0; t < line.width; ++t)
+			rgba[4 * t + 3] = 1.f;
+		for (int c = 0; c < 4; ++c) {
+			const unsigned char* values = line.values[c];
+			if (values == nullptr)
+				continue;
+			if (line.valueSize[c] == 2) {
+				for (int t = 0; t < line.width; ++t)
+					rgba[4 * t + c] = HalfFloat::toFloat(uint16_t(values[2 * t] | values[2 * t + 1] << 8));
+			}
+			else {
+				for (int t = 0; t < line.width; ++t) {
+					uint32_t bits = readUInt32(values + 4 * t);
+					memcpy(&rgba[4 * t + c], &bits, sizeof(float));
+				}
+			}
+		}
+	}
+
+	// Decode fileName into the RGBA floats returned by destination(width), which returns nullptr to reject the file.
+	// Uncompressed files are read into the arena and decoded in place, the others by tinyexr.
+	template <typename Destination>
+	bool decodeEXRRow(const std::string& fileName, DictionaryIO::EXRDecodeArena& arena, const Destination& destination)
+	{
+		size_t size;
+		EXRScanline line;
+		if (readFile(fileName.c_str(), arena.fileData, size) && parseEXRScanline(arena.fileData.data(), size, line)) {
+			float* rgba = destination(line.width);
+			if (rgba != nullptr)
+				decodeEXRScanline(line, rgba);
+			return rgba != nullptr;
+		}
+
+		// Also reports the missing or unreadable files
+		int width, height;
+		float* data = decodeEXR(fileName, width, height);
+		if (data == nullptr)
+			return false;
+		float* rgba = destination(width);
+		if (rgba != nullptr)
+			memcpy(rgba, data, size_t(width) * 4 * sizeof(float));
+		free(data);
+		return rgba != nullptr;
+	}
+}
+
+size_t DictionaryHeader::rowSize() const
+{
+	return size_t(width) * channels * valueSize(valueType);
+}
+
+bool DictionaryHeader::isQuantized() const
+{
+	return valueType == uint32_t(DictionaryValueType::UNorm16) || valueType == uint32_t(DictionaryValueType::UNorm8);
+}
+
+size_t DictionaryHeader::scaleOffsetSize() const
+{
+	return isQuantized() ? size_t(layerCount()) * channels * 2 * sizeof(float) : 0;
+}
+
+//=========================================================================================================================
+//=================================================== MappedDictionary ====================================================
+//=========================================================================================================================
+
+#ifdef _WIN32
+MappedDictionary::MappedDictionary() : base(nullptr), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {}
+#else
+MappedDictionary::MappedDictionary() : base(nullptr), size(0), fd(-1) {}
+#endif
+
+MappedDictionary::~MappedDictionary()
+{
+	close();
+}
+
+bool MappedDictionary::open(const std::string& fileName)
+{
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		close();
+		return false;
+	}
+	size = size_t(fileSize.QuadPart);
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == nullptr) {
+		close();
+		return false;
+	}
+	base = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close();
+		return false;
+	}
+	size = size_t(info.st_size);
+	void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		close();
+		return false;
+	}
+	// The whole file is uploaded at once. The advices are values, not flags: one call each
+	madvise(ptr, size, MADV_SEQUENTIAL);
+	madvise(ptr, size, MADV_WILLNEED);
+	base = static_cast<const unsigned char*>(ptr);
+#endif
+	if (base == nullptr) {
+		close();
+		return false;
+	}
+
+	std::string error;
+	if (!DictionaryIO::validateHeader(header(), size, error)) {
+		std::cerr << fileName << ": " << error << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+const float* MappedDictionary::scaleOffset() const
+{
+	if (!header().isQuantized())
+		return nullptr;
+	return reinterpret_cast<const float*>(base + header().scaleOffset);
+}
+
+void MappedDictionary::close()
+{
+#ifdef _WIN32
+	if (base != nullptr)
+		UnmapViewOfFile(base);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (base != nullptr)
+		munmap(const_cast<unsigned char*>(base), size);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	base = nullptr;
+	size = 0;
+}
+
+//=========================================================================================================================
+//===================================================== DictionaryIO ======================================================
+//=========================================================================================================================
+
+namespace DictionaryIO {
+
+std::string exrFileName(const std::string& baseName, int i, int l)
+{
+	std::string name;
+	exrFileName(baseName, i, l, name);
+	return name;
+}
+
+void exrFileName(const std::string& baseName, int i, int l, std::string& name)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "_%04d_%04d.exr", i, l);
+	name.assign(baseName);
+	name.append(suffix);
+}
+
+bool parseEXRFileName(const std::string& baseName, const std::string& fileName, int& i, int& l)
+{
+	// baseName_XXXX_YYYY.exr
+	std::string prefix = std::filesystem::path(baseName).filename().string() + "_";
+	std::string name = std::filesystem::path(fileName).filename().string();
+	if (name.size() != prefix.size() + 13 || name.compare(0, prefix.size(), prefix) != 0
+		|| name.compare(name.size() - 4, 4, ".exr") != 0 || name[prefix.size() + 4] != '_')
+		return false;
+	for (size_t k = 0; k < 9; ++k)
+		if (k != 4 && (name[prefix.size() + k] < '0' || name[prefix.size() + k] > '9'))
+			return false;
+	i = std::atoi(name.substr(prefix.size(), 4).c_str());
+	l = std::atoi(name.substr(prefix.size() + 5, 4).c_str());
+	return true;
+}
+
+bool loadEXRRow(const std::string& fileName, int width, float* rgba)
+{
+	return loadEXRRow(fileName, width, rgba, threadArena());
+}
+
+bool loadEXRRow(const std::string& fileName, int width, float* rgba, EXRDecodeArena& arena)
+{
+	return decodeEXRRow(fileName, arena, [&](int w) -> float* {
+		if (w != width) {
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cerr << fileName << ": expected " << width << " texels, got " << w << std::endl;
+			return nullptr;
+		}
+		return rgba;
+	});
+}
+
+size_t exrAllocationCount()
+{
+	return exrAllocations;
+}
+
+bool loadEXRSet(const std::string& baseName, unsigned int nlevels, int ndists,
+	std::vector<float>& rows, int& width, const std::function<void(size_t)>& rowDecoded,
+	const std::vector<size_t>& rowOrder)
+{
+	if (nlevels == 0 || ndists <= 0)
+		return false;
+
+	// Decode one file into its row, l * ndists + i, with the arena of the decoding thread
+	std::atomic<bool> failed(false);
+	auto decode = [&](size_t row) {
+		EXRDecodeArena& arena = threadArena();
+		size_t capacity = arena.fileName.capacity();
+		exrFileName(baseName, int(row % ndists), int(row / ndists), arena.fileName);
+		if (arena.fileName.capacity() != capacity)
+			++exrAllocations;
+
+		bool decoded;
+		if (rows.empty()) {
+			// The first distribution gives the size of all the rows
+			decoded = decodeEXRRow(arena.fileName, arena, [&](int w) -> float* {
+				if (w <= 0)
+					return nullptr;
+				width = w;
+				rows.resize(size_t(width) * 4 * nlevels * ndists);
+				return &rows[row * width * 4];
+			});
+		}
+		else {
+			decoded = loadEXRRow(arena.fileName, width, &rows[row * width * 4], arena);
+		}
+		if (!decoded) {
+			failed = true;
+			return;
+		}
+
+		if (rowDecoded)
+			rowDecoded(row);
+	};
+
+	size_t rowCount = size_t(nlevels) * ndists;
+	if (!rowOrder.empty() && rowOrder.size() != rowCount)
+		return false;
+	auto rowAt = [&](size_t k) { return rowOrder.empty() ? k : rowOrder[k]; };
+
+	rows.clear();
+	width = 0;
+	decode(rowAt(0));
+	if (failed)
+		return false;
+
+	// The other files are decoded on all the cores, straight into the preallocated rows
+	Parallel::forEachIndex(rowCount - 1, [&](size_t k) {
+		if (!failed)
+			decode(rowAt(k + 1));
+	});
+	return !failed;
+}
+
+DictionaryHeader makeHeader(unsigned int nlevels, int ndists, int width, float alpha,
+	DictionaryValueType valueType, uint32_t channels)
+{
+	DictionaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PackMagic, sizeof(PackMagic));
+	header.version = PackVersion;
+	header.nlevels = nlevels;
+	header.ndists = ndists;
+	header.width = width;
+	header.channels = channels;
+	header.valueType = static_cast<uint32_t>(valueType);
+	header.alpha = alpha;
+	header.dataOffset = (sizeof(DictionaryHeader) + PackAlignment - 1) / PackAlignment * PackAlignment;
+	header.dataSize = uint64_t(header.rowSize()) * header.layerCount();
+	if (header.isQuantized())
+		header.scaleOffset = (header.dataOffset + header.dataSize + PackAlignment - 1) / PackAlignment * PackAlignment;
+	return header;
+}
+
+uint32_t channelCount(DictionaryValueType valueType)
+{
+	return valueType == DictionaryValueType::Float32 ? 4 : 3;
+}
+
+const char* valueTypeName(DictionaryValueType valueType)
+{
+	switch (valueType) {
+	case DictionaryValueType::Float32:
+		return "RGBA float";
+	case DictionaryValueType::Float16:
+		return "RGB half";
+	case DictionaryValueType::UNorm16:
+		return "RGB unorm16";
+	case DictionaryValueType::UNorm8:
+		return "RGB unorm8";
+	default:
+		return "unknown";
+	}
+}
+
+void encodeRow(const float* rgba, int width, DictionaryValueType valueType, void* values, float* scaleOffset)
+{
+	switch (valueType) {
+	case DictionaryValueType::Float32:
+		memcpy(values, rgba, size_t(width) * 4 * sizeof(float));
+		break;
+	case DictionaryValueType::Float16:
+		HalfFloat::convertRGBAToRGB(rgba, static_cast<uint16_t*>(values), width);
+		break;
+	case DictionaryValueType::UNorm16:
+		quantizeRow(rgba, width, 65535.f, static_cast<uint16_t*>(values), scaleOffset);
+		break;
+	case DictionaryValueType::UNorm8:
+		quantizeRow(rgba, width, 255.f, static_cast<uint8_t*>(values), scaleOffset);
+		break;
+	}
+}
+
+void encodeRows(const DictionaryHeader& header, const std::vector<float>& rgba,
+	std::vector<unsigned char>& values, std::vector<float>& scaleOffset)
+{
+	values.resize(header.dataSize);
+	scaleOffset.resize(header.scaleOffsetSize() / sizeof(float));
+	DictionaryValueType valueType = static_cast<DictionaryValueType>(header.valueType);
+	size_t rowSize = header.rowSize();
+	Parallel::forEachIndex(header.layerCount(), [&](size_t row) {
+		encodeRow(&rgba[row * header.width * 4], int(header.width), valueType, &values[row * rowSize],
+			header.isQuantized() ? &scaleOffset[row * 6] : nullptr);
+	});
+}
+
+void decodeRow(const DictionaryHeader& header, const void* rows, const float* scaleOffset, size_t row, float* rgb)
+{
+	const unsigned char* values = static_cast<const unsigned char*>(rows) + row * header.rowSize();
+	int width = int(header.width);
+	switch (static_cast<DictionaryValueType>(header.valueType)) {
+	case DictionaryValueType::Float32: {
+		const float* texels = reinterpret_cast<const float*>(values);
+		for (int t = 0; t < width; ++t)
+			for (int c = 0; c < 3; ++c)
+				rgb[3 * t + c] = texels[header.channels * t + c];
+		break;
+	}
+	case DictionaryValueType::Float16: {
+		const uint16_t* texels = reinterpret_cast<const uint16_t*>(values);
+		for (int t = 0; t < width; ++t)
+			for (int c = 0; c < 3; ++c)
+				rgb[3 * t + c] = HalfFloat::toFloat(texels[header.channels * t + c]);
+		break;
+	}
+	case DictionaryValueType::UNorm16:
+		dequantizeRow(reinterpret_cast<const uint16_t*>(values), scaleOffset + row * 6, width, 65535.f, rgb);
+		break;
+	case DictionaryValueType::UNorm8:
+		dequantizeRow(values, scaleOffset + row * 6, width, 255.f, rgb);
+		break;
+	}
+}
+
+DictionaryRowSupport rowSupport(const DictionaryHeader& header, const void* rows, const float* scaleOffset, size_t row)
+{
+	int width = int(header.width);
+	std::vector<float> rgb(size_t(width) * 3);
+	decodeRow(header, rows, scaleOffset, row, rgb.data());
+	int first = width, last = -1;
+	for (int t = 0; t < width; ++t) {
+		if (rgb[3 * t] != 0.f || rgb[3 * t + 1] != 0.f || rgb[3 * t + 2] != 0.f) {
+			first = std::min(first, t);
+			last = t;
+		}
+	}
+
+	DictionaryRowSupport support;
+	support.first = last < first ? 0 : std::max(first - 1, 0);
+	support.last = last < first ? -1 : std::min(last + 1, width - 1);
+	support.layer = uint32_t(row);
+	support.offset = uint32_t(support.first);
+	return support;
+}
+
+uint32_t compactRows(const DictionaryHeader& header, const void* rows, const float* scaleOffset,
+	std::vector<DictionaryRowSupport>& supports)
+{
+	supports.resize(header.layerCount());
+	Parallel::forEachIndex(supports.size(), [&](size_t row) {
+		supports[row] = rowSupport(header, rows, scaleOffset, row);
+	});
+
+	// Longest rows first, each in the first layer with enough free texels
+	std::vector<uint32_t> order(supports.size());
+	for (uint32_t row = 0; row < order.size(); ++row)
+		order[row] = row;
+	auto extent = [&](uint32_t row) { return uint32_t(supports[row].last - supports[row].first + 1); };
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return extent(a) > extent(b); });
+
+	std::vector<uint32_t> used;
+	for (uint32_t row : order) {
+		uint32_t size = extent(row);
+		uint32_t layer = 0;
+		while (layer < used.size() && used[layer] + size > header.width)
+			++layer;
+		if (layer == used.size())
+			used.push_back(0);
+		supports[row].layer = layer;
+		supports[row].offset = used[layer];
+		used[layer] += size;
+	}
+	return std::max(uint32_t(used.size()), 1u);
+}
+
+void supportTableEntry(const DictionaryRowSupport& support, uint32_t width, float* entry)
+{
+	// Texel t covers [t, t + 1], its center is t + 0.5. The padding texels are null: the row is null
+	// on their far half, and beyond. The first and last texels of the row are clamped to.
+	if (support.last < support.first) {
+		entry[0] = float(width) + 1.f;
+		entry[1] = -1.f;
+	}
+	else {
+		entry[0] = support.first > 0 ? float(support.first) + 0.5f : 0.f;
+		entry[1] = support.last < int32_t(width) - 1 ? float(support.last) + 0.5f : float(width);
+	}
+	entry[2] = float(support.layer);
+	entry[3] = float(support.offset) - float(support.first);
+}
+
+void inverseCDFRow(const float* rgb, int width, int entries, float texelSlope, float* table)
+{
+	// The distribution as the texture units filter it: constant on [0, 0.5] and [width - 0.5, width],
+	// linear between the texel centers. Nodes are 0, the texel centers and width.
+	int nodes = width + 2;
+	std::vector<float> position(nodes), value(nodes), cdf(nodes);
+	for (int c = 0; c < 3; ++c) {
+		position[0] = 0.f;
+		value[0] = std::max(rgb[c], 0.f);
+		for (int t = 0; t < width; ++t) {
+			position[t + 1] = float(t) + 0.5f;
+			value[t + 1] = std::max(rgb[3 * t + c], 0.f);
+		}
+		position[nodes - 1] = float(width);
+		value[nodes - 1] = value[nodes - 2];
+		cdf[0] = 0.f;
+		for (int n = 1; n < nodes; ++n)
+			cdf[n] = cdf[n - 1] + 0.5f * (value[n - 1] + value[n]) * (position[n] - position[n - 1]);
+		float total = cdf[nodes - 1];
+
+		int n = 0;
+		for (int k = 0; k < entries; ++k) {
+			float u = float(k) / float(entries - 1);
+			if (total <= 0.f) {
+				// Null distribution, never sampled
+				table[3 * k + c] = u * float(width);
+				continue;
+			}
+			float target = u * total;
+			while (n < nodes - 2 && cdf[n + 1] < target)
+				++n;
+			// Solve a x + (b - a) x^2 / (2 h) = r on the segment [position[n], position[n + 1]]
+			float h = position[n + 1] - position[n];
+			float a = value[n], b = value[n + 1];
+			float r = std::max(target - cdf[n], 0.f);
+			float denominator = a + std::sqrt(std::max(a * a + 2.f * (b - a) * r / h, 0.f));
+			float x = denominator > 0.f ? 2.f * r / denominator : 0.f;
+			table[3 * k + c] = position[n] + std::min(x, h);
+		}
+		table[3 * entries + c] = total * texelSlope;
+	}
+}
+
+bool writePack(const std::string& fileName, const DictionaryHeader& header, const void* rows, const float* scaleOffset)
+{
+	std::error_code ec;
+	std::filesystem::path parent = std::filesystem::path(fileName).parent_path();
+	if (!parent.empty())
+		std::filesystem::create_directories(parent, ec);
+
+	std::string tmpName = temporaryPackName(fileName);
+	{
+		std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			std::cerr << "Unable to open: " << tmpName << std::endl;
+			return false;
+		}
+
+		std::vector<char> prefix(header.dataOffset, 0);
+		memcpy(prefix.data(), &header, sizeof(header));
+		out.write(prefix.data(), prefix.size());
+		out.write(static_cast<const char*>(rows), header.dataSize);
+		if (header.isQuantized()) {
+			std::vector<char> padding(header.scaleOffset - header.dataOffset - header.dataSize, 0);
+			out.write(padding.data(), padding.size());
+			out.write(reinterpret_cast<const char*>(scaleOffset), header.scaleOffsetSize());
+		}
+		if (!out) {
+			std::cerr << "Unable to write: " << tmpName << std::endl;
+			out.close();
+			std::filesystem::remove(tmpName, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmpName, fileName, ec);
+	if (ec) {
+		std::cerr << "Unable to rename " << tmpName << ": " << ec.message() << std::endl;
+		std::filesystem::remove(tmpName, ec);
+		return false;
+	}
+	return true;
+}
+
+DictionaryValueType uploadValueType()
+{
+	const char* upload = getenv("GLINT_DICTIONARY_UPLOAD");
+	std::string type = upload ? upload : "";
+	if (type == "float")
+		return DictionaryValueType::Float32;
+	if (type == "unorm16")
+		return DictionaryValueType::UNorm16;
+	if (type == "unorm8")
+		return DictionaryValueType::UNorm8;
+	return DictionaryValueType::Float16;
+}
+
+std::string cacheDirectory()
+{
+	if (const char* dir = getenv("GLINT_DICTIONARY_CACHE"))
+		return dir;
+	if (const char* dir = getenv("XDG_CACHE_HOME"))
+		return std::string(dir) + "/real_time_glint";
+	if (const char* dir = getenv("LOCALAPPDATA"))
+		return std::string(dir) + "/real_time_glint";
+	if (const char* dir = getenv("HOME"))
+		return std::string(dir) + "/.cache/real_time_glint";
+	return "";
+}
+
+std::string cachedPackName(const std::string& baseName, unsigned int nlevels, int ndists)
+{
+	std::string dir = cacheDirectory();
+	if (dir.empty())
+		return "";
+
+	Hash hash;
+	hash.add(PackVersion);
+	hash.add(uploadValueType());
+	hash.add(nlevels);
+	hash.add(ndists);
+	for (int l = 0; l < int(nlevels); ++l) {
+		for (int i = 0; i < ndists; i++) {
+			std::string texName = exrFileName(baseName, i, l);
+			std::error_code ec;
+			std::filesystem::path path = std::filesystem::absolute(texName, ec);
+			uintmax_t size = std::filesystem::file_size(path, ec);
+			if (ec)
+				return "";
+			auto mtime = std::filesystem::last_write_time(path, ec);
+			if (ec)
+				return "";
+			hash.add(path.string());
+			hash.add(uint64_t(size));
+			hash.add(int64_t(mtime.time_since_epoch().count()));
+		}
+	}
+
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash.value);
+	return dir + "/" + key + ".dict";
+}
+
+uint64_t hashBytes(const void* data, size_t size)
+{
+	Hash hash;
+	hash.add(data, size);
+	return hash.value;
+}
+
+bool validateHeader(const DictionaryHeader& header, size_t fileSize, std::string& error)
+{
+	if (fileSize < sizeof(DictionaryHeader) || memcmp(header.magic, PackMagic, sizeof(PackMagic)) != 0) {
+		error = "not a packed dictionary";
+		return false;
+	}
+	if (header.version != PackVersion) {
+		error = "unsupported pack version " + std::to_string(header.version);
+		return false;
+	}
+	if (valueSize(header.valueType) == 0 || header.channels == 0 || header.channels > 4
+		|| (header.isQuantized() && header.channels != 3)) {
+		error = "unsupported texel format";
+		return false;
+	}
+	// The sizes of a corrupt pack must not wrap: the products are bounded by the file size before they are computed,
+	// and the offsets are compared to the room left in the file
+	uint64_t layers = uint64_t(header.nlevels) * header.ndists;
+	uint64_t rowSize = header.rowSize();
+	if (layers == 0 || layers > UINT32_MAX || rowSize == 0 || layers > fileSize / rowSize
+		|| header.dataSize != rowSize * layers
+		|| header.dataOffset < sizeof(DictionaryHeader)
+		|| header.dataOffset > fileSize || header.dataSize > fileSize - header.dataOffset
+		|| (header.isQuantized() ? header.scaleOffset < header.dataOffset + header.dataSize
+			|| header.scaleOffset % sizeof(float) != 0 || header.scaleOffset > fileSize
+			|| header.scaleOffsetSize() > fileSize - header.scaleOffset
+			: header.scaleOffset != 0)) {
+		error = "truncated or inconsistent pack";
+		return false;
+	}
+	return true;
+}
+
+} // namespace DictionaryIO
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Type of the values stored in the rows of a packed dictionary
+enum class DictionaryValueType : uint32_t {
+	Float32 = 0, // 32 bits floats, one value per channel
+	Float16 = 1, // 16 bits floats (GL_HALF_FLOAT), one value per channel
+	UNorm16 = 2, // 16 bits normalized integers, rescaled per row and channel (see DictionaryHeader::scaleOffset)
+	UNorm8 = 3   // 8 bits normalized integers, rescaled per row and channel
+};
+
+// Header of a packed dictionary file (.dict).
+// All the rows follow the header, contiguously, in upload order: row l * ndists + i
+// holds the distributions 3i, 3i + 1 and 3i + 2 of the level l.
+// Quantized rows are followed by a table of channels scales then channels offsets per row (floats):
+// the value of a channel is offset + scale * v, with v the normalized integer in [0, 1].
+struct DictionaryHeader {
+	char magic[4];       // "GDIC"
+	uint32_t version;    // DictionaryIO::PackVersion
+	uint32_t nlevels;    // Number of LOD
+	uint32_t ndists;     // Number of distributions per channel
+	uint32_t width;      // Number of texels per row
+	uint32_t channels;   // Number of channels per texel
+	uint32_t valueType;  // DictionaryValueType
+	float alpha;         // Roughness of the dictionary (\alpha_{dist} in the paper)
+	uint64_t dataOffset; // Offset of the first row from the beginning of the file
+	uint64_t dataSize;   // Size in bytes of all the rows
+	uint64_t scaleOffset; // Offset of the scale and offset table from the beginning of the file, 0 if not quantized
+
+	uint32_t layerCount() const { return nlevels * ndists; }
+	size_t rowSize() const;
+	bool isQuantized() const;
+	// Size in bytes of the scale and offset table
+	size_t scaleOffsetSize() const;
+};
+
+// Texels of a row stored in the texture, and their place in it. Rows are compacted to their support:
+// the non-zero texels, padded with one zero texel on each side (within the row) so that linear filtering
+// is exact up to the padding. Outside of it the distributions are null, the shader does not fetch them.
+struct DictionaryRowSupport {
+	int32_t first;   // First and last stored texels of the row, last < first for a null row
+	int32_t last;
+	uint32_t layer;  // Layer of the texture holding the stored texels
+	uint32_t offset; // Texel of the layer holding the texel first of the row
+};
+
+// Read only memory mapping of a packed dictionary file
+class MappedDictionary {
+public:
+	MappedDictionary();
+	~MappedDictionary();
+
+	// Make it non-copyable.
+	MappedDictionary(const MappedDictionary&) = delete;
+	MappedDictionary& operator=(const MappedDictionary&) = delete;
+
+	bool open(const std::string& fileName);
+	void close();
+
+	bool isOpen() const { return base != nullptr; }
+	const DictionaryHeader& header() const { return *reinterpret_cast<const DictionaryHeader*>(base); }
+	const void* data() const { return base + header().dataOffset; }
+	// Scale and offset table of a quantized pack, nullptr otherwise
+	const float* scaleOffset() const;
+
+private:
+	const unsigned char* base;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fd;
+#endif
+};
+
+namespace DictionaryIO
+{
+	const uint32_t PackVersion = 2;
+
+	// File name of the distribution i at level l in an EXR set
+	std::string exrFileName(const std::string& baseName, int i, int l);
+	// Same, written into name: no allocation once name holds a file name of the set
+	void exrFileName(const std::string& baseName, int i, int l, std::string& name);
+	// Inverse of exrFileName, false if fileName is not a file of the set (the directory is ignored)
+	bool parseEXRFileName(const std::string& baseName, const std::string& fileName, int& i, int& l);
+
+	// Scratch memory of the EXR decoding, grown to the largest file then reused: decoding a file allocates nothing.
+	// Not thread safe, use one arena per decoding thread.
+	struct EXRDecodeArena {
+		std::vector<unsigned char> fileData;
+		std::string fileName;
+	};
+
+	// Decode one file of an EXR set into width RGBA floats, using the arena of the calling thread.
+	// Uncompressed scanline files of half or float channels, as the dictionary generator writes them,
+	// are decoded in place. Other files (compressed, tiled...) go through tinyexr, which allocates.
+	bool loadEXRRow(const std::string& fileName, int width, float* rgba);
+	bool loadEXRRow(const std::string& fileName, int width, float* rgba, EXRDecodeArena& arena);
+
+	// Number of heap allocations made by the EXR decoding since the start of the program:
+	// growths of the arenas, and one per file decoded through tinyexr
+	size_t exrAllocationCount();
+
+	// Decode an EXR set into rows of RGBA floats stored in upload order.
+	// rowDecoded is called from the decoding threads each time a row is complete.
+	// Rows are decoded in rowOrder when given (the first one alone, before the others).
+	// Each decoding thread reuses its arena: the whole set makes O(threads) allocations, not O(files).
+	bool loadEXRSet(const std::string& baseName, unsigned int nlevels, int ndists,
+		std::vector<float>& rows, int& width, const std::function<void(size_t)>& rowDecoded = nullptr,
+		const std::vector<size_t>& rowOrder = std::vector<size_t>());
+
+	DictionaryHeader makeHeader(unsigned int nlevels, int ndists, int width, float alpha,
+		DictionaryValueType valueType, uint32_t channels);
+
+	// Channels stored per texel: the RGBA floats of the EXR files are kept as is, the other types drop alpha
+	uint32_t channelCount(DictionaryValueType valueType);
+	const char* valueTypeName(DictionaryValueType valueType);
+
+	// Encode a row of width RGBA floats. Quantized types also write the 2 * 3 floats of the row
+	// in the scale and offset table, mapping the range of each channel to [0, 1].
+	void encodeRow(const float* rgba, int width, DictionaryValueType valueType, void* values, float* scaleOffset);
+	// Encode all the rows of an RGBA float dictionary in the format of the header, on all the cores
+	void encodeRows(const DictionaryHeader& header, const std::vector<float>& rgba,
+		std::vector<unsigned char>& values, std::vector<float>& scaleOffset);
+	// Decode the row of a pack into width RGB floats
+	void decodeRow(const DictionaryHeader& header, const void* rows, const float* scaleOffset, size_t row, float* rgb);
+
+	// Stored texels of a row of a pack (see DictionaryRowSupport), in place: layer is the row, offset is first
+	DictionaryRowSupport rowSupport(const DictionaryHeader& header, const void* rows, const float* scaleOffset, size_t row);
+	// Supports of all the rows of a pack, packed first fit decreasing in layers of header.width texels.
+	// A row never straddles two layers. Returns the number of layers.
+	uint32_t compactRows(const DictionaryHeader& header, const void* rows, const float* scaleOffset,
+		std::vector<DictionaryRowSupport>& supports);
+	// Entry of a row in the support table of the shader, 4 floats: the row is null for texel coordinates
+	// (in [0, width]) below entry[0] or above entry[1], the texel coordinate u of the row is u + entry[3] in layer entry[2]
+	void supportTableEntry(const DictionaryRowSupport& support, uint32_t width, float* entry);
+	// Inverse cumulative distributions of the 3 distributions of a decoded row (width RGB floats), filtered
+	// as the texture units filter the row. Writes entries + 1 RGB texels: texel k is the texel coordinate (in [0, width])
+	// below which lies the fraction k / (entries - 1) of the distribution, the last texel is the integral of the
+	// distribution over the positive slopes, a texel covering texelSlope.
+	void inverseCDFRow(const float* rgb, int width, int entries, float texelSlope, float* table);
+
+	// Write the pack to a temporary file renamed once complete, so readers never see a partial pack.
+	// Creates the directory of the pack if needed.
+	bool writePack(const std::string& fileName, const DictionaryHeader& header, const void* rows,
+		const float* scaleOffset = nullptr);
+
+	// Value type of the uploaded texture: RGB halves, unless GLINT_DICTIONARY_UPLOAD asks for
+	// the RGBA floats decoded from the EXR files ("float", to compare both paths),
+	// or for quantized rows ("unorm16" or "unorm8")
+	DictionaryValueType uploadValueType();
+
+	// Directory of the decoded dictionary cache: $GLINT_DICTIONARY_CACHE, or the user cache directory.
+	// Empty when the cache is disabled (GLINT_DICTIONARY_CACHE set to an empty string).
+	std::string cacheDirectory();
+
+	// Name of the cached pack of an EXR set. The key hashes the path, size and modification time
+	// of every file of the set, so editing or replacing a file invalidates the cache.
+	// Empty when the cache is disabled or a file of the set is missing. Does not create the cache directory.
+	std::string cachedPackName(const std::string& baseName, unsigned int nlevels, int ndists);
+
+	// 64 bits FNV-1a hash of a buffer
+	uint64_t hashBytes(const void* data, size_t size);
+
+	// Check the header of a mapped pack against the size of the mapping
+	bool validateHeader(const DictionaryHeader& header, size_t fileSize, std::string& error);
+}
@@ -0,0 +1,69 @@
+#include "dictionarymanager.h"
+
+#include <iostream>
+
+DictionaryManager::DictionaryManager(size_t budgetBytes) : budgetBytes(budgetBytes), hotReload(false), layout(DictionaryLayout::Array1D), frame(0) {}
+
+void DictionaryManager::setStorageLayout(DictionaryLayout storageLayout)
+{
+	if (storageLayout == layout)
+		return;
+	layout = storageLayout;
+	dictionaries.clear();
+}
+
+DictionaryStreamer& DictionaryManager::acquire(const std::string& dictionaryName, unsigned int nlevels, int ndists, float alpha,
+	const std::vector<int>& levelPriority)
+{
+	Entry& entry = dictionaries[Key{ dictionaryName, nlevels, ndists, alpha }];
+	if (!entry.streamer) {
+		entry.streamer.reset(new DictionaryStreamer());
+		entry.streamer->setLevelPriority(levelPriority);
+		entry.streamer->setHotReload(hotReload);
+		entry.streamer->setStorageLayout(layout);
+		entry.streamer->start(dictionaryName, nlevels, ndists, alpha);
+	}
+	entry.lastUsedFrame = frame;
+	return *entry.streamer;
+}
+
+void DictionaryManager::update()
+{
+	for (auto& dictionary : dictionaries)
+		dictionary.second.streamer->update();
+	evict();
+	++frame;
+}
+
+size_t DictionaryManager::gpuBytes() const
+{
+	size_t bytes = 0;
+	for (const auto& dictionary : dictionaries)
+		bytes += dictionary.second.streamer->gpuBytes();
+	return bytes;
+}
+
+void DictionaryManager::evict()
+{
+	size_t bytes = gpuBytes();
+	while (bytes > budgetBytes) {
+		// Least recently used dictionary, neither used this frame nor loading
+		// (releasing a loading dictionary waits for its decoding threads)
+		auto victim = dictionaries.end();
+		for (auto it = dictionaries.begin(); it != dictionaries.end(); ++it) {
+			const DictionaryStreamer& streamer = *it->second.streamer;
+			if (it->second.lastUsedFrame == frame || !(streamer.isResident() || streamer.hasFailed()))
+				continue;
+			if (victim == dictionaries.end() || it->second.lastUsedFrame < victim->second.lastUsedFrame)
+				victim = it;
+		}
+		if (victim == dictionaries.end())
+			return;
+
+		size_t victimBytes = victim->second.streamer->gpuBytes();
+		std::cout << "Dictionary evicted: " << victim->first.name << " (" << victimBytes << " bytes, budget "
+			<< budgetBytes << " bytes)" << std::endl;
+		bytes -= victimBytes;
+		dictionaries.erase(victim);
+	}
+}
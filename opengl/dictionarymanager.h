@@ -0,0 +1,76 @@
+#pragma once
+
+#include "dictionarystreamer.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Dictionaries shared by the materials of a scene. Each dictionary is streamed into its own texture
+// on first request, and the least recently used ones are released when the GPU memory of all
+// the dictionaries exceeds the budget.
+class DictionaryManager {
+public:
+	explicit DictionaryManager(size_t budgetBytes = size_t(256) << 20);
+
+	// Make it non-copyable.
+	DictionaryManager(const DictionaryManager&) = delete;
+	DictionaryManager& operator=(const DictionaryManager&) = delete;
+
+	// Dictionary used by a material this frame, started (see DictionaryStreamer::start) if it is not loaded.
+	// Materials share a dictionary when they use the same files with the same nlevels, ndists and alpha:
+	// the same files read with other parameters are another dictionary.
+	// levelPriority orders the levels of a new dictionary (see DictionaryStreamer::setLevelPriority).
+	// The streamer remains valid until the next update, materials acquire their dictionary every frame
+	// and bind its textures (DictionaryStreamer::texture and scaleOffsetTexture) before drawing.
+	DictionaryStreamer& acquire(const std::string& dictionaryName, unsigned int nlevels, int ndists, float alpha,
+		const std::vector<int>& levelPriority = std::vector<int>());
+
+	// Stream the loading dictionaries, then evict the least recently used ones over budget.
+	// Must be called on the GL thread, once per frame, after the materials acquired their dictionaries.
+	void update();
+
+	void setBudget(size_t bytes) { budgetBytes = bytes; }
+	size_t budget() const { return budgetBytes; }
+	// GPU memory of the loaded dictionaries
+	size_t gpuBytes() const;
+	size_t dictionaryCount() const { return dictionaries.size(); }
+
+	// Watch the files of the dictionaries loaded from now on (see DictionaryStreamer::setHotReload)
+	void setHotReload(bool enable) { hotReload = enable; }
+
+	// Storage of the dictionaries (see DictionaryStreamer::setStorageLayout).
+	// Changing it releases the loaded dictionaries, they are streamed again on their next acquire.
+	void setStorageLayout(DictionaryLayout layout);
+	DictionaryLayout storageLayout() const { return layout; }
+
+private:
+	// Files and parameters of a dictionary, see acquire
+	struct Key {
+		std::string name;
+		unsigned int nlevels;
+		int ndists;
+		float alpha;
+
+		bool operator<(const Key& other) const
+		{
+			return std::tie(name, nlevels, ndists, alpha) < std::tie(other.name, other.nlevels, other.ndists, other.alpha);
+		}
+	};
+
+	struct Entry {
+		std::unique_ptr<DictionaryStreamer> streamer;
+		uint64_t lastUsedFrame;
+	};
+
+	size_t budgetBytes;
+	bool hotReload;
+	DictionaryLayout layout;
+	uint64_t frame;
+	std::map<Key, Entry> dictionaries;
+
+	void evict();
+};
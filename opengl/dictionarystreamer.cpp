@@ -0,0 +1,696 @@
+#include "dictionarystreamer.h"
+#include "texture.h"
+#include "halffloat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// Texels of the buffer layouts: RGBA in the format of the texture (the fourth channel is unused),
+	// or RGBA floats for the storage buffer
+	void convertTexels(const void* texels, GLsizei count, DictionaryValueType valueType, int channels, bool toFloat, unsigned char* out)
+	{
+		size_t valueSize = valueType == DictionaryValueType::Float32 ? 4 : valueType == DictionaryValueType::UNorm8 ? 1 : 2;
+		const unsigned char* in = static_cast<const unsigned char*>(texels);
+		size_t outValueSize = toFloat ? sizeof(float) : valueSize;
+		memset(out, 0, count * 4 * outValueSize);
+		for (GLsizei t = 0; t < count; ++t) {
+			for (int c = 0; c < std::min(channels, 3); ++c) {
+				const unsigned char* value = in + (size_t(t) * channels + c) * valueSize;
+				unsigned char* converted = out + (size_t(t) * 4 + c) * outValueSize;
+				if (!toFloat) {
+					memcpy(converted, value, valueSize);
+					continue;
+				}
+				float v;
+				uint16_t v16;
+				switch (valueType) {
+				case DictionaryValueType::Float32:
+					memcpy(&v, value, sizeof(v));
+					break;
+				case DictionaryValueType::Float16:
+					memcpy(&v16, value, sizeof(v16));
+					v = HalfFloat::toFloat(v16);
+					break;
+				case DictionaryValueType::UNorm16:
+					memcpy(&v16, value, sizeof(v16));
+					v = float(v16) / 65535.f;
+					break;
+				default:
+					v = float(*value) / 255.f;
+					break;
+				}
+				memcpy(converted, &v, sizeof(v));
+			}
+		}
+	}
+}
+
+const char* DictionaryLayouts::name(DictionaryLayout layout)
+{
+	switch (layout) {
+	case DictionaryLayout::Array1D:
+		return "array";
+	case DictionaryLayout::Atlas2D:
+		return "atlas";
+	case DictionaryLayout::TextureBuffer:
+		return "tbo";
+	case DictionaryLayout::StorageBuffer:
+		return "ssbo";
+	}
+	return "unknown";
+}
+
+bool DictionaryLayouts::parse(const std::string& name, DictionaryLayout& layout)
+{
+	for (int k = 0; k < Count; ++k) {
+		if (name == DictionaryLayouts::name(static_cast<DictionaryLayout>(k))) {
+			layout = static_cast<DictionaryLayout>(k);
+			return true;
+		}
+	}
+	return false;
+}
+
+DictionaryStreamer::DictionaryStreamer() :
+	nlevels(0), ndists(0), sourceIsPack(false), hotReload(false), dictAlpha(0.f), width(0),
+	compacted(false), textureLayers(0),
+	rowData(nullptr), scaleOffsetData(nullptr), valueType(DictionaryValueType::Float16), rowSize(0),
+	uploadInternalFormat(GL_RGB16F), uploadFormat(GL_RGB), uploadType(GL_HALF_FLOAT),
+	failed(false),
+	storage(DictionaryLayout::Array1D), shards(0), shardLayers(0), atlasTex(0), atlasCols(1), texelBuffer(0), texelBufferTex(0),
+	bufferTexelSize(0), scaleOffsetBuffer(0), scaleOffsetTex(0), supportBuffer(0), supportTex(0), inverseCDFTex(0),
+	uploadedRows(0), uploadedBytes(0), levelMask(0),
+	pbo(0), pboPtr(nullptr), slotRows(0), currentSlot(0)
+{
+	for (int slot = 0; slot < RingSlots; ++slot)
+		slotFences[slot] = 0;
+	for (int shard = 0; shard < MaxShards; ++shard)
+		textures[shard] = 0;
+}
+
+DictionaryStreamer::~DictionaryStreamer()
+{
+	watcher.stop();
+	if (producer.joinable())
+		producer.join();
+
+	for (auto& levelFence : levelFences)
+		glDeleteSync(levelFence.second);
+	releaseRing();
+	if (shards > 0)
+		glDeleteTextures(shards, textures);
+	if (atlasTex)
+		glDeleteTextures(1, &atlasTex);
+	if (texelBufferTex)
+		glDeleteTextures(1, &texelBufferTex);
+	if (texelBuffer)
+		glDeleteBuffers(1, &texelBuffer);
+	if (scaleOffsetTex)
+		glDeleteTextures(1, &scaleOffsetTex);
+	if (scaleOffsetBuffer)
+		glDeleteBuffers(1, &scaleOffsetBuffer);
+	if (supportTex)
+		glDeleteTextures(1, &supportTex);
+	if (supportBuffer)
+		glDeleteBuffers(1, &supportBuffer);
+	if (inverseCDFTex)
+		glDeleteTextures(1, &inverseCDFTex);
+}
+
+void DictionaryStreamer::start(const std::string& dictionaryName, unsigned int nlevels, int ndists, float alpha)
+{
+	this->nlevels = nlevels;
+	this->ndists = ndists;
+	dictAlpha = alpha;
+	startTime = std::chrono::steady_clock::now();
+	updateLevelRank();
+
+	// A packed dictionary is already decoded: all its rows are ready
+	sourceName = dictionaryName + ".dict";
+	sourceIsPack = true;
+	if (openPack(sourceName, true))
+		return;
+
+	// So is a cached decoding of the EXR set. The EXR files remain the source of the dictionary.
+	sourceName = dictionaryName;
+	sourceIsPack = false;
+	std::string cacheName = DictionaryIO::cachedPackName(dictionaryName, nlevels, ndists);
+	if (!cacheName.empty() && openPack(cacheName, false))
+		return;
+
+	// Otherwise decode the EXR set in the background, in priority order. Rows are queued as soon as they are decoded.
+	// Decoding threads also encode the rows in the format of the texture (RGB halves by default),
+	// and find their support. The rows are stored in place: their supports are not known in advance.
+	if (nlevels > 32) {
+		std::cerr << "Dictionaries are limited to 32 levels" << std::endl;
+		failed = true;
+		return;
+	}
+	valueType = DictionaryIO::uploadValueType();
+	compacted = false;
+	textureLayers = this->nlevels * this->ndists;
+	producer = std::thread([this, dictionaryName, cacheName, order = rowOrder()]() {
+		bool encode = valueType != DictionaryValueType::Float32;
+		DictionaryHeader header;
+		bool ret = DictionaryIO::loadEXRSet(dictionaryName, this->nlevels, this->ndists, rows, width,
+			[this, encode, &header](size_t row) {
+				// The first row is decoded alone, before the others
+				if (supports.empty()) {
+					header = DictionaryIO::makeHeader(this->nlevels, this->ndists, width, dictAlpha, valueType,
+						DictionaryIO::channelCount(valueType));
+					if (encode) {
+						encodedRows.resize(header.dataSize);
+						scaleOffset.resize(header.scaleOffsetSize() / sizeof(float));
+					}
+					supports.resize(header.layerCount());
+				}
+				if (encode)
+					DictionaryIO::encodeRow(&rows[row * width * 4], width, valueType, &encodedRows[row * header.rowSize()],
+						scaleOffset.empty() ? nullptr : &scaleOffset[row * 6]);
+				supports[row] = DictionaryIO::rowSupport(header, encode ? static_cast<const void*>(encodedRows.data()) : rows.data(),
+					scaleOffset.empty() ? nullptr : scaleOffset.data(), row);
+				std::lock_guard<std::mutex> lock(queueMutex);
+				readyRows.push_back(row);
+			}, order);
+		if (!ret) {
+			failed = true;
+			return;
+		}
+		if (!cacheName.empty())
+			DictionaryIO::writePack(cacheName, DictionaryIO::makeHeader(this->nlevels, this->ndists, width, dictAlpha,
+				valueType, DictionaryIO::channelCount(valueType)),
+				encode ? static_cast<const void*>(encodedRows.data()) : rows.data(), scaleOffset.data());
+	});
+}
+
+void DictionaryStreamer::setHotReload(bool enable)
+{
+	hotReload = enable;
+	if (!enable)
+		watcher.stop();
+}
+
+void DictionaryStreamer::setLevelPriority(const std::vector<int>& levels)
+{
+	levelPriority = levels;
+	updateLevelRank();
+}
+
+void DictionaryStreamer::updateLevelRank()
+{
+	// Rank of each level in the streaming order, coarse to fine after the prioritized levels
+	int count = int(nlevels);
+	std::vector<int> rank(count, -1);
+	int next = 0;
+	for (int l : levelPriority)
+		if (l >= 0 && l < count && rank[l] < 0)
+			rank[l] = next++;
+	for (int l = count - 1; l >= 0; --l)
+		if (rank[l] < 0)
+			rank[l] = next++;
+	levelRank = rank;
+}
+
+std::vector<size_t> DictionaryStreamer::rowOrder() const
+{
+	std::vector<int> levels(nlevels);
+	for (int l = 0; l < int(nlevels); ++l)
+		levels[levelRank[l]] = l;
+
+	std::vector<size_t> order;
+	order.reserve(size_t(nlevels) * ndists);
+	for (int l : levels)
+		for (int i = 0; i < ndists; ++i)
+			order.push_back(size_t(l) * ndists + i);
+	return order;
+}
+
+bool DictionaryStreamer::openPack(const std::string& packName, bool useHeaderAlpha)
+{
+	if (!pack.open(packName))
+		return false;
+
+	const DictionaryHeader& header = pack.header();
+	if (!Texture::dictionaryUploadFormat(header, uploadInternalFormat, uploadFormat, uploadType)
+		|| header.layerCount() == 0 || header.nlevels > 32) {
+		pack.close();
+		return false;
+	}
+
+	nlevels = header.nlevels;
+	ndists = header.ndists;
+	updateLevelRank();
+	if (useHeaderAlpha)
+		dictAlpha = header.alpha;
+	width = header.width;
+	valueType = static_cast<DictionaryValueType>(header.valueType);
+	rowSize = header.rowSize();
+	rowData = static_cast<const unsigned char*>(pack.data());
+	scaleOffsetData = pack.scaleOffset();
+	compacted = true;
+	textureLayers = DictionaryIO::compactRows(header, rowData, scaleOffsetData, supports);
+	for (size_t row = 0; row < header.layerCount(); ++row)
+		readyRows.push_back(row);
+	return true;
+}
+
+size_t DictionaryStreamer::gpuBytes() const
+{
+	if (supportTex == 0)
+		return 0;
+	size_t rowCount = size_t(nlevels) * ndists;
+	size_t bytes = layerBytes() + rowCount * 4 * sizeof(float);
+	if (scaleOffsetTex)
+		bytes += rowCount * 6 * sizeof(float);
+	if (inverseCDFTex)
+		bytes += rowCount * (InverseCDFSize + 1) * 3 * sizeof(float);
+	if (pbo)
+		bytes += RingSlots * slotRows * rowSize;
+	return bytes;
+}
+
+DictionaryHeader DictionaryStreamer::layout() const
+{
+	return DictionaryIO::makeHeader(nlevels, ndists, width, dictAlpha, valueType, uploadFormat == GL_RGBA ? 4 : 3);
+}
+
+void DictionaryStreamer::update()
+{
+	if (failed)
+		return;
+	if (isResident()) {
+		// Hot reload is disabled when the files cannot be watched
+		if (hotReload && !watcher.isWatching())
+			hotReload = sourceIsPack ? watcher.watchPack(sourceName, layout()) : watcher.watchEXRSet(sourceName, layout());
+		applyPatches();
+		return;
+	}
+
+	// Levels become resident when the GPU has consumed all their rows
+	for (auto it = levelFences.begin(); it != levelFences.end();) {
+		GLenum status = glClientWaitSync(it->second, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			glDeleteSync(it->second);
+			levelMask |= 1u << it->first;
+			it = levelFences.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	if (isResident()) {
+		std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - startTime;
+		std::cout << "Dictionary resident: " << uploadedBytes << " bytes uploaded as "
+			<< DictionaryIO::valueTypeName(valueType) << ", " << textureLayers << " layers for " << uploadedRows << " rows ("
+			<< size_t(width) * uploadedRows * 4 * sizeof(float) << " bytes as RGBA float), "
+			<< loadTime.count() << " ms after start" << std::endl;
+
+		// All the uploads are complete: the ring is no longer needed.
+		// Release the mapped pack. Decoded rows may still be written to the cache
+		// by the producer, they are released with the streamer.
+		releaseRing();
+		if (!producer.joinable()) {
+			rowData = nullptr;
+			scaleOffsetData = nullptr;
+			pack.close();
+		}
+		return;
+	}
+
+	std::vector<size_t> batch;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		batch.assign(readyRows.begin(), readyRows.end());
+		readyRows.clear();
+	}
+	if (batch.empty())
+		return;
+
+	// The rows are allocated by the decoding of the first row, which happens before it is queued
+	if (rowData == nullptr) {
+		DictionaryHeader header = DictionaryIO::makeHeader(nlevels, ndists, width, dictAlpha, valueType,
+			DictionaryIO::channelCount(valueType));
+		Texture::dictionaryUploadFormat(header, uploadInternalFormat, uploadFormat, uploadType);
+		rowSize = header.rowSize();
+		rowData = valueType == DictionaryValueType::Float32 ? reinterpret_cast<const unsigned char*>(rows.data())
+			: encodedRows.data();
+		scaleOffsetData = scaleOffset.empty() ? nullptr : scaleOffset.data();
+	}
+	if (supportTex == 0 && !allocateStorage()) {
+		failed = true;
+		return;
+	}
+
+	// Most wanted levels first, the priority may have changed since the rows were queued
+	std::stable_sort(batch.begin(), batch.end(), [this](size_t a, size_t b) {
+		return levelRank[a / ndists] < levelRank[b / ndists];
+	});
+
+	uploadRows(batch);
+
+	// Rows that did not fit in the ring go back to the queue
+	if (!batch.empty()) {
+		std::lock_guard<std::mutex> lock(queueMutex);
+		readyRows.insert(readyRows.begin(), batch.begin(), batch.end());
+	}
+}
+
+void DictionaryStreamer::applyPatches()
+{
+	std::vector<DictionaryWatcher::RowPatch> patches = watcher.takePatches();
+	if (patches.empty())
+		return;
+
+	// A few rows per save: uploaded from client memory, the driver copies them without waiting for the GPU
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	DictionaryHeader header = layout();
+	size_t texelSize = rowSize / width;
+	for (const DictionaryWatcher::RowPatch& patch : patches) {
+		DictionaryRowSupport support = DictionaryIO::rowSupport(header, patch.values.data(), patch.scaleOffset, 0);
+		DictionaryRowSupport& stored = supports[patch.row];
+		if (!compacted) {
+			// Rows stored in place are uploaded whole, their support follows their content
+			support.layer = uint32_t(patch.row);
+			stored = support;
+			uploadTexels(support.layer, 0, width, patch.values.data());
+			float entry[4];
+			DictionaryIO::supportTableEntry(stored, width, entry);
+			glBindBuffer(GL_TEXTURE_BUFFER, supportBuffer);
+			glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(patch.row * sizeof(entry)), sizeof(entry), entry);
+		}
+		else {
+			// Compacted rows keep their place: texels beyond it are lost until the pack is reloaded
+			if (support.last >= support.first && (support.first < stored.first || support.last > stored.last))
+				std::cerr << "Dictionary hot reload: the support of row " << patch.row << " grew, restart to reload it" << std::endl;
+			if (stored.last >= stored.first)
+				uploadTexels(stored.layer, GLint(stored.offset), stored.last - stored.first + 1, patch.values.data() + stored.first * texelSize);
+		}
+		if (scaleOffsetTex) {
+			glBindBuffer(GL_TEXTURE_BUFFER, scaleOffsetBuffer);
+			glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(patch.row * 6 * sizeof(float)), 6 * sizeof(float), patch.scaleOffset);
+		}
+		uploadInverseCDF(patch.row, patch.values.data(), patch.scaleOffset, 0);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	std::cout << "Dictionary hot reload: " << patches.size() << " rows patched" << std::endl;
+}
+
+void DictionaryStreamer::rowUploaded(size_t row)
+{
+	++uploadedRows;
+	float entry[4];
+	DictionaryIO::supportTableEntry(supports[row], width, entry);
+	glBindBuffer(GL_TEXTURE_BUFFER, supportBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(row * sizeof(entry)), sizeof(entry), entry);
+	if (scaleOffsetTex) {
+		glBindBuffer(GL_TEXTURE_BUFFER, scaleOffsetBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(row * 6 * sizeof(float)), 6 * sizeof(float), scaleOffsetData + row * 6);
+	}
+	uploadInverseCDF(row, rowData, scaleOffsetData, row);
+	int l = int(row / ndists);
+	if (++levelUploadedRows[l] == ndists)
+		levelFences.emplace_back(l, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+void DictionaryStreamer::uploadInverseCDF(size_t row, const void* rows, const float* scaleOffset, size_t sourceRow)
+{
+	if (inverseCDFTex == 0)
+		return;
+	// Texels span the slopes 0 to 4 alpha / sqrt(2), as in the shader
+	DictionaryHeader header = layout();
+	std::vector<float> rgb(size_t(width) * 3);
+	std::vector<float> table(size_t(InverseCDFSize + 1) * 3);
+	DictionaryIO::decodeRow(header, rows, scaleOffset, sourceRow, rgb.data());
+	DictionaryIO::inverseCDFRow(rgb.data(), width, InverseCDFSize, dictAlpha * 4.f / std::sqrt(2.f) / float(width), table.data());
+
+	// Uploaded from client memory, between the rows of the ring
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, inverseCDFTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(row), InverseCDFSize + 1, 1, GL_RGB, GL_FLOAT, table.data());
+}
+
+bool DictionaryStreamer::allocateStorage()
+{
+	levelUploadedRows.assign(nlevels, 0);
+	if (!allocateLayers())
+		return false;
+
+	DictionaryHeader header = layout();
+	supportTex = Texture::createDictionarySupportTexture(header, nullptr, supportBuffer);
+	if (scaleOffsetData != nullptr)
+		scaleOffsetTex = Texture::createDictionaryScaleOffsetTexture(header, nullptr, scaleOffsetBuffer);
+
+	// Without inverse CDF tables, the dictionary is rendered but not sampled
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	if (GLint(header.layerCount()) <= maxSize) {
+		glGenTextures(1, &inverseCDFTex);
+		glBindTexture(GL_TEXTURE_2D, inverseCDFTex);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB32F, InverseCDFSize + 1, GLsizei(header.layerCount()));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else {
+		std::cerr << "Dictionary of " << header.layerCount() << " rows: no inverse CDF tables beyond " << maxSize
+			<< " rows (GL_MAX_TEXTURE_SIZE)" << std::endl;
+	}
+
+	// Persistent mapping needs OpenGL 4.4 (not available on Mac), rows are then uploaded from client memory.
+	// So are the rows of the buffer layouts, converted to the format of the buffer.
+	if (!(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+		|| storage == DictionaryLayout::TextureBuffer || storage == DictionaryLayout::StorageBuffer)
+		return true;
+
+	// One slot holds one level
+	slotRows = ndists;
+	GLsizeiptr size = GLsizeiptr(RingSlots * slotRows * rowSize);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+	pboPtr = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (pboPtr == nullptr) {
+		glDeleteBuffers(1, &pbo);
+		pbo = 0;
+	}
+	return true;
+}
+
+bool DictionaryStreamer::allocateLayers()
+{
+	// Only the supports are uploaded. Filtering reads the neighbors of their first and last texels, with a null weight:
+	// the texels between them must not hold NaNs.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	switch (storage) {
+	case DictionaryLayout::Array1D: {
+		// Shards of equal size, each within the limit of the GL
+		uint32_t maxLayers = Texture::maxArrayTextureLayers();
+		uint32_t shardCount = (textureLayers + maxLayers - 1) / maxLayers;
+		if (shardCount > uint32_t(MaxShards)) {
+			std::cerr << "Dictionary of " << textureLayers << " layers: more than " << MaxShards << " shards of "
+				<< maxLayers << " layers (GL_MAX_ARRAY_TEXTURE_LAYERS)" << std::endl;
+			return false;
+		}
+		shards = int(shardCount);
+		shardLayers = (textureLayers + shardCount - 1) / shardCount;
+		if (shards > 1)
+			std::cout << "Dictionary of " << textureLayers << " layers split in " << shards << " shards of " << shardLayers << " layers" << std::endl;
+
+		std::vector<unsigned char> zeros(rowSize * shardLayers, 0);
+		glGenTextures(shards, textures);
+		for (int shard = 0; shard < shards; ++shard) {
+			GLsizei layers = GLsizei(std::min(shardLayers, textureLayers - shard * shardLayers));
+			glBindTexture(GL_TEXTURE_1D_ARRAY, textures[shard]);
+			glTexStorage2D(GL_TEXTURE_1D_ARRAY, 1, uploadInternalFormat, width, layers);
+			glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, 0, width, layers, uploadFormat, uploadType, zeros.data());
+		}
+		return true;
+	}
+	case DictionaryLayout::Atlas2D: {
+		// Texels are fetched at the center of their row: the rows above and below have a null weight
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		atlasCols = std::max(1, std::min(maxSize / width, int(textureLayers)));
+		GLsizei atlasRows = GLsizei((textureLayers + atlasCols - 1) / atlasCols);
+		if (atlasRows > maxSize) {
+			std::cerr << "Dictionary of " << textureLayers << " layers: larger than an atlas of " << maxSize << " texels (GL_MAX_TEXTURE_SIZE)" << std::endl;
+			return false;
+		}
+		std::vector<unsigned char> zeros(rowSize * atlasCols * atlasRows, 0);
+		glGenTextures(1, &atlasTex);
+		glBindTexture(GL_TEXTURE_2D, atlasTex);
+		glTexStorage2D(GL_TEXTURE_2D, 1, uploadInternalFormat, width * atlasCols, atlasRows);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width * atlasCols, atlasRows, uploadFormat, uploadType, zeros.data());
+		return true;
+	}
+	case DictionaryLayout::TextureBuffer: {
+		// Buffer textures have no RGB format but 32 bits floats: texels get a fourth channel
+		static const GLenum formats[] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA16, GL_RGBA8 };
+		size_t texels = size_t(textureLayers) * width;
+		GLint maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		if (texels > size_t(maxTexels)) {
+			std::cerr << "Dictionary of " << texels << " texels: larger than a buffer texture of " << maxTexels << " texels (GL_MAX_TEXTURE_BUFFER_SIZE)" << std::endl;
+			return false;
+		}
+		bufferTexelSize = 4 * (rowSize / width / (uploadFormat == GL_RGBA ? 4 : 3));
+		std::vector<unsigned char> zeros(texels * bufferTexelSize, 0);
+		glGenBuffers(1, &texelBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, texelBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, zeros.size(), zeros.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glGenTextures(1, &texelBufferTex);
+		glBindTexture(GL_TEXTURE_BUFFER, texelBufferTex);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[int(valueType)], texelBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		return true;
+	}
+	case DictionaryLayout::StorageBuffer: {
+		if (!(GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_shader_storage_buffer_object)) {
+			std::cerr << "Shader storage buffers need OpenGL 4.3" << std::endl;
+			return false;
+		}
+		bufferTexelSize = 4 * sizeof(float);
+		std::vector<unsigned char> zeros(size_t(textureLayers) * width * bufferTexelSize, 0);
+		GLint64 maxSize = 0;
+		glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxSize);
+		if (zeros.size() > size_t(maxSize)) {
+			std::cerr << "Dictionary of " << zeros.size() << " bytes: larger than a shader storage block of " << maxSize << " bytes" << std::endl;
+			return false;
+		}
+		glGenBuffers(1, &texelBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, texelBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size(), zeros.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return true;
+	}
+	}
+	return false;
+}
+
+size_t DictionaryStreamer::layerBytes() const
+{
+	size_t texelSize = rowSize / width;
+	switch (storage) {
+	case DictionaryLayout::Array1D:
+		return size_t(width) * textureLayers * texelSize;
+	case DictionaryLayout::Atlas2D:
+		return size_t(width) * atlasCols * ((textureLayers + atlasCols - 1) / atlasCols) * texelSize;
+	default:
+		return size_t(width) * textureLayers * bufferTexelSize;
+	}
+}
+
+void DictionaryStreamer::releaseRing()
+{
+	for (int slot = 0; slot < RingSlots; ++slot) {
+		if (slotFences[slot])
+			glDeleteSync(slotFences[slot]);
+		slotFences[slot] = 0;
+	}
+	if (pbo) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &pbo);
+	}
+	pbo = 0;
+	pboPtr = nullptr;
+}
+
+bool DictionaryStreamer::acquireSlot(int slot)
+{
+	if (slotFences[slot] == 0)
+		return true;
+	GLenum status = glClientWaitSync(slotFences[slot], 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return false;
+	glDeleteSync(slotFences[slot]);
+	slotFences[slot] = 0;
+	return true;
+}
+
+void DictionaryStreamer::uploadTexels(uint32_t layer, GLint x, GLsizei count, const void* texels)
+{
+	switch (storage) {
+	case DictionaryLayout::Array1D:
+		glBindTexture(GL_TEXTURE_1D_ARRAY, textures[layer / shardLayers]);
+		glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, x, GLint(layer % shardLayers), count, 1, uploadFormat, uploadType, texels);
+		break;
+	case DictionaryLayout::Atlas2D:
+		glBindTexture(GL_TEXTURE_2D, atlasTex);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(layer % atlasCols) * width + x, GLint(layer / atlasCols), count, 1,
+			uploadFormat, uploadType, texels);
+		break;
+	case DictionaryLayout::TextureBuffer:
+	case DictionaryLayout::StorageBuffer: {
+		std::vector<unsigned char> converted(count * bufferTexelSize);
+		convertTexels(texels, count, valueType, uploadFormat == GL_RGBA ? 4 : 3, storage == DictionaryLayout::StorageBuffer,
+			converted.data());
+		GLenum target = storage == DictionaryLayout::TextureBuffer ? GL_TEXTURE_BUFFER : GL_SHADER_STORAGE_BUFFER;
+		glBindBuffer(target, texelBuffer);
+		glBufferSubData(target, GLintptr((size_t(layer) * width + x) * bufferTexelSize), converted.size(), converted.data());
+		glBindBuffer(target, 0);
+		break;
+	}
+	}
+}
+
+void DictionaryStreamer::uploadRows(std::vector<size_t>& batch)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t texelSize = rowSize / width;
+
+	if (pbo == 0) {
+		for (size_t row : batch) {
+			const DictionaryRowSupport& support = supports[row];
+			GLsizei extent = support.last - support.first + 1;
+			if (extent > 0)
+				uploadTexels(support.layer, GLint(support.offset), extent, rowData + row * rowSize + support.first * texelSize);
+			uploadedBytes += extent * texelSize;
+			rowUploaded(row);
+		}
+		batch.clear();
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		return;
+	}
+
+	// Fill the free slots of the ring, the GPU reads a slot while the next ones are written
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	size_t next = 0;
+	while (next < batch.size() && acquireSlot(currentSlot)) {
+		size_t slotOffset = size_t(currentSlot) * slotRows * rowSize;
+		for (size_t k = 0; k < slotRows && next < batch.size(); ++k, ++next) {
+			size_t row = batch[next];
+			const DictionaryRowSupport& support = supports[row];
+			GLsizei extent = support.last - support.first + 1;
+			size_t offset = slotOffset + k * rowSize;
+			if (extent > 0) {
+				memcpy(pboPtr + offset, rowData + row * rowSize + support.first * texelSize, extent * texelSize);
+				uploadTexels(support.layer, GLint(support.offset), extent, reinterpret_cast<const void*>(offset));
+			}
+			uploadedBytes += extent * texelSize;
+			rowUploaded(row);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		}
+		slotFences[currentSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentSlot = (currentSlot + 1) % RingSlots;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	batch.erase(batch.begin(), batch.begin() + next);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "openglogl.h"
+#include "dictionary.h"
+#include "dictionarywatcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Storage of the layers of a dictionary on the GPU, read by the matching accessor of glint.frag.glsl
+enum class DictionaryLayout : int {
+	Array1D = 0,       // GL_TEXTURE_1D_ARRAY shards, filtered by the texture units
+	Atlas2D = 1,       // GL_TEXTURE_2D, the layers side by side in rows of atlasColumns() layers
+	TextureBuffer = 2, // Buffer texture of all the texels, filtered by the shader
+	StorageBuffer = 3  // Shader storage buffer of RGBA floats, filtered by the shader (OpenGL 4.3)
+};
+
+namespace DictionaryLayouts {
+	const int Count = 4;
+	const char* name(DictionaryLayout layout);
+	// "array", "atlas", "tbo" or "ssbo", false for other names
+	bool parse(const std::string& name, DictionaryLayout& layout);
+}
+
+// Asynchronous loading of a dictionary into a GL_TEXTURE_1D_ARRAY, or another DictionaryLayout.
+// Rows are decoded on worker threads while the GL thread streams the decoded rows
+// through a ring of persistently mapped pixel buffer objects, a few rows per frame.
+// Levels are streamed in priority order and become resident one by one.
+// Only the support of each row is stored (see DictionaryRowSupport): the rows of a pack are compacted
+// in fewer layers, the rows of an EXR set, streamed as they are decoded, stay in place.
+// Layers beyond GL_MAX_ARRAY_TEXTURE_LAYERS are split in several array textures, the shards.
+class DictionaryStreamer {
+public:
+	// Number of samplers of the dictionary in the shader
+	static const int MaxShards = 4;
+	// Number of entries of the inverse cumulative distribution of each distribution
+	static const int InverseCDFSize = 256;
+
+	DictionaryStreamer();
+	~DictionaryStreamer();
+
+	// Make it non-copyable.
+	DictionaryStreamer(const DictionaryStreamer&) = delete;
+	DictionaryStreamer& operator=(const DictionaryStreamer&) = delete;
+
+	// Storage of the layers, Array1D by default. Must be called before start.
+	void setStorageLayout(DictionaryLayout layout) { storage = layout; }
+	DictionaryLayout storageLayout() const { return storage; }
+
+	// Start loading dictionaryName.dict if it exists, the EXR set dictionaryName_XXXX_YYYY.exr otherwise.
+	// A decoded EXR set is cached (see DictionaryIO::cachedPackName), later starts read the cache instead.
+	// nlevels, ndists and alpha describe the EXR set, they are replaced by the pack header values.
+	void start(const std::string& dictionaryName, unsigned int nlevels, int ndists, float alpha);
+
+	// Levels to stream first, most wanted first. The other levels follow, coarse to fine
+	// (from level nlevels - 1 down to 0). May be called before start and at any time during streaming.
+	void setLevelPriority(const std::vector<int>& levels);
+
+	// Once resident, watch the loaded files and patch the rows whose file changes (see DictionaryWatcher)
+	void setHotReload(bool enable);
+
+	// Upload the rows decoded since the last call. Must be called on the GL thread, once per frame.
+	void update();
+
+	// Texture name of a shard, 0 until the first rows are decoded. Layer k of the dictionary
+	// (see DictionaryIO::supportTableEntry) is the layer k % layersPerShard() of the shard k / layersPerShard().
+	GLuint texture(int shard = 0) const { return shard < shards ? textures[shard] : 0; }
+	int shardCount() const { return shards; }
+	uint32_t layersPerShard() const { return shardLayers; }
+	// The other layouts, 0 when not used: layer k is at column k % atlasColumns() and row k / atlasColumns() of the atlas,
+	// texels k * width to (k + 1) * width - 1 of the buffers
+	GLuint atlasTexture() const { return atlasTex; }
+	int atlasColumns() const { return atlasCols; }
+	GLuint texelBufferTexture() const { return storage == DictionaryLayout::TextureBuffer ? texelBufferTex : 0; }
+	GLuint storageBuffer() const { return storage == DictionaryLayout::StorageBuffer ? texelBuffer : 0; }
+	// Number of texels of a row
+	int rowWidth() const { return width; }
+	// Buffer texture of the scale and offset table of a quantized dictionary (see Texture::createDictionaryScaleOffsetTexture),
+	// 0 otherwise. The entries of a row are uploaded with the row.
+	GLuint scaleOffsetTexture() const { return scaleOffsetTex; }
+	bool isQuantized() const { return scaleOffsetTex != 0; }
+	// Buffer texture of the support table (see Texture::createDictionarySupportTexture).
+	// The entry of a row is uploaded with the row.
+	GLuint supportTexture() const { return supportTex; }
+	// GL_TEXTURE_2D of the inverse cumulative distributions, to sample the distributions: row r holds the
+	// InverseCDFSize + 1 RGB texels of the layer r of the dictionary (see DictionaryIO::inverseCDFRow).
+	// The table of a row is uploaded with the row.
+	GLuint inverseCDFTexture() const { return inverseCDFTex; }
+	// Bit l is set once all the rows of the level l are uploaded and the GPU signaled it
+	uint32_t residentLevels() const { return levelMask; }
+	// True once all the levels are resident
+	bool isResident() const { return nlevels > 0 && levelMask == allLevels(); }
+	bool hasFailed() const { return failed; }
+	// GPU memory of the layers, of the scale and offset, support and inverse CDF tables, and of the upload ring
+	size_t gpuBytes() const;
+
+	unsigned int levelCount() const { return nlevels; }
+	int distributionsPerChannel() const { return ndists; }
+	float alpha() const { return dictAlpha; }
+
+private:
+	static const int RingSlots = 4;
+
+	unsigned int nlevels;
+	int ndists;
+	std::string sourceName; // Loaded pack, or base name of the EXR set
+	bool sourceIsPack;
+	bool hotReload;
+	DictionaryWatcher watcher;
+	float dictAlpha;
+	int width;
+
+	// Decoded rows, in upload order
+	std::vector<float> rows;
+	std::vector<unsigned char> encodedRows;
+	std::vector<float> scaleOffset;
+	std::vector<DictionaryRowSupport> supports;
+	bool compacted;
+	uint32_t textureLayers;
+	MappedDictionary pack;
+	const unsigned char* rowData;
+	const float* scaleOffsetData;
+	DictionaryValueType valueType;
+	size_t rowSize;
+	GLenum uploadInternalFormat;
+	GLenum uploadFormat;
+	GLenum uploadType;
+
+	std::thread producer;
+	std::mutex queueMutex;
+	std::deque<size_t> readyRows;
+	std::atomic<bool> failed;
+
+	DictionaryLayout storage;
+	GLuint textures[MaxShards];
+	int shards;
+	uint32_t shardLayers;
+	GLuint atlasTex;
+	int atlasCols;
+	GLuint texelBuffer;
+	GLuint texelBufferTex;
+	size_t bufferTexelSize;
+	GLuint scaleOffsetBuffer;
+	GLuint scaleOffsetTex;
+	GLuint supportBuffer;
+	GLuint supportTex;
+	GLuint inverseCDFTex;
+	std::chrono::steady_clock::time_point startTime;
+	size_t uploadedRows;
+	size_t uploadedBytes;
+
+	// Streaming order and residency of the levels
+	std::vector<int> levelPriority;
+	std::vector<int> levelRank;
+	std::vector<int> levelUploadedRows;
+	std::vector<std::pair<int, GLsync>> levelFences;
+	uint32_t levelMask;
+
+	// Ring of persistently mapped pixel buffer objects
+	GLuint pbo;
+	unsigned char* pboPtr;
+	size_t slotRows;
+	int currentSlot;
+	GLsync slotFences[RingSlots];
+
+	uint32_t allLevels() const { return nlevels >= 32 ? ~0u : (1u << nlevels) - 1u; }
+	void updateLevelRank();
+	std::vector<size_t> rowOrder() const;
+	bool openPack(const std::string& packName, bool useHeaderAlpha);
+	DictionaryHeader layout() const;
+	void applyPatches();
+	bool allocateStorage();
+	bool allocateLayers();
+	size_t layerBytes() const;
+	void uploadTexels(uint32_t layer, GLint x, GLsizei count, const void* texels);
+	void releaseRing();
+	bool acquireSlot(int slot);
+	void rowUploaded(size_t row);
+	// Table of the row row of the dictionary, whose values are the row sourceRow of rows
+	void uploadInverseCDF(size_t row, const void* rows, const float* scaleOffset, size_t sourceRow);
+	void uploadRows(std::vector<size_t>& batch);
+};
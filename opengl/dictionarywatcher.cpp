@@ -0,0 +1,246 @@
+#include "dictionarywatcher.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// Events of a single save (or of a generator writing the whole set) are gathered in one reload
+	const int SettleMilliseconds = 50;
+#ifndef __linux__
+	const int PollMilliseconds = 500;
+#endif
+
+	std::string directoryOf(const std::string& fileName)
+	{
+		std::string dir = std::filesystem::path(fileName).parent_path().string();
+		return dir.empty() ? "." : dir;
+	}
+}
+
+#ifdef __linux__
+DictionaryWatcher::DictionaryWatcher() : watchingPack(false), layout(), stopping(false), inotifyFd(-1) {}
+#else
+DictionaryWatcher::DictionaryWatcher() : watchingPack(false), layout(), stopping(false) {}
+#endif
+
+DictionaryWatcher::~DictionaryWatcher()
+{
+	stop();
+}
+
+bool DictionaryWatcher::watchPack(const std::string& packName, const DictionaryHeader& header)
+{
+	return start(packName, true, header);
+}
+
+bool DictionaryWatcher::watchEXRSet(const std::string& baseName, const DictionaryHeader& header)
+{
+	return start(baseName, false, header);
+}
+
+bool DictionaryWatcher::start(const std::string& name, bool pack, const DictionaryHeader& header)
+{
+	stop();
+	watchedName = name;
+	watchingPack = pack;
+	layout = header;
+	rowHashes.assign(header.layerCount(), 0);
+
+#ifdef __linux__
+	// Watch the directory: writePack and most editors replace the files by renaming them
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directoryOf(name).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		std::cerr << "Unable to watch " << directoryOf(name) << ": " << strerror(errno) << std::endl;
+		if (inotifyFd >= 0)
+			close(inotifyFd);
+		inotifyFd = -1;
+		return false;
+	}
+#else
+	// Current modification times, later changes are reported
+	modificationTimes.clear();
+	waitForChanges();
+#endif
+	// The rows of the loaded pack, a rewrite only uploads the rows that changed
+	if (pack)
+		reloadPack(false);
+
+	stopping = false;
+	worker = std::thread(&DictionaryWatcher::run, this);
+	return true;
+}
+
+void DictionaryWatcher::stop()
+{
+	if (!worker.joinable())
+		return;
+	stopping = true;
+	worker.join();
+#ifdef __linux__
+	close(inotifyFd);
+	inotifyFd = -1;
+#endif
+}
+
+std::vector<DictionaryWatcher::RowPatch> DictionaryWatcher::takePatches()
+{
+	std::lock_guard<std::mutex> lock(patchMutex);
+	std::vector<RowPatch> taken;
+	taken.swap(patches);
+	return taken;
+}
+
+void DictionaryWatcher::run()
+{
+	std::string packFile = std::filesystem::path(watchedName).filename().string();
+	while (!stopping) {
+		std::vector<std::string> names = waitForChanges();
+		if (watchingPack) {
+			if (std::find(names.begin(), names.end(), packFile) != names.end())
+				reloadPack(true);
+			continue;
+		}
+
+		std::vector<size_t> rows;
+		for (const std::string& name : names) {
+			int i, l;
+			if (DictionaryIO::parseEXRFileName(watchedName, name, i, l) && l < int(layout.nlevels) && i < int(layout.ndists))
+				rows.push_back(size_t(l) * layout.ndists + i);
+		}
+		std::sort(rows.begin(), rows.end());
+		rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+		if (!rows.empty())
+			reloadRows(rows);
+	}
+}
+
+#ifdef __linux__
+std::vector<std::string> DictionaryWatcher::waitForChanges()
+{
+	std::vector<std::string> names;
+	alignas(inotify_event) char buffer[16 * 1024];
+	pollfd fd = { inotifyFd, POLLIN, 0 };
+	// Wait for a first event, checking for stop regularly, then until no event comes for SettleMilliseconds
+	int timeout = 200;
+	while (!stopping) {
+		int ready = poll(&fd, 1, timeout);
+		if (ready <= 0) {
+			if (!names.empty())
+				break;
+			continue;
+		}
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length;) {
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+				if (event->len > 0 && std::find(names.begin(), names.end(), event->name) == names.end())
+					names.push_back(event->name);
+				ptr += sizeof(inotify_event) + event->len;
+			}
+		}
+		timeout = SettleMilliseconds;
+	}
+	return names;
+}
+#else
+std::vector<std::string> DictionaryWatcher::waitForChanges()
+{
+	std::vector<std::string> files;
+	if (watchingPack) {
+		files.push_back(watchedName);
+	}
+	else {
+		for (int l = 0; l < int(layout.nlevels); ++l)
+			for (int i = 0; i < int(layout.ndists); ++i)
+				files.push_back(DictionaryIO::exrFileName(watchedName, i, l));
+	}
+
+	std::vector<std::string> names;
+	bool first = modificationTimes.empty();
+	modificationTimes.resize(files.size(), 0);
+	while (!stopping) {
+		for (size_t f = 0; f < files.size(); ++f) {
+			std::error_code ec;
+			auto mtime = std::filesystem::last_write_time(files[f], ec);
+			int64_t time = ec ? 0 : int64_t(mtime.time_since_epoch().count());
+			if (time != modificationTimes[f]) {
+				modificationTimes[f] = time;
+				names.push_back(std::filesystem::path(files[f]).filename().string());
+			}
+		}
+		if (first || !names.empty())
+			break;
+		for (int t = 0; t < PollMilliseconds && !stopping; t += SettleMilliseconds)
+			std::this_thread::sleep_for(std::chrono::milliseconds(SettleMilliseconds));
+	}
+	// The first call only records the current state
+	if (first)
+		names.clear();
+	return names;
+}
+#endif
+
+void DictionaryWatcher::reloadPack(bool upload)
+{
+	MappedDictionary pack;
+	if (!pack.open(watchedName))
+		return;
+	const DictionaryHeader& header = pack.header();
+	if (header.nlevels != layout.nlevels || header.ndists != layout.ndists || header.width != layout.width
+		|| header.channels != layout.channels || header.valueType != layout.valueType) {
+		std::cerr << watchedName << ": the layout of the dictionary changed, restart to load it" << std::endl;
+		return;
+	}
+
+	const unsigned char* rows = static_cast<const unsigned char*>(pack.data());
+	const float* scaleOffset = pack.scaleOffset();
+	for (size_t row = 0; row < header.layerCount(); ++row)
+		patch(row, rows + row * header.rowSize(), scaleOffset ? scaleOffset + row * 6 : nullptr, upload);
+}
+
+void DictionaryWatcher::reloadRows(const std::vector<size_t>& rows)
+{
+	DictionaryValueType valueType = static_cast<DictionaryValueType>(layout.valueType);
+	Parallel::forEachIndex(rows.size(), [&](size_t k) {
+		size_t row = rows[k];
+		std::string fileName = DictionaryIO::exrFileName(watchedName, int(row % layout.ndists), int(row / layout.ndists));
+		std::vector<float> rgba(size_t(layout.width) * 4);
+		if (!DictionaryIO::loadEXRRow(fileName, int(layout.width), rgba.data()))
+			return;
+		std::vector<unsigned char> values(layout.rowSize());
+		float scaleOffset[6];
+		DictionaryIO::encodeRow(rgba.data(), int(layout.width), valueType, values.data(), scaleOffset);
+		patch(row, values.data(), layout.isQuantized() ? scaleOffset : nullptr, true);
+	});
+}
+
+void DictionaryWatcher::patch(size_t row, const void* values, const float* scaleOffset, bool upload)
+{
+	RowPatch rowPatch;
+	rowPatch.row = row;
+	rowPatch.values.assign(static_cast<const unsigned char*>(values), static_cast<const unsigned char*>(values) + layout.rowSize());
+	if (scaleOffset)
+		memcpy(rowPatch.scaleOffset, scaleOffset, sizeof(rowPatch.scaleOffset));
+	else
+		memset(rowPatch.scaleOffset, 0, sizeof(rowPatch.scaleOffset));
+
+	// Files saved without changes, and the unchanged rows of a rewritten pack, are not uploaded again
+	uint64_t hash = DictionaryIO::hashBytes(rowPatch.values.data(), rowPatch.values.size())
+		^ DictionaryIO::hashBytes(rowPatch.scaleOffset, sizeof(rowPatch.scaleOffset));
+	std::lock_guard<std::mutex> lock(patchMutex);
+	if (rowHashes[row] == hash)
+		return;
+	rowHashes[row] = hash;
+	if (upload)
+		patches.push_back(std::move(rowPatch));
+}
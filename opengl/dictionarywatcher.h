@@ -0,0 +1,68 @@
+#pragma once
+
+#include "dictionary.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches the files of a loaded dictionary and re-decodes, on a background thread, the rows of the files that change.
+// Uses inotify on Linux, and polls the modification times of the files elsewhere.
+class DictionaryWatcher {
+public:
+	// New content of a row, encoded as the texture
+	struct RowPatch {
+		size_t row;
+		std::vector<unsigned char> values;
+		float scaleOffset[6]; // Quantized dictionaries only
+	};
+
+	DictionaryWatcher();
+	~DictionaryWatcher();
+
+	// Make it non-copyable.
+	DictionaryWatcher(const DictionaryWatcher&) = delete;
+	DictionaryWatcher& operator=(const DictionaryWatcher&) = delete;
+
+	// Watch a packed dictionary. When it is rewritten, the rows that differ are patched.
+	// Packs whose layout differs from header are ignored: they need a restart.
+	bool watchPack(const std::string& packName, const DictionaryHeader& header);
+	// Watch the EXR set baseName_XXXX_YYYY.exr. Each rewritten file is decoded and encoded as header describes.
+	bool watchEXRSet(const std::string& baseName, const DictionaryHeader& header);
+	void stop();
+
+	bool isWatching() const { return worker.joinable(); }
+
+	// Patches decoded since the last call, in decoding order
+	std::vector<RowPatch> takePatches();
+
+private:
+	std::string watchedName; // Pack or base name of the EXR set
+	bool watchingPack;
+	DictionaryHeader layout;
+
+	std::thread worker;
+	std::atomic<bool> stopping;
+	std::mutex patchMutex;
+	std::vector<RowPatch> patches;
+	// Hash of the last content of each row, 0 until the row is reloaded once
+	std::vector<uint64_t> rowHashes;
+
+	bool start(const std::string& name, bool pack, const DictionaryHeader& header);
+	void run();
+	// Names (without directory) of the files written since the last call, waits for changes until stop
+	std::vector<std::string> waitForChanges();
+	// Without upload, only the hashes of the rows are recorded
+	void reloadPack(bool upload);
+	void reloadRows(const std::vector<size_t>& rows);
+	void patch(size_t row, const void* values, const float* scaleOffset, bool upload);
+
+#ifdef __linux__
+	int inotifyFd;
+#else
+	std::vector<int64_t> modificationTimes;
+#endif
+};
@@ -8,6 +8,7 @@ using std::ifstream;
 using std::ios;
 using std::string;
 
+#include <algorithm>
 #include <sstream>
 #include <sys/stat.h>
 #include <vector>
@@ -34,7 +35,7 @@ namespace GLSLShaderInfo {
 	};
 }
 
-GLSLProgram::GLSLProgram() : handle(0), linked(false) {}
+GLSLProgram::GLSLProgram() : handle(0), linked(false), includeCount(0) {}
 
 GLSLProgram::~GLSLProgram() {
     if (handle == 0) return;
@@ -134,7 +135,25 @@ void GLSLProgram::compileShader(const string &source,
 
     GLuint shaderHandle = glCreateShader(type);
 
-    const char *c_code = source.c_str();
+    // The #version directive must come first, then the #extension directives before any code
+    string code = source;
+    if (!defines.empty() || !includes.empty()) {
+        size_t version = code.find("#version");
+        size_t insert = 0;
+        int line = 1;
+        if (version != string::npos) {
+            insert = code.find('\n', version);
+            insert = insert == string::npos ? code.size() : insert + 1;
+            while (code.compare(insert, 10, "#extension") == 0) {
+                insert = code.find('\n', insert);
+                insert = insert == string::npos ? code.size() : insert + 1;
+            }
+            line = 1 + int(std::count(code.begin(), code.begin() + insert, '\n'));
+        }
+        code.insert(insert, defines + includes + "#line " + std::to_string(line) + " 0\n");
+    }
+
+    const char *c_code = code.c_str();
     glShaderSource(shaderHandle, 1, &c_code, NULL);
 
     // Compile the shader
@@ -168,6 +187,22 @@ void GLSLProgram::compileShader(const string &source,
     }
 }
 
+void GLSLProgram::addDefine(const string &name, const string &value) {
+    defines += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+}
+
+void GLSLProgram::addInclude(const char *fileName) {
+    ifstream inFile(fileName, ios::in);
+    if (!inFile) {
+        string message = string("Unable to open: ") + fileName;
+        throw GLSLProgramException(message);
+    }
+
+    std::stringstream code;
+    code << inFile.rdbuf();
+    includes += "#line 1 " + std::to_string(++includeCount) + "\n" + code.str() + "\n";
+}
+
 void GLSLProgram::link() {
     if (linked) return;
     if (handle <= 0) throw GLSLProgramException("Program has not been compiled.");
@@ -33,6 +33,9 @@ private:
     GLuint handle;
     bool linked;
     std::map<std::string, int> uniformLocations;
+    std::string defines; // #define lines of addDefine
+    std::string includes; // Code of the files of addInclude, each after a #line directive
+    int includeCount;
 
     inline GLint getUniformLocation(const char *name);
 	void detachAndDeleteShaderObjects();
@@ -52,6 +55,15 @@ public:
     void compileShader(const std::string &source, GLSLShader::GLSLShaderType type,
                        const char *fileName = NULL);
 
+    // Define the macro name (with a value, optional) in the shaders compiled next, after their #version line.
+    // The lines of the sources keep their numbers in the compilation logs.
+    void addDefine(const std::string &name, const std::string &value = "");
+
+    // Insert the code of a file (without #version line) in the shaders compiled next, after their defines: the
+    // shaders share one source of the functions that must be identical in all of them. In the compilation logs, the
+    // lines of the n-th included file are numbered from 1 in the source string n.
+    void addInclude(const char *fileName);
+
     void link();
     void validate();
     void use();
@@ -0,0 +1,161 @@
+#include "halffloat.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HALFFLOAT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// The vectorised path is compiled for F16C/AVX2 whatever the global flags, and only called after a CPUID check
+#if defined(HALFFLOAT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define HALFFLOAT_TARGET_F16C __attribute__((target("avx2,f16c")))
+#else
+#define HALFFLOAT_TARGET_F16C
+#endif
+
+namespace {
+
+	void convertScalar(const float* rgba, uint16_t* rgb, size_t texelCount)
+	{
+		for (size_t t = 0; t < texelCount; ++t) {
+			rgb[3 * t + 0] = HalfFloat::fromFloat(rgba[4 * t + 0]);
+			rgb[3 * t + 1] = HalfFloat::fromFloat(rgba[4 * t + 1]);
+			rgb[3 * t + 2] = HalfFloat::fromFloat(rgba[4 * t + 2]);
+		}
+	}
+
+#ifdef HALFFLOAT_X86
+	HALFFLOAT_TARGET_F16C
+	void convertF16C(const float* rgba, uint16_t* rgb, size_t texelCount)
+	{
+		// Keep the halves 0, 1, 2 and 4, 5, 6 of two RGBA texels
+		const __m128i dropAlpha = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+
+		size_t t = 0;
+		// 4 texels per iteration: two 8 floats conversions, two 12 bytes stores
+		for (; t + 4 <= texelCount; t += 4) {
+			__m128i h0 = _mm256_cvtps_ph(_mm256_loadu_ps(rgba + 4 * t), _MM_FROUND_TO_NEAREST_INT);
+			__m128i h1 = _mm256_cvtps_ph(_mm256_loadu_ps(rgba + 4 * t + 8), _MM_FROUND_TO_NEAREST_INT);
+			h0 = _mm_shuffle_epi8(h0, dropAlpha);
+			h1 = _mm_shuffle_epi8(h1, dropAlpha);
+			uint16_t packed[16];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(packed), h0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(packed + 8), h1);
+			memcpy(rgb + 3 * t, packed, 6 * sizeof(uint16_t));
+			memcpy(rgb + 3 * t + 6, packed + 8, 6 * sizeof(uint16_t));
+		}
+		convertScalar(rgba + 4 * t, rgb + 3 * t, texelCount - t);
+	}
+
+	bool detectF16C()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool f16c = (info[2] & (1 << 29)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		return f16c && avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+namespace HalfFloat {
+
+uint16_t fromFloat(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000u;
+	uint32_t absx = x & 0x7fffffffu;
+
+	// NaN and infinity
+	if (absx >= 0x7f800000u)
+		return uint16_t(sign | 0x7c00u | (absx > 0x7f800000u ? 0x200u : 0u));
+	// Overflow
+	if (absx >= 0x477ff000u)
+		return uint16_t(sign | 0x7c00u);
+	// Denormals and zero
+	if (absx < 0x38800000u) {
+		if (absx <= 0x33000000u)
+			return uint16_t(sign);
+		uint32_t mantissa = (absx & 0x007fffffu) | 0x00800000u;
+		int shift = 126 - int(absx >> 23);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1u);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+			++half;
+		return uint16_t(sign | half);
+	}
+	// Normals, round to nearest even
+	uint32_t half = (absx - 0x38000000u) >> 13;
+	uint32_t rest = absx & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+		++half;
+	return uint16_t(sign | half);
+}
+
+float toFloat(uint16_t h)
+{
+	uint32_t sign = uint32_t(h & 0x8000u) << 16;
+	uint32_t exponent = (h >> 10) & 0x1fu;
+	uint32_t mantissa = h & 0x3ffu;
+	uint32_t x;
+	if (exponent == 0x1fu) {
+		x = sign | 0x7f800000u | (mantissa << 13);
+	}
+	else if (exponent != 0) {
+		x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+	}
+	else if (mantissa == 0) {
+		x = sign;
+	}
+	else {
+		// Normalize the denormal
+		exponent = 113;
+		while ((mantissa & 0x400u) == 0) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		x = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+bool hasF16C()
+{
+#ifdef HALFFLOAT_X86
+	static const bool supported = detectF16C();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+void convertRGBAToRGB(const float* rgba, uint16_t* rgb, size_t texelCount)
+{
+#ifdef HALFFLOAT_X86
+	if (hasF16C()) {
+		convertF16C(rgba, rgb, texelCount);
+		return;
+	}
+#endif
+	convertScalar(rgba, rgb, texelCount);
+}
+
+} // namespace HalfFloat
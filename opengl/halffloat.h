@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// IEEE 754 half precision floats, as uploaded with GL_HALF_FLOAT
+namespace HalfFloat
+{
+	// Round to nearest even, overflows to infinity
+	uint16_t fromFloat(float f);
+	float toFloat(uint16_t h);
+
+	// True when the CPU converts with F16C/AVX2 instructions
+	bool hasF16C();
+
+	// Repack texelCount RGBA floats into RGB halves, dropping the alpha channel.
+	// Uses F16C/AVX2 when the CPU supports it, a scalar conversion otherwise.
+	void convertRGBAToRGB(const float* rgba, uint16_t* rgb, size_t texelCount);
+}
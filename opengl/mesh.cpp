@@ -17,13 +17,15 @@ using std::ifstream;
 using std::istringstream;
 #include <map>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const std::string& name)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const std::string& name, bool upload) :
+    VAO(0), VBO(0), EBO(0)
 { 
     this->vertices = vertices;
     this->indices = indices;
     this->name = name;
 
-    setupMesh();
+    if (upload)
+        setupMesh();
 }
 
 void Mesh::Draw(GLSLProgram& shader)
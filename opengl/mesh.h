@@ -30,7 +30,8 @@ public:
     unsigned int VAO;
     std::string name;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const std::string& name);
+    // Without upload, no buffer is created and VAO is 0
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const std::string& name, bool upload = true);
     void Draw(GLSLProgram& shader);
 private:
     //  render data
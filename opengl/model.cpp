@@ -102,5 +102,5 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 			indices.push_back(face.mIndices[j]);
 	}
 
-	return Mesh(vertices, indices, mesh->mName.C_Str());
+	return Mesh(vertices, indices, mesh->mName.C_Str(), upload);
 }
@@ -18,15 +18,18 @@
 
 class Model {
 public:
-	Model(const std::string& path)
+	// Without upload, the meshes are only loaded in memory, for the renderers without OpenGL context
+	Model(const std::string& path, bool upload = true) : upload(upload)
 	{
 		loadModel(path);
 	}
 	void Draw(GLSLProgram& shader);
+	const std::vector<Mesh>& getMeshes() const { return meshes; }
 private:
 	// model data
 	std::vector<Mesh> meshes;
 	std::string directory;
+	bool upload;
 
 	void loadModel(const std::string& path);
 	void processNode(aiNode* node, const aiScene* scene);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+	// Number of worker threads used by forEachIndex
+	inline unsigned int threadCount()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Call f(i) for each i in [0, count) on a pool of worker threads.
+	// Indices are handed out one by one through an atomic counter, so uneven work items balance out.
+	template <typename F>
+	void forEachIndex(size_t count, const F& f, unsigned int nthreads = 0)
+	{
+		if (nthreads == 0)
+			nthreads = threadCount();
+		nthreads = unsigned(std::min<size_t>(nthreads, count));
+		if (nthreads <= 1) {
+			for (size_t i = 0; i < count; ++i)
+				f(i);
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++)
+				f(i);
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(nthreads - 1);
+		for (unsigned int t = 1; t < nthreads; ++t)
+			workers.emplace_back(worker);
+		worker();
+		for (std::thread& t : workers)
+			t.join();
+	}
+}
@@ -40,4 +40,9 @@ public:
       Called when screen is resized
       */
     virtual void resize(int, int) = 0;
+
+    /**
+      Exit status of the program, once the window is closed
+      */
+    virtual int exitStatus() const { return 0; }
 };
@@ -23,7 +23,7 @@ private:
 	bool debug;           // Set true to enable debug messages
 
 public:
-    SceneRunner(const std::string & windowTitle, int width = WIN_WIDTH, int height = WIN_HEIGHT, int samples = 0) : debug(false) {
+    SceneRunner(const std::string & windowTitle, int width = WIN_WIDTH, int height = WIN_HEIGHT, int samples = 0, bool visible = true) : debug(false) {
         // Initialize GLFW
         if( !glfwInit() ) exit( EXIT_FAILURE );
 
@@ -44,6 +44,8 @@ public:
         if(samples > 0) {
             glfwWindowHint(GLFW_SAMPLES, samples);
         }
+        // Hidden windows for the scenes rendering off screen
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
         // Open the window
 
@@ -101,7 +103,7 @@ public:
 
     int run(std::unique_ptr<Scene> scene) {        
         // Enter the main loop
-        mainLoop(window, std::move(scene));
+        int status = mainLoop(window, std::move(scene));
 
 #ifndef __APPLE__
 		if( debug )
@@ -113,7 +115,7 @@ public:
 		glfwTerminate();
 
         // Exit program
-        return EXIT_SUCCESS;
+        return status;
     }
 
     static std::string parseCLArgs(int argc, char ** argv, std::map<std::string, std::string> & sceneData) {
@@ -142,7 +144,7 @@ private:
         }
     }
 
-    void mainLoop(GLFWwindow * window, std::unique_ptr<Scene> scene) {
+    int mainLoop(GLFWwindow * window, std::unique_ptr<Scene> scene) {
         
         scene->setDimensions(fbw, fbh);
         scene->initScene();
@@ -164,5 +166,7 @@ private:
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
+
+        return scene->exitStatus();
     }
 };
@@ -1,83 +1,247 @@
-#define TINYEXR_IMPLEMENTATION
-
 #include "texture.h"
 #include "stb/stb_image.h"
 #include "glutils.h"
-#include "tinyexr.h"
+#include "halffloat.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
+
+namespace {
+	// Allocate the array texture and upload all the rows at once.
+	// With a support texture, only the support of the rows is stored (see DictionaryIO::compactRows).
+	GLuint createDictionaryTexture(const DictionaryHeader& header, const void* rows, const float* scaleOffset, GLuint* scaleOffsetTex,
+		GLuint* supportTex)
+	{
+		GLenum internalFormat, format, type;
+		if (!Texture::dictionaryUploadFormat(header, internalFormat, format, type))
+			return 0;
+		if (header.isQuantized() && scaleOffsetTex == nullptr) {
+			std::cerr << "Quantized dictionaries need a scale and offset texture" << std::endl;
+			return 0;
+		}
+
+		GLsizei layerCount = header.layerCount();
+		const void* layers = rows;
+		std::vector<unsigned char> compacted;
+		std::vector<float> supportTable;
+		if (supportTex) {
+			std::vector<DictionaryRowSupport> supports;
+			layerCount = DictionaryIO::compactRows(header, rows, scaleOffset, supports);
+			size_t rowSize = header.rowSize();
+			size_t texelSize = rowSize / header.width;
+			compacted.assign(rowSize * layerCount, 0);
+			supportTable.resize(supports.size() * 4);
+			for (size_t row = 0; row < supports.size(); ++row) {
+				const DictionaryRowSupport& support = supports[row];
+				memcpy(&compacted[support.layer * rowSize + support.offset * texelSize],
+					static_cast<const unsigned char*>(rows) + row * rowSize + support.first * texelSize,
+					(support.last - support.first + 1) * texelSize);
+				DictionaryIO::supportTableEntry(support, header.width, &supportTable[row * 4]);
+			}
+			layers = compacted.data();
+		}
+
+		if (GLuint(layerCount) > Texture::maxArrayTextureLayers()) {
+			std::cerr << "Dictionary of " << layerCount << " layers: more than GL_MAX_ARRAY_TEXTURE_LAYERS, "
+				<< "load it with DictionaryStreamer, which splits it" << std::endl;
+			return 0;
+		}
+
+		GLuint texID;
+		glGenTextures(1, &texID);
+		glBindTexture(GL_TEXTURE_1D_ARRAY, texID);
+
+		GLsizei mipLevelCount = 1;
+
+		// Allocate the storage
+		glTexStorage2D(GL_TEXTURE_1D_ARRAY, mipLevelCount, internalFormat, header.width, layerCount);
+
+		// Upload pixel data, all the layers at once
+		// The first 0 refers to the mipmap level (level 0)
+		// The following zero refers to the x offset in case you only want to specify a subrectangle
+		// The final 0 refers to the layer index offset (we start from index 0)
+		// The upload is timed with GLINT_DICTIONARY_UPLOAD_TIMING=1 only: the time is the one of a glFinish, which
+		// stalls the CPU on the whole pipeline
+		const char* timing = getenv("GLINT_DICTIONARY_UPLOAD_TIMING");
+		bool timed = timing && atoi(timing) != 0;
+		// Rows of 3 halves per texel are not 4 bytes aligned, the alignment of the application is restored after
+		GLint unpackAlignment = 4;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+		auto start = std::chrono::steady_clock::now();
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, 0, header.width, layerCount, format, type, layers);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+		if (timed)
+			glFinish();
+		std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - start;
+
+		std::cout << "Dictionary upload: " << header.rowSize() * layerCount + header.scaleOffsetSize() + supportTable.size() * sizeof(float)
+			<< " bytes as " << DictionaryIO::valueTypeName(static_cast<DictionaryValueType>(header.valueType)) << ", "
+			<< layerCount << " layers for " << header.layerCount() << " rows ("
+			<< size_t(header.width) * header.layerCount() * 4 * sizeof(float) << " bytes as RGBA float)";
+		if (timed)
+			std::cout << ", " << uploadTime.count() << " ms";
+		std::cout << std::endl;
 
-const char* err = nullptr;
+		glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 
-GLuint Texture::loadMultiscaleMarginalDistributions(const std::string& baseName, const unsigned int nlevels, const GLsizei ndists)
+		// The buffers live as long as the textures they are attached to
+		if (header.isQuantized()) {
+			GLuint buffer;
+			*scaleOffsetTex = Texture::createDictionaryScaleOffsetTexture(header, scaleOffset, buffer);
+			glDeleteBuffers(1, &buffer);
+		}
+		if (supportTex) {
+			GLuint buffer;
+			*supportTex = Texture::createDictionarySupportTexture(header, supportTable.data(), buffer);
+			glDeleteBuffers(1, &buffer);
+		}
+
+		return texID;
+	}
+}
+
+bool Texture::dictionaryUploadFormat(const DictionaryHeader& header, GLenum& internalFormat, GLenum& format, GLenum& type)
 {
+	// Filtering is linear in the normalized values: the per row rescaling can be applied after it
+	switch (static_cast<DictionaryValueType>(header.valueType)) {
+	case DictionaryValueType::Float32:
+		internalFormat = GL_RGB16F;
+		type = GL_FLOAT;
+		break;
+	case DictionaryValueType::Float16:
+		internalFormat = GL_RGB16F;
+		type = GL_HALF_FLOAT;
+		break;
+	case DictionaryValueType::UNorm16:
+		internalFormat = GL_RGB16;
+		type = GL_UNSIGNED_SHORT;
+		break;
+	case DictionaryValueType::UNorm8:
+		internalFormat = GL_RGB8;
+		type = GL_UNSIGNED_BYTE;
+		break;
+	default:
+		return false;
+	}
+	if (header.channels == 4)
+		format = GL_RGBA;
+	else if (header.channels == 3)
+		format = GL_RGB;
+	else
+		return false;
+	return true;
+}
+
+GLuint Texture::createDictionaryScaleOffsetTexture(const DictionaryHeader& header, const float* scaleOffset, GLuint& buffer)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, header.scaleOffsetSize(), scaleOffset, GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
 	GLuint texID;
 	glGenTextures(1, &texID);
-	glBindTexture(GL_TEXTURE_1D_ARRAY, texID);
+	glBindTexture(GL_TEXTURE_BUFFER, texID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	return texID;
+}
+
+GLuint Texture::maxArrayTextureLayers()
+{
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (const char* limit = getenv("GLINT_DICTIONARY_MAX_LAYERS")) {
+		int layers = atoi(limit);
+		if (layers > 0 && layers < maxLayers)
+			maxLayers = layers;
+	}
+	return GLuint(std::max(maxLayers, 1));
+}
+
+GLuint Texture::createDictionarySupportTexture(const DictionaryHeader& header, const float* table, GLuint& buffer)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size_t(header.layerCount()) * 4 * sizeof(float), table, GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GLuint texID;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_BUFFER, texID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	return texID;
+}
 
+GLuint Texture::loadMultiscaleMarginalDistributions(const std::string& baseName, const unsigned int nlevels, const GLsizei ndists,
+	GLuint* scaleOffsetTex, GLuint* supportTex)
+{
+	// Warm start: the decoded dictionary is read back from the cache
+	std::string cacheName = DictionaryIO::cachedPackName(baseName, nlevels, ndists);
+	if (!cacheName.empty()) {
+		GLuint texID = loadPackedMultiscaleMarginalDistributions(cacheName, nullptr, scaleOffsetTex, supportTex);
+		if (texID != 0)
+			return texID;
+	}
+
+	// Decode all the EXR files on worker threads, into rows stored in upload order
+	std::vector<float> rows;
 	GLint width;
-	GLint height;
-	GLsizei layerCount = ndists * nlevels;
-	GLsizei mipLevelCount = 1;
-
-	// Load the first one to get width/height
-	std::string texName = baseName + "_0000" + "_" + "0000" + ".exr";
-	float* data;
-	bool ret = exrio::LoadEXRRGBA(&data, &width, &height, texName.c_str(), err);
-	if (!ret) {
+	size_t allocations = DictionaryIO::exrAllocationCount();
+	if (!DictionaryIO::loadEXRSet(baseName, nlevels, ndists, rows, width)) {
 		exit(-1);
 	}
+	std::cout << "Dictionary decoding: " << nlevels * ndists << " files, "
+		<< DictionaryIO::exrAllocationCount() - allocations << " decode allocations" << std::endl;
 
-	// Allocate the storage
-	glTexStorage2D(GL_TEXTURE_1D_ARRAY, mipLevelCount, GL_RGB16F, width, layerCount);
-
-	// Upload pixel data
-	// The first 0 refers to the mipmap level (level 0)
-	// The following zero refers to the x offset in case you only want to specify a subrectangle
-	// The final 0 refers to the layer index offset (we start from index 0)
-	glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, 0, width, 1, GL_RGBA, GL_FLOAT, data);
-
-	free(data);
-
-	// Load the other 1D distributions
-	for (int l = 0; l < nlevels; ++l) {
-		std::string index_level;
-		if (l < 10)
-			index_level = "000" + std::to_string(l);
-		else if (l < 100)
-			index_level = "00" + std::to_string(l);
-		else if (l < 1000)
-			index_level = "0" + std::to_string(l);
-		else
-			index_level = std::to_string(l);
-
-		for (int i = 0; i < ndists; i++) {
-
-			if (l == 0 && i == 0) continue;
-
-			std::string index_dist;
-			if (i < 10)
-				index_dist = "000" + std::to_string(i);
-			else if (i < 100)
-				index_dist = "00" + std::to_string(i);
-			else if (i < 1000)
-				index_dist = "0" + std::to_string(i);
-			else
-				index_dist = std::to_string(i);
-
-			texName = baseName + "_" + index_dist + "_" + index_level + ".exr";
-			bool ret = exrio::LoadEXRRGBA(&data, &width, &height, texName.c_str(), err);
-			if (!ret) {
-				exit(-1);
-			}
-			glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, l * ndists + i, width, 1, GL_RGBA, GL_FLOAT, data);
-			free(data);
-		}
+	// The EXR set does not store alpha_dist, the header leaves it to 0
+	DictionaryValueType valueType = DictionaryIO::uploadValueType();
+	DictionaryHeader header = DictionaryIO::makeHeader(nlevels, ndists, width, 0.f, valueType, DictionaryIO::channelCount(valueType));
+	const void* data = rows.data();
+	std::vector<unsigned char> values;
+	std::vector<float> scaleOffset;
+	if (valueType != DictionaryValueType::Float32) {
+		// Upload the rows in the format of the texture
+		auto start = std::chrono::steady_clock::now();
+		DictionaryIO::encodeRows(header, rows, values, scaleOffset);
+		std::chrono::duration<double, std::milli> convertTime = std::chrono::steady_clock::now() - start;
+		std::cout << "Dictionary conversion to " << DictionaryIO::valueTypeName(valueType);
+		if (valueType == DictionaryValueType::Float16)
+			std::cout << " (" << (HalfFloat::hasF16C() ? "F16C" : "scalar") << ")";
+		std::cout << ": " << convertTime.count() << " ms" << std::endl;
+		data = values.data();
+	}
+
+	if (!cacheName.empty())
+		DictionaryIO::writePack(cacheName, header, data, scaleOffset.data());
+
+	return createDictionaryTexture(header, data, scaleOffset.data(), scaleOffsetTex, supportTex);
+}
+
+GLuint Texture::loadPackedMultiscaleMarginalDistributions(const std::string& packName, DictionaryHeader* header, GLuint* scaleOffsetTex,
+	GLuint* supportTex)
+{
+	MappedDictionary pack;
+	if (!pack.open(packName))
+		return 0;
+
+	// All the rows are contiguous in upload order: a single upload from the mapped file, unless compacted
+	GLuint texID = createDictionaryTexture(pack.header(), pack.data(), pack.scaleOffset(), scaleOffsetTex, supportTex);
+	if (texID == 0) {
+		std::cerr << packName << ": unsupported texel format" << std::endl;
+		return 0;
 	}
 
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	if (header)
+		*header = pack.header();
 
 	return texID;
 }
@@ -1,8 +1,28 @@
+#pragma once
 
 #include "openglogl.h"
+#include "dictionary.h"
 #include <string>
 
 class Texture {
 public:
-    static GLuint loadMultiscaleMarginalDistributions(const std::string& baseName, const unsigned int nlevels, const GLsizei ndists);
+    // Quantized dictionaries (see DictionaryIO::uploadValueType) also create the buffer texture of their scale and offset table.
+    // With supportTex, the rows are compacted to their support and supportTex is their support table
+    // (see createDictionarySupportTexture). Without it, the rows are stored in place.
+    static GLuint loadMultiscaleMarginalDistributions(const std::string& baseName, const unsigned int nlevels, const GLsizei ndists,
+        GLuint* scaleOffsetTex = nullptr, GLuint* supportTex = nullptr);
+    // Upload a packed dictionary (.dict) straight from its memory mapping. Returns 0 on failure.
+    static GLuint loadPackedMultiscaleMarginalDistributions(const std::string& packName, DictionaryHeader* header = nullptr,
+        GLuint* scaleOffsetTex = nullptr, GLuint* supportTex = nullptr);
+    // Layers of an array texture: GL_MAX_ARRAY_TEXTURE_LAYERS, or less with GLINT_DICTIONARY_MAX_LAYERS (to test sharding).
+    // Larger dictionaries are split by DictionaryStreamer.
+    static GLuint maxArrayTextureLayers();
+    // Texture and client formats, and type of the rows of a pack, false if they cannot be uploaded
+    static bool dictionaryUploadFormat(const DictionaryHeader& header, GLenum& internalFormat, GLenum& format, GLenum& type);
+    // GL_RGB32F buffer texture of the scale and offset table of a quantized dictionary: texel 2 * row holds
+    // the scales of the row, texel 2 * row + 1 its offsets. scaleOffset may be null to upload it later.
+    static GLuint createDictionaryScaleOffsetTexture(const DictionaryHeader& header, const float* scaleOffset, GLuint& buffer);
+    // GL_RGBA32F buffer texture of the support table of a dictionary: texel row holds the entry of the row
+    // (see DictionaryIO::supportTableEntry). table may be null to upload it later.
+    static GLuint createDictionarySupportTexture(const DictionaryHeader& header, const float* table, GLuint& buffer);
 };
\ No newline at end of file
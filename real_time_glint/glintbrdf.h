@@ -0,0 +1,851 @@
+#pragma once
+
+#include "dictionary.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// C++ reference of the glint BRDF of shader/glint.frag.glsl, function by function, for renderers and tools without GPU.
+// The uniforms of the shader are the members of GlintBRDF, the derivatives of the texture coordinates (dFdx and dFdy
+// in the shader) are explicit. Computations are in single precision, as on the GPU: results differ from the shader
+// by the precision of the GPU math functions and of the texture filtering.
+
+// Dictionary as the shader reads it: the rows decoded to RGB floats (Float16 by default, see DictionaryIO::uploadValueType),
+// their support table and their inverse CDF tables.
+class GlintDictionary {
+public:
+	static const int InverseCDFSize = 256; // See DictionaryStreamer::InverseCDFSize
+
+	float alpha;             // Dictionary.Alpha
+	int n;                   // Dictionary.N
+	int nlevels;             // Dictionary.NLevels
+	int width;               // Dictionary.Width
+	std::vector<float> rows; // layerCount * width RGB floats
+	std::vector<float> support;    // layerCount * 2 floats: texel coordinates below the first and above the second are null
+	std::vector<float> inverseCDF; // layerCount * (InverseCDFSize + 1) RGB floats (see DictionaryIO::inverseCDFRow)
+
+	GlintDictionary() : alpha(0.f), n(0), nlevels(0), width(0) {}
+
+	// Load dictionaryName.dict if it exists, the EXR set dictionaryName_XXXX_YYYY.exr otherwise (through the cache,
+	// see DictionaryIO::cachedPackName), as DictionaryStreamer does. nlevels, ndists and alpha describe the EXR set.
+	bool load(const std::string& dictionaryName, unsigned int nlevels, int ndists, float alpha)
+	{
+		MappedDictionary pack;
+		if (pack.open(dictionaryName + ".dict")) {
+			decode(pack.header(), pack.data(), pack.scaleOffset(), pack.header().alpha);
+			return true;
+		}
+		std::string cacheName = DictionaryIO::cachedPackName(dictionaryName, nlevels, ndists);
+		if (!cacheName.empty() && pack.open(cacheName)) {
+			decode(pack.header(), pack.data(), pack.scaleOffset(), alpha);
+			return true;
+		}
+
+		// Encoded and decoded in the format of the texture, the values are the ones the GPU filters
+		std::vector<float> rgba;
+		int exrWidth;
+		if (!DictionaryIO::loadEXRSet(dictionaryName, nlevels, ndists, rgba, exrWidth))
+			return false;
+		DictionaryValueType valueType = DictionaryIO::uploadValueType();
+		DictionaryHeader header = DictionaryIO::makeHeader(nlevels, ndists, exrWidth, alpha, valueType, DictionaryIO::channelCount(valueType));
+		if (valueType == DictionaryValueType::Float32) {
+			decode(header, rgba.data(), nullptr, alpha);
+			return true;
+		}
+		std::vector<unsigned char> values;
+		std::vector<float> scaleOffset;
+		DictionaryIO::encodeRows(header, rgba, values, scaleOffset);
+		decode(header, values.data(), scaleOffset.empty() ? nullptr : scaleOffset.data(), alpha);
+		return true;
+	}
+
+	// dictionaryLookup of the shader: the texel coordinate texel (0 to width) of a row, linearly interpolated
+	// between the texel centers and clamped to the first and last ones (GL_LINEAR, GL_CLAMP_TO_EDGE)
+	glm::vec3 lookup(float texel, int row) const
+	{
+		float x = texel - 0.5f;
+		int t0 = std::min(std::max(int(std::floor(x)), 0), width - 1);
+		int t1 = std::min(t0 + 1, width - 1);
+		float w = std::min(std::max(x - float(t0), 0.f), 1.f);
+		const float* p0 = &rows[(size_t(row) * width + t0) * 3];
+		const float* p1 = &rows[(size_t(row) * width + t1) * 3];
+		return glm::vec3(p0[0] + (p1[0] - p0[0]) * w, p0[1] + (p1[1] - p0[1]) * w, p0[2] + (p1[2] - p0[2]) * w);
+	}
+
+private:
+	void decode(const DictionaryHeader& header, const void* values, const float* scaleOffset, float dictionaryAlpha)
+	{
+		alpha = dictionaryAlpha;
+		n = int(header.ndists) * 3;
+		nlevels = int(header.nlevels);
+		width = int(header.width);
+		size_t layers = header.layerCount();
+		rows.resize(layers * width * 3);
+		support.resize(layers * 2);
+		inverseCDF.resize(layers * (InverseCDFSize + 1) * 3);
+		float texelSlope = alpha * 4.f / std::sqrt(2.f) / float(width);
+		for (size_t row = 0; row < layers; ++row) {
+			float* rgb = &rows[row * width * 3];
+			DictionaryIO::decodeRow(header, values, scaleOffset, row, rgb);
+			float entry[4];
+			DictionaryIO::supportTableEntry(DictionaryIO::rowSupport(header, values, scaleOffset, row), header.width, entry);
+			support[row * 2] = entry[0];
+			support[row * 2 + 1] = entry[1];
+			DictionaryIO::inverseCDFRow(rgb, width, InverseCDFSize, texelSlope, &inverseCDF[row * (InverseCDFSize + 1) * 3]);
+		}
+	}
+};
+
+class GlintBRDF {
+public:
+	// Random attributes of a cell, see glintCell
+	struct Cell {
+		bool discarded;
+		bool beckmann;
+		int lDist;
+		float theta;
+		int i;
+		int j;
+	};
+
+	// Random numbers of a cell, drawn from its coherent index only, see glintCellSeed
+	struct CellSeed {
+		bool discarded;
+		float deviation; // Randomisation of l_dist, Alg. 3, line 8
+		float theta;
+		int i;
+		int j;
+	};
+
+	// Ellipse of a footprint in the cells of a level, see ewaFootprint
+	struct EWAFootprint {
+		glm::vec2 st;
+		float A, B, C;
+		float radius2;       // Squared radius of the cells kept by the cell budget, 1 without budget
+		glm::ivec2 min, max; // Bounding box of these cells
+	};
+
+	// Uniforms of the shader
+	const GlintDictionary* dictionary;
+	uint32_t residentLevels;     // Dictionary.ResidentLevels, all the levels by default
+	float alpha_x;               // Material.Alpha_x
+	float alpha_y;               // Material.Alpha_y
+	float logMicrofacetDensity;  // Material.LogMicrofacetDensity
+	float microfacetRelativeArea;
+	float maxAnisotropy;
+	int cellBudget;              // CellBudget: cells of the EWA filter evaluated per LOD, 0 for no budget (see GlintQuality)
+	float lodBias;               // LodBias: added to the LOD of the footprint
+	float lodBlendCutoff;        // LodBlendCutoff: f_P skips the LOD of weight up to it
+	bool fusedLevels;            // GLINT_FUSED_LEVELS: the two LODs of f_P are scanned together (see P22__P_levels), faster on CPUs
+	bool cellRotation;           // Not GLINT_NO_ROTATION: the distributions of the cells are rotated
+
+	// Parameters of SceneGlint
+	explicit GlintBRDF(const GlintDictionary* dictionary = nullptr) :
+		dictionary(dictionary), residentLevels(~0u), alpha_x(0.5f), alpha_y(0.5f), logMicrofacetDensity(27.f),
+		microfacetRelativeArea(1.f), maxAnisotropy(8.f), cellBudget(64), lodBias(0.f),
+		lodBlendCutoff(DefaultLodBlendCutoff), fusedLevels(true), cellRotation(true) {}
+
+	static constexpr float DefaultLodBlendCutoff = 0.02f;
+
+	//=====================================================================================================================
+	// Beckmann anisotropic NDF
+
+	static float p22_beckmann_anisotropic(float x, float y, float alpha_x, float alpha_y)
+	{
+		float x_sqr = x * x;
+		float y_sqr = y * y;
+		float sigma_x = alpha_x * m_i_sqrt_2;
+		float sigma_y = alpha_y * m_i_sqrt_2;
+		float sigma_x_sqr = sigma_x * sigma_x;
+		float sigma_y_sqr = sigma_y * sigma_y;
+		return std::exp(-0.5f * ((x_sqr / sigma_x_sqr) + (y_sqr / sigma_y_sqr))) / (2.f * m_pi * sigma_x * sigma_y);
+	}
+
+	static float ndf_beckmann_anisotropic(glm::vec3 omega_h, float alpha_x, float alpha_y)
+	{
+		float slope_x = -(omega_h.x / omega_h.z);
+		float slope_y = -(omega_h.y / omega_h.z);
+		float cos_theta = omega_h.z;
+		float cos_2_theta = cos_theta * cos_theta;
+		float cos_4_theta = cos_2_theta * cos_2_theta;
+		float beckmann_p22 = p22_beckmann_anisotropic(slope_x, slope_y, alpha_x, alpha_y);
+		return beckmann_p22 / cos_4_theta;
+	}
+
+	//=====================================================================================================================
+	// Diffuse Lambertian BRDF
+
+	static glm::vec3 f_diffuse(glm::vec3 wo, glm::vec3 wi)
+	{
+		if (wo.z <= 0.f)
+			return glm::vec3(0.f);
+		if (wi.z <= 0.f)
+			return glm::vec3(0.f);
+		return glm::vec3(0.8f, 0.f, 0.f) * m_i_pi * wi.z;
+	}
+
+	//=====================================================================================================================
+	// Inverse error function, hash function, pyramid size
+
+	static float erfinv(float x)
+	{
+		float w, p;
+		w = -std::log((1.0f - x) * (1.0f + x));
+		if (w < 5.000000f) {
+			w = w - 2.500000f;
+			p = 2.81022636e-08f;
+			p = 3.43273939e-07f + p * w;
+			p = -3.5233877e-06f + p * w;
+			p = -4.39150654e-06f + p * w;
+			p = 0.00021858087f + p * w;
+			p = -0.00125372503f + p * w;
+			p = -0.00417768164f + p * w;
+			p = 0.246640727f + p * w;
+			p = 1.50140941f + p * w;
+		}
+		else {
+			w = std::sqrt(w) - 3.000000f;
+			p = -0.000200214257f;
+			p = 0.000100950558f + p * w;
+			p = 0.00134934322f + p * w;
+			p = -0.00367342844f + p * w;
+			p = 0.00573950773f + p * w;
+			p = -0.0076224613f + p * w;
+			p = 0.00943887047f + p * w;
+			p = 1.00167406f + p * w;
+			p = 2.83297682f + p * w;
+		}
+		return p * x;
+	}
+
+	static float hashIQ(uint32_t n)
+	{
+		// integer hash copied from Hugo Elias
+		n = (n << 13U) ^ n;
+		n = n * (n * n * 15731U + 789221U) + 1376312589U;
+		return float(n & 0x7fffffffU) / float(0x7fffffff);
+	}
+
+	int pyramidSize(int level) const
+	{
+		return int(std::pow(2.f, float(dictionary->nlevels - 1 - level)));
+	}
+
+	static float sampleNormalDistribution(float U, float mu, float sigma)
+	{
+		return sigma * 1.414213f * erfinv(2.0f * U - 1.0f) + mu;
+	}
+
+	//=====================================================================================================================
+	// Random cell attributes, Alg. 3, lines 1 to 18
+
+	// l_dist of the cells of the level l, before its randomisation
+	float levelDistMean(int l) const
+	{
+		// Number of microfacets in a cell, Alg. 3, line 5
+		float n = std::pow(2.f, float(2 * l - (2 * (dictionary->nlevels - 1))));
+		n *= std::exp(logMicrofacetDensity);
+
+		// Corresponding continuous distribution LOD, Alg. 3, line 6
+		return std::log(n) / 1.38629f; // 2. * log(2) = 1.38629
+	}
+
+	// Random numbers of the cell (s0, t0) of the level l. They only depend on its coherent index: the cell (s, t) of the
+	// level l + 1 has the ones of the cell (2s, 2t) of the level l.
+	CellSeed glintCellSeed(int l, int s0, int t0) const
+	{
+		CellSeed seed = { false, 0.f, 0.f, 0, 0 };
+
+		// Coherent index, Eq. 8, Alg. 3, line 1
+		int twoToTheL = int(std::pow(2.f, float(l)));
+		s0 *= twoToTheL;
+		t0 *= twoToTheL;
+
+		// Seed pseudo random generator, Alg. 3, line 2 (unsigned arithmetic wraps as GLSL integers do)
+		uint32_t rngSeed = uint32_t(s0) + 1549u * uint32_t(t0);
+
+		// Discard cells by using microfacet relative area, Alg.3, lines 3 and 4
+		float uMicrofacetRelativeArea = hashIQ(rngSeed * 13U);
+		if (uMicrofacetRelativeArea > microfacetRelativeArea) {
+			seed.discarded = true;
+			return seed;
+		}
+
+		// Randomisation of l_dist, Alg. 3, lines 7 and 8
+		float uDensityRandomisation = hashIQ(rngSeed * 2171U);
+		float densityRandomisation = 2.f;
+		seed.deviation = sampleNormalDistribution(uDensityRandomisation, 0.f, densityRandomisation);
+
+		// Alg. 3, line 13
+		if (cellRotation) {
+			float uTheta = hashIQ(rngSeed);
+			seed.theta = 2.0f * m_pi * uTheta;
+		}
+
+		// Alg. 3, lines 17 and 18. hashIQ returns 1 for the largest hashes: the last distribution
+		float u1 = hashIQ(rngSeed * 16807U);
+		float u2 = hashIQ(rngSeed * 48271U);
+		seed.i = std::min(int(u1 * float(dictionary->n)), dictionary->n - 1);
+		seed.j = std::min(int(u2 * float(dictionary->n)), dictionary->n - 1);
+		return seed;
+	}
+
+	// Attributes of a cell from its random numbers, at a level of l_dist lDistMean (see levelDistMean)
+	Cell glintCell(const CellSeed& seed, float lDistMean) const
+	{
+		Cell cell = { seed.discarded, false, 0, seed.theta, seed.i, seed.j };
+		if (seed.discarded)
+			return cell;
+
+		// Alg. 3, line 9
+		cell.lDist = std::min(std::max(int(std::round(seed.deviation + lDistMean)), 0), dictionary->nlevels);
+
+		// Alg. 3, line 10
+		cell.beckmann = cell.lDist == dictionary->nlevels || (residentLevels & (1u << cell.lDist)) == 0;
+		return cell;
+	}
+
+	// Alg. 3, lines 1 to 18
+	Cell glintCell(int l, int s0, int t0) const
+	{
+		return glintCell(glintCellSeed(l, s0, t0), levelDistMean(l));
+	}
+
+	//=====================================================================================================================
+	// Spatially-varying, multiscale, rotated, and scaled slope distribution function, Eq. 11, Alg. 3
+
+	// Rotate and scale slope, Alg. 3, line 16, for a cell of rotation theta
+	glm::vec2 cellSlope(glm::vec2 slope_h, float theta) const
+	{
+		float cosTheta = std::cos(theta);
+		float sinTheta = std::sin(theta);
+
+		glm::vec2 scaleFactor(alpha_x / dictionary->alpha, alpha_y / dictionary->alpha);
+
+		return glm::vec2(slope_h.x * cosTheta / scaleFactor.x + slope_h.y * sinTheta / scaleFactor.y,
+			-slope_h.x * sinTheta / scaleFactor.x + slope_h.y * cosTheta / scaleFactor.y);
+	}
+
+	// Alg. 3, lines 14 to 19, for a cell using the dictionary
+	float P22_dictionary(glm::vec2 slope_h, const Cell& cell) const
+	{
+		return P22_dictionaryRotated(cellSlope(slope_h, cell.theta), cell);
+	}
+
+	// P22_dictionary of the slope of the cell (see cellSlope)
+	float P22_dictionaryRotated(glm::vec2 slope, const Cell& cell) const
+	{
+		glm::vec2 scaleFactor(alpha_x / dictionary->alpha, alpha_y / dictionary->alpha);
+		glm::vec2 abs_slope_h(std::abs(slope.x), std::abs(slope.y));
+
+		int distPerChannel = dictionary->n / 3;
+		float alpha_dist_isqrt2_4 = dictionary->alpha * m_i_sqrt_2 * 4.f;
+
+		if (abs_slope_h.x > alpha_dist_isqrt2_4 || abs_slope_h.y > alpha_dist_isqrt2_4)
+			return 0.f;
+
+		// 3 distributions values in one texel
+		float dictionaryWidth = float(dictionary->width);
+		float texCoordX = abs_slope_h.x / alpha_dist_isqrt2_4 * dictionaryWidth;
+		float texCoordY = abs_slope_h.y / alpha_dist_isqrt2_4 * dictionaryWidth;
+
+		int layerX = cell.lDist * distPerChannel + cell.i / 3;
+		int layerY = cell.lDist * distPerChannel + cell.j / 3;
+
+		// Slopes outside of the support of the distributions have a null density
+		const float* supportX = &dictionary->support[size_t(layerX) * 2];
+		const float* supportY = &dictionary->support[size_t(layerY) * 2];
+		if (texCoordX < supportX[0] || texCoordX > supportX[1] || texCoordY < supportY[0] || texCoordY > supportY[1])
+			return 0.f;
+
+		glm::vec3 P_i = dictionary->lookup(texCoordX, layerX);
+		glm::vec3 P_j = dictionary->lookup(texCoordY, layerY);
+
+		// Alg. 3, line 19
+		return P_i[cell.i % 3] * P_j[cell.j % 3] / (scaleFactor.x * scaleFactor.y);
+	}
+
+	float P22_theta_alpha(glm::vec2 slope_h, int l, int s0, int t0) const
+	{
+		Cell cell = glintCell(l, s0, t0);
+		if (cell.discarded)
+			return 0.f;
+		// Alg. 3, line 11
+		if (cell.beckmann)
+			return p22_beckmann_anisotropic(slope_h.x, slope_h.y, alpha_x, alpha_y);
+		return P22_dictionary(slope_h, cell);
+	}
+
+	// P22_theta_alpha of a cell from its random numbers, at a level of l_dist lDistMean. slope is the slope of the cell
+	// (see cellSlope), beckmann the Beckmann P22 of the slope of the half vector.
+	float P22_theta_alpha(glm::vec2 slope, const CellSeed& seed, float lDistMean, float beckmann) const
+	{
+		Cell cell = glintCell(seed, lDistMean);
+		if (cell.discarded)
+			return 0.f;
+		if (cell.beckmann)
+			return beckmann;
+		return P22_dictionaryRotated(slope, cell);
+	}
+
+	//=====================================================================================================================
+	// Alg. 2, P-SDF for a discrete LOD
+
+	// Similar to pbrt-v3 EWA function, and to Heckbert 1989, Section 3.5.9
+	EWAFootprint ewaFootprint(int l, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		return ewaFootprint(float(pyramidSize(l)), st, footprintProducts(dst0, dst1), cellBudget);
+	}
+
+	// Products of the derivatives in the ellipse coefficients, for all the levels: scaling them by the squared size of
+	// a pyramid, a power of two, is exact
+	static glm::vec3 footprintProducts(glm::vec2 dst0, glm::vec2 dst1)
+	{
+		return glm::vec3(dst0[1] * dst0[1] + dst1[1] * dst1[1], dst0[0] * dst0[1] + dst1[0] * dst1[1],
+			dst0[0] * dst0[0] + dst1[0] * dst1[0]);
+	}
+
+	// Ellipse of the footprint in a pyramid of pyrSize cells, from footprintProducts. Over a budget of cells (0 for
+	// none), the cells of the lowest EWA weights are dropped: the ellipse shrinks to the area of the budget, then by
+	// the ratio of the budget to the lattice cells inside until they fit, the lattice holding a few more cells than
+	// the area. The scans keep all the cells inside, so the filter stays centred on st.
+	static EWAFootprint ewaFootprint(float pyrSize, glm::vec2 st, glm::vec3 products, int cellBudget)
+	{
+		// Convert surface coordinates to appropriate scale for level
+		st = st * pyrSize - 0.5f;
+		float pyrSize2 = pyrSize * pyrSize;
+
+		// Compute ellipse coefficients to bound filter region
+		float A = pyrSize2 * products.x + 1.f;
+		float B = -2.f * (pyrSize2 * products.y);
+		float C = pyrSize2 * products.z + 1.f;
+		float invF = 1.f / (A * C - B * B * 0.25f);
+		A *= invF;
+		B *= invF;
+		C *= invF;
+
+		// The ellipse r2 < radius2 covers pi radius2 / sqrt(det / 4) cells
+		float det = -B * B + 4.f * A * C;
+		float radius2 = 1.f;
+		if (cellBudget > 0)
+			radius2 = std::min(1.f, float(cellBudget) * 0.5f * std::sqrt(det) / m_pi);
+
+		EWAFootprint footprint;
+		footprint.st = st;
+		footprint.A = A;
+		footprint.B = B;
+		footprint.C = C;
+		setRadius2(footprint, radius2);
+		if (cellBudget > 0) {
+			// One pass for most footprints, the bound only guards the cost of degenerate ones
+			for (int pass = 0; pass < maxShrinkPasses; ++pass) {
+				int cells = countCells(footprint);
+				if (cells <= cellBudget)
+					break;
+				setRadius2(footprint, footprint.radius2 * float(cellBudget) / float(cells));
+			}
+		}
+		return footprint;
+	}
+
+	// Shrink steps of the ellipse of a footprint over the cell budget, see ewaFootprint
+	static constexpr int maxShrinkPasses = 8;
+
+	// Last-resort bound of the cells evaluated by a scan of a footprint, whatever the cell budget (MaxCells in the shader)
+	static constexpr int maxCells = 256;
+
+	// Squared radius of the cells of a footprint, and the bounding box of its ellipse in texture space
+	static void setRadius2(EWAFootprint& footprint, float radius2)
+	{
+		float det = -footprint.B * footprint.B + 4.f * footprint.A * footprint.C;
+		float invDet = 1.f / det;
+		float radius = std::sqrt(radius2);
+		float uSqrt = std::sqrt(det * footprint.C) * radius, vSqrt = std::sqrt(footprint.A * det) * radius;
+		glm::vec2 st = footprint.st;
+		footprint.radius2 = radius2;
+		footprint.min = glm::ivec2(int(std::ceil(st[0] - 2.f * invDet * uSqrt)), int(std::ceil(st[1] - 2.f * invDet * vSqrt)));
+		footprint.max = glm::ivec2(int(std::floor(st[0] + 2.f * invDet * uSqrt)), int(std::floor(st[1] + 2.f * invDet * vSqrt)));
+	}
+
+	// Lattice cells inside the ellipse of a footprint
+	static int countCells(const EWAFootprint& footprint)
+	{
+		int cells = 0;
+		for (int it = footprint.min.y; it <= footprint.max.y; ++it) {
+			float tt = float(it) - footprint.st[1];
+			for (int is = footprint.min.x; is <= footprint.max.x; ++is) {
+				float ss = float(is) - footprint.st[0];
+				if (footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt < footprint.radius2)
+					++cells;
+			}
+		}
+		return cells;
+	}
+
+	// Go through cells within the pixel footprint for a given LOD
+	float P22__P_(int l, glm::vec2 slope_h, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		return ewaAverage(l, slope_h, st, dst0, dst1, false);
+	}
+
+	// Alg. 1, line 8: P22__P_ of the levels l and l + 1 mixed with the weight w of the level l + 1, in one scan. The cell
+	// (s, t) of the level l + 1 has the random numbers of the cell (2s, 2t) of the level l (see glintCellSeed): the scan
+	// goes through the cells of the level l of both bounding boxes, and the cells of even coordinates are drawn, and the
+	// slope rotated, once for both levels. Each level sums the cells of its ellipse, sized by ewaFootprint.
+	float P22__P_levels(int l, float w, glm::vec2 slope_h, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		glm::vec3 products = footprintProducts(dst0, dst1);
+		EWAFootprint fine = ewaFootprint(float(pyramidSize(l)), st, products, cellBudget);
+		EWAFootprint coarse = ewaFootprint(float(pyramidSize(l + 1)), st, products, cellBudget);
+
+		float fineMean = levelDistMean(l);
+		float coarseMean = levelDistMean(l + 1);
+		float beckmann = p22_beckmann_anisotropic(slope_h.x, slope_h.y, alpha_x, alpha_y);
+		float fineSum = 0.f, fineWts = 0.f;
+		float coarseSum = 0.f, coarseWts = 0.f;
+		int fineCells = 0, coarseCells = 0;
+		// The rows of even coordinates also go through the cells of the level l + 1, from even coordinates as the shader
+		int scanMinT = std::min(fine.min.y, 2 * coarse.min.y) & ~1;
+		int scanMaxT = std::max(fine.max.y, 2 * coarse.max.y);
+		for (int it = scanMinT; it <= scanMaxT && (fineCells < maxCells || coarseCells < maxCells); ++it) {
+			float tt = float(it) - fine.st[1];
+			float ttc = float(it / 2) - coarse.st[1];
+			bool fineRow = it >= fine.min.y && it <= fine.max.y;
+			bool coarseRow = (it & 1) == 0 && it / 2 >= coarse.min.y && it / 2 <= coarse.max.y;
+			if (!fineRow && !coarseRow)
+				continue;
+			int scanMinS = fineRow ? fine.min.x : 2 * coarse.min.x;
+			int scanMaxS = fineRow ? fine.max.x : 2 * coarse.max.x;
+			if (coarseRow) {
+				scanMinS = std::min(scanMinS, 2 * coarse.min.x) & ~1;
+				scanMaxS = std::max(scanMaxS, 2 * coarse.max.x);
+			}
+			for (int is = scanMinS; is <= scanMaxS; ++is) {
+				// Cells out of the ellipses have a squared radius of 1
+				float r2 = 1.f;
+				if (contains(fine, is, it)) {
+					float ss = float(is) - fine.st[0];
+					r2 = fine.A * ss * ss + fine.B * ss * tt + fine.C * tt * tt;
+				}
+				// The cell of the level l + 1 of the same coherent index
+				float coarseR2 = 1.f;
+				if (((is | it) & 1) == 0 && contains(coarse, is / 2, it / 2)) {
+					float ssc = float(is / 2) - coarse.st[0];
+					coarseR2 = coarse.A * ssc * ssc + coarse.B * ssc * ttc + coarse.C * ttc * ttc;
+				}
+				bool fineCell = r2 < fine.radius2 && fineCells < maxCells;
+				bool coarseCell = coarseR2 < coarse.radius2 && coarseCells < maxCells;
+				if (!fineCell && !coarseCell)
+					continue;
+
+				CellSeed seed = glintCellSeed(l, is, it);
+				glm::vec2 slope = seed.discarded ? slope_h : cellSlope(slope_h, seed.theta);
+				if (fineCell) {
+					++fineCells;
+					float W_P = ewaWeight(r2);
+					fineSum += P22_theta_alpha(slope, seed, fineMean, beckmann) * W_P;
+					fineWts += W_P;
+				}
+				if (coarseCell) {
+					++coarseCells;
+					float W_P = ewaWeight(coarseR2);
+					coarseSum += P22_theta_alpha(slope, seed, coarseMean, beckmann) * W_P;
+					coarseWts += W_P;
+				}
+			}
+		}
+		return (1.f - w) * (fineSum / fineWts) + w * (coarseSum / coarseWts);
+	}
+
+	//=====================================================================================================================
+	// Evaluation of the procedural physically based glinty BRDF, Alg. 1, Eq. 14
+
+	// LOD of a footprint of minor axis minorLength, Alg. 1, line 6, with the LOD bias
+	float footprintLOD(float minorLength) const
+	{
+		return std::max(0.f, float(dictionary->nlevels) - 1.f + std::log2(minorLength) + lodBias);
+	}
+
+	// Make dst0 the major axis of the footprint ellipse and clamp its eccentricity, returns the length of the minor axis
+	float clampFootprint(glm::vec2& dst0, glm::vec2& dst1) const
+	{
+		float dst0LengthSquared = dst0.x * dst0.x + dst0.y * dst0.y;
+		float dst1LengthSquared = dst1.x * dst1.x + dst1.y * dst1.y;
+		if (dst0LengthSquared < dst1LengthSquared) {
+			std::swap(dst0, dst1);
+			std::swap(dst0LengthSquared, dst1LengthSquared);
+		}
+		float majorLength = std::sqrt(dst0LengthSquared);
+		// Alg. 1, line 5
+		float minorLength = std::sqrt(dst1LengthSquared);
+
+		// Clamp ellipse eccentricity if too large, Alg. 1, line 4
+		if (minorLength * maxAnisotropy < majorLength && minorLength > 0.f) {
+			float scale = majorLength / (minorLength * maxAnisotropy);
+			dst1 *= scale;
+			minorLength *= scale;
+		}
+		return minorLength;
+	}
+
+	// texCoord and its screen derivatives dst0 and dst1 (dFdx and dFdy in the shader)
+	glm::vec3 f_P(glm::vec3 wo, glm::vec3 wi, glm::vec2 texCoord, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		if (wo.z <= 0.f)
+			return glm::vec3(0.f);
+		if (wi.z <= 0.f)
+			return glm::vec3(0.f);
+
+		// Alg. 1, line 1
+		glm::vec3 wh = glm::normalize(wo + wi);
+		if (wh.z <= 0.f)
+			return glm::vec3(0.f);
+
+		// Local masking shadowing
+		if (glm::dot(wo, wh) <= 0.f || glm::dot(wi, wh) <= 0.f)
+			return glm::vec3(0.f);
+
+		// Eq. 1, Alg. 1, line 2
+		glm::vec2 slope_h(-wh.x / wh.z, -wh.y / wh.z);
+
+		float D_P = 0.f;
+		float minorLength = clampFootprint(dst0, dst1);
+
+		// Without footprint, or without dictionary, we evaluate the Cook Torrance BRDF
+		if (minorLength == 0.f || residentLevels == 0 || dictionary == nullptr) {
+			D_P = ndf_beckmann_anisotropic(wh, alpha_x, alpha_y);
+		}
+		else {
+			// Choose LOD, Alg. 1, lines 6 and 7
+			float l = footprintLOD(minorLength);
+			int il = int(std::floor(l));
+			float w = l - float(il);
+
+			// Alg. 1, line 8, without the LOD of weight up to lodBlendCutoff
+			float P22_P;
+			if (w <= lodBlendCutoff)
+				P22_P = P22__P_(il, slope_h, texCoord, dst0, dst1);
+			else if (w >= 1.f - lodBlendCutoff)
+				P22_P = P22__P_(il + 1, slope_h, texCoord, dst0, dst1);
+			else if (fusedLevels)
+				P22_P = P22__P_levels(il, w, slope_h, texCoord, dst0, dst1);
+			else
+				P22_P = (1.f - w) * P22__P_(il, slope_h, texCoord, dst0, dst1) + w * P22__P_(il + 1, slope_h, texCoord, dst0, dst1);
+
+			// Eq. 6, Alg. 1, line 10
+			D_P = P22_P / (wh.z * wh.z * wh.z * wh.z);
+		}
+
+		// V-cavity masking shadowing
+		float G1wowh = std::min(1.f, 2.f * wh.z * wo.z / glm::dot(wo, wh));
+		float G1wiwh = std::min(1.f, 2.f * wh.z * wi.z / glm::dot(wi, wh));
+		float G = G1wowh * G1wiwh;
+
+		// Fresnel is set to one
+		glm::vec3 F(1.f);
+
+		// Eq. 14, Alg. 1, line 14
+		return (F * G * D_P) / (4.f * wo.z);
+	}
+
+	//=====================================================================================================================
+	// Importance sampling of the P-SDF of a footprint
+
+	// Texel coordinate of the inverse CDF of the distribution channel of a dictionary layer, at the probability u
+	float inverseCDF(int layer, int channel, float u) const
+	{
+		const int size = GlintDictionary::InverseCDFSize;
+		const float* table = &dictionary->inverseCDF[size_t(layer) * (size + 1) * 3];
+		float x = u * float(size - 1);
+		int k = std::min(int(x), size - 2);
+		float t0 = table[3 * k + channel], t1 = table[3 * (k + 1) + channel];
+		return t0 + (t1 - t0) * (x - float(k));
+	}
+
+	// Integral of the distribution channel of a dictionary layer over the positive slopes
+	float distributionIntegral(int layer, int channel) const
+	{
+		const int size = GlintDictionary::InverseCDFSize;
+		return dictionary->inverseCDF[(size_t(layer) * (size + 1) + size) * 3 + channel];
+	}
+
+	// Density of the slopes sampled by sampleCellSlope: P22_theta_alpha, with the distributions normalized
+	float P22_theta_alpha_pdf(glm::vec2 slope_h, int l, int s0, int t0) const
+	{
+		Cell cell = glintCell(l, s0, t0);
+		if (cell.discarded)
+			return 0.f;
+		if (cell.beckmann)
+			return p22_beckmann_anisotropic(slope_h.x, slope_h.y, alpha_x, alpha_y);
+
+		float P22 = P22_dictionary(slope_h, cell);
+		if (P22 == 0.f)
+			return 0.f;
+		int distPerChannel = dictionary->n / 3;
+		// Symmetric distributions: the integral over all the slopes is twice the stored one
+		float integralX = 2.f * distributionIntegral(cell.lDist * distPerChannel + cell.i / 3, cell.i % 3);
+		float integralY = 2.f * distributionIntegral(cell.lDist * distPerChannel + cell.j / 3, cell.j % 3);
+		return P22 / (integralX * integralY);
+	}
+
+	// Slope of a cell from two uniform numbers, distributed as P22_theta_alpha_pdf
+	glm::vec2 sampleCellSlope(const Cell& cell, glm::vec2 u) const
+	{
+		if (cell.beckmann)
+			return glm::vec2(sampleNormalDistribution(u.x, 0.f, alpha_x * m_i_sqrt_2),
+				sampleNormalDistribution(u.y, 0.f, alpha_y * m_i_sqrt_2));
+
+		// The sign, then the absolute value of the slope in the distributions i and j, by inversion of their CDF
+		glm::vec2 signs(u.x < 0.5f ? -1.f : 1.f, u.y < 0.5f ? -1.f : 1.f);
+		u = glm::fract(2.f * u);
+		int distPerChannel = dictionary->n / 3;
+		float alpha_dist_isqrt2_4 = dictionary->alpha * m_i_sqrt_2 * 4.f;
+		glm::vec2 slope = signs * alpha_dist_isqrt2_4 / float(dictionary->width)
+			* glm::vec2(inverseCDF(cell.lDist * distPerChannel + cell.i / 3, cell.i % 3, u.x),
+				inverseCDF(cell.lDist * distPerChannel + cell.j / 3, cell.j % 3, u.y));
+
+		// Inverse of the rotation and scale of P22_dictionary
+		float cosTheta = std::cos(cell.theta);
+		float sinTheta = std::sin(cell.theta);
+		glm::vec2 scaleFactor(alpha_x / dictionary->alpha, alpha_y / dictionary->alpha);
+		return glm::vec2(scaleFactor.x * (cosTheta * slope.x - sinTheta * slope.y),
+			scaleFactor.y * (sinTheta * slope.x + cosTheta * slope.y));
+	}
+
+	// P22__P_ with the sampling density of the cells
+	float pdf__P_(int l, glm::vec2 slope_h, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		return ewaAverage(l, slope_h, st, dst0, dst1, true);
+	}
+
+	// Weight of the LOD l + 1 in f_P, of the fractional LOD w: f_P skips the LOD of weight up to lodBlendCutoff
+	float lodBlendWeight(float w) const
+	{
+		if (w <= lodBlendCutoff)
+			return 0.f;
+		if (w >= 1.f - lodBlendCutoff)
+			return 1.f;
+		return w;
+	}
+
+	// Sample a slope of the P-SDF that f_P evaluates for the footprint (st, dst0, dst1), from 4 uniform numbers:
+	// u.x picks one of the two LODs (see lodBlendWeight), u.y a cell of the EWA filter, u.z and u.w invert the
+	// marginals of the cell. Returns false when the cell has no microfacet, or the footprint no cell. The density of
+	// the slopes is pdf_P22.
+	bool sample_P22(glm::vec4 u, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1, glm::vec2& slope_h) const
+	{
+		float minorLength = clampFootprint(dst0, dst1);
+		if (minorLength == 0.f || residentLevels == 0 || dictionary == nullptr) {
+			slope_h = glm::vec2(sampleNormalDistribution(u.z, 0.f, alpha_x * m_i_sqrt_2),
+				sampleNormalDistribution(u.w, 0.f, alpha_y * m_i_sqrt_2));
+			return true;
+		}
+
+		// LOD of f_P, Alg. 1, lines 6 to 8
+		float l = footprintLOD(minorLength);
+		int il = int(std::floor(l));
+		if (u.x < lodBlendWeight(l - float(il)))
+			il += 1;
+
+		// Total weight of the cells, then the cell where the cumulated weight reaches u.y of it
+		EWAFootprint footprint = ewaFootprint(il, st, dst0, dst1);
+		float sumWts = 0.f;
+		forEachCell(footprint, [&](int, int, float W_P) { sumWts += W_P; return true; });
+		slope_h = glm::vec2(0.f);
+		if (sumWts == 0.f)
+			return false;
+
+		float target = u.y * sumWts;
+		float cumulated = 0.f;
+		glm::ivec2 picked = footprint.min;
+		forEachCell(footprint, [&](int is, int it, float W_P) {
+			cumulated += W_P;
+			picked = glm::ivec2(is, it);
+			return cumulated <= target;
+		});
+
+		Cell cell = glintCell(il, picked.x, picked.y);
+		if (cell.discarded)
+			return false;
+		slope_h = sampleCellSlope(cell, glm::vec2(u.z, u.w));
+		return true;
+	}
+
+	// Density of the slopes sampled by sample_P22 for the footprint (st, dst0, dst1)
+	float pdf_P22(glm::vec2 slope_h, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1) const
+	{
+		float minorLength = clampFootprint(dst0, dst1);
+		if (minorLength == 0.f || residentLevels == 0 || dictionary == nullptr)
+			return p22_beckmann_anisotropic(slope_h.x, slope_h.y, alpha_x, alpha_y);
+
+		float l = footprintLOD(minorLength);
+		int il = int(std::floor(l));
+		float w = lodBlendWeight(l - float(il));
+		if (w == 0.f)
+			return pdf__P_(il, slope_h, st, dst0, dst1);
+		if (w == 1.f)
+			return pdf__P_(il + 1, slope_h, st, dst0, dst1);
+		return (1.f - w) * pdf__P_(il, slope_h, st, dst0, dst1) + w * pdf__P_(il + 1, slope_h, st, dst0, dst1);
+	}
+
+private:
+	static constexpr float m_pi = 3.141592f;
+	static constexpr float m_i_pi = 0.318309f;
+	static constexpr float m_i_sqrt_2 = 0.707106f;
+
+	static bool contains(const EWAFootprint& footprint, int is, int it)
+	{
+		return is >= footprint.min.x && is <= footprint.max.x && it >= footprint.min.y && it <= footprint.max.y;
+	}
+
+	// Weighting function used in pbrt-v3 EWA function, for a squared radius r2 < 1
+	static float ewaWeight(float r2)
+	{
+		float alpha = 2.f;
+		return std::exp(-alpha * r2) - std::exp(-alpha);
+	}
+
+	// Scan of the first maxCells cells inside the ellipse, in the order of the shader: visit(is, it, W_P) returns false
+	// to stop
+	template <typename Visit>
+	void forEachCell(const EWAFootprint& footprint, Visit visit) const
+	{
+		int cells = 0;
+		for (int it = footprint.min.y; it <= footprint.max.y; ++it) {
+			float tt = float(it) - footprint.st[1];
+			for (int is = footprint.min.x; is <= footprint.max.x; ++is) {
+				float ss = float(is) - footprint.st[0];
+				// Compute squared radius and filter SDF if inside ellipse
+				float r2 = footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt;
+				if (r2 < footprint.radius2) {
+					float W_P = ewaWeight(r2);
+					if (!visit(is, it, W_P) || ++cells == maxCells)
+						return;
+				}
+			}
+		}
+	}
+
+	// Alg. 2, line 3: average of P22_theta_alpha (or P22_theta_alpha_pdf) over the footprint
+	float ewaAverage(int l, glm::vec2 slope_h, glm::vec2 st, glm::vec2 dst0, glm::vec2 dst1, bool pdf) const
+	{
+		EWAFootprint footprint = ewaFootprint(l, st, dst0, dst1);
+		float sum = 0.f;
+		float sumWts = 0.f;
+		forEachCell(footprint, [&](int is, int it, float W_P) {
+			sum += (pdf ? P22_theta_alpha_pdf(slope_h, l, is, it) : P22_theta_alpha(slope_h, l, is, it)) * W_P;
+			sumWts += W_P;
+			return true;
+		});
+		// A footprint without cell has no sampling density (see sample_P22)
+		if (pdf && sumWts == 0.f)
+			return 0.f;
+		return sum / sumWts;
+	}
+};
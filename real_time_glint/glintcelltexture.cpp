@@ -0,0 +1,130 @@
+#include "glintcelltexture.h"
+
+#include <algorithm>
+#include <iostream>
+
+GlintCellTexture::GlintCellTexture() :
+	cellTexture(0),
+	framebuffer(0),
+	vertexArray(0),
+	maxSize(DefaultMaxSize),
+	initialized(false),
+	bakedLevels(0),
+	bakedDists(0),
+	bakedSize(0),
+	bakedDensity(0.f),
+	bakedArea(0.f),
+	bakedFirstLevel(0)
+{
+}
+
+GlintCellTexture::~GlintCellTexture()
+{
+	release();
+	if (framebuffer)
+		glDeleteFramebuffers(1, &framebuffer);
+	if (vertexArray)
+		glDeleteVertexArrays(1, &vertexArray);
+}
+
+void GlintCellTexture::init()
+{
+	try {
+		program.compileShader((SHADER_PATH + std::string("glintcells.vert.glsl")).c_str());
+		// The functions of glintCell in glint.frag.glsl, from the same source
+		program.addInclude((SHADER_PATH + std::string("glintcommon.glsl")).c_str());
+		program.compileShader((SHADER_PATH + std::string("glintcells.frag.glsl")).c_str());
+		program.link();
+	}
+	catch (GLSLProgramException& e) {
+		// The shader hashes all the cells
+		std::cerr << e.what() << std::endl;
+		return;
+	}
+	glGenFramebuffers(1, &framebuffer);
+	glGenVertexArrays(1, &vertexArray);
+	initialized = true;
+}
+
+void GlintCellTexture::setMaxSize(int size)
+{
+	maxSize = std::max(size, 1);
+}
+
+void GlintCellTexture::update(int nlevels, int ndists, float logMicrofacetDensity, float microfacetRelativeArea)
+{
+	// Fields of the packed attributes: 5 bits for LDist (up to nlevels), 12 bits for I and J
+	if (!initialized || nlevels <= 0 || nlevels > 31 || ndists <= 0 || ndists > 4096) {
+		release();
+		bakedFirstLevel = std::max(nlevels, 0);
+		return;
+	}
+
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	int size = 1;
+	int mips = 1;
+	while (mips < nlevels && size * 2 <= std::min(maxSize, int(maxTextureSize))) {
+		size *= 2;
+		++mips;
+	}
+	if (cellTexture && nlevels == bakedLevels && ndists == bakedDists && size == bakedSize
+		&& logMicrofacetDensity == bakedDensity && microfacetRelativeArea == bakedArea)
+		return;
+
+	if (!cellTexture || size != bakedSize) {
+		release();
+		glGenTextures(1, &cellTexture);
+		glBindTexture(GL_TEXTURE_2D, cellTexture);
+		glTexStorage2D(GL_TEXTURE_2D, mips, GL_RG32UI, size, size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips - 1);
+	}
+	bakedLevels = nlevels;
+	bakedDists = ndists;
+	bakedSize = size;
+	bakedDensity = logMicrofacetDensity;
+	bakedArea = microfacetRelativeArea;
+	bakedFirstLevel = nlevels - mips;
+
+	GLint previousProgram = 0, previousFramebuffer = 0, previousVertexArray = 0;
+	GLint previousViewport[4];
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+
+	program.use();
+	program.setUniform("NLevels", nlevels);
+	program.setUniform("N", ndists);
+	program.setUniform("LogMicrofacetDensity", logMicrofacetDensity);
+	program.setUniform("MicrofacetRelativeArea", microfacetRelativeArea);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glBindVertexArray(vertexArray);
+	for (int mip = 0; mip < mips; ++mip) {
+		int mipSize = size >> mip;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cellTexture, mip);
+		glViewport(0, 0, mipSize, mipSize);
+		program.setUniform("Level", bakedFirstLevel + mip);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+	glBindVertexArray(GLuint(previousVertexArray));
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	glUseProgram(GLuint(previousProgram));
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+}
+
+void GlintCellTexture::release()
+{
+	if (cellTexture)
+		glDeleteTextures(1, &cellTexture);
+	cellTexture = 0;
+	bakedSize = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "glslprogram.h"
+#include "openglogl.h"
+
+// Attributes of the glint cells of the coarse pyramid levels (discard flag, LDist, rotation and distributions, see
+// glintCell in glint.frag.glsl), baked by a render pass into an RG32UI texture: the mip m holds the level
+// firstLevel() + m, down to the 1x1 level NLevels - 1. The shader fetches the cells of these levels instead of
+// hashing them. The attributes depend on the material: they are baked again when its density or relative area change.
+class GlintCellTexture {
+public:
+	// Side of the finest baked level, 2048 by default (44 MB): the levels with more cells are hashed
+	static const int DefaultMaxSize = 2048;
+
+	GlintCellTexture();
+	~GlintCellTexture();
+
+	GlintCellTexture(const GlintCellTexture&) = delete;
+	GlintCellTexture& operator=(const GlintCellTexture&) = delete;
+
+	// Compile the bake pass, with an OpenGL context
+	void init();
+	void setMaxSize(int size);
+
+	// Bake the cells for the dictionary (number of levels and of distributions) and the material, when they changed.
+	// The current program, framebuffer and viewport are restored.
+	void update(int nlevels, int ndists, float logMicrofacetDensity, float microfacetRelativeArea);
+
+	GLuint texture() const { return cellTexture; }
+	// First baked level, nlevels when nothing is baked
+	int firstLevel() const { return bakedFirstLevel; }
+
+private:
+	GLSLProgram program;
+	GLuint cellTexture;
+	GLuint framebuffer;
+	GLuint vertexArray;
+	int maxSize;
+	bool initialized;
+
+	// Parameters of the bake
+	int bakedLevels;
+	int bakedDists;
+	int bakedSize;
+	float bakedDensity;
+	float bakedArea;
+	int bakedFirstLevel;
+
+	void release();
+};
@@ -0,0 +1,153 @@
+#include "glinthistory.h"
+
+#include <iostream>
+
+GlintHistory::GlintHistory() :
+	frameTexture(0),
+	depthRenderbuffer(0),
+	historyTexture(0),
+	frameFramebuffer(0),
+	historyFramebuffer(0),
+	vertexArray(0),
+	initialized(false),
+	width(0),
+	height(0),
+	frameCount(0),
+	previousFramebuffer(0)
+{
+}
+
+GlintHistory::~GlintHistory()
+{
+	release();
+	if (vertexArray)
+		glDeleteVertexArrays(1, &vertexArray);
+}
+
+void GlintHistory::init()
+{
+	try {
+		// The triangle covering the viewport of the bake of the cells
+		program.compileShader((SHADER_PATH + std::string("glintcells.vert.glsl")).c_str());
+		program.compileShader((SHADER_PATH + std::string("glinthistory.frag.glsl")).c_str());
+		program.link();
+	}
+	catch (GLSLProgramException& e) {
+		// The stochastic variant is drawn without average
+		std::cerr << e.what() << std::endl;
+		return;
+	}
+	glGenVertexArrays(1, &vertexArray);
+	initialized = true;
+	if (width > 0 && height > 0)
+		resize(width, height);
+}
+
+void GlintHistory::resize(int w, int h)
+{
+	width = w;
+	height = h;
+	if (!initialized)
+		return;
+
+	release();
+	GLint boundFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &boundFramebuffer);
+	bool complete = true;
+
+	glGenTextures(1, &frameTexture);
+	glBindTexture(GL_TEXTURE_2D, frameTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	glGenFramebuffers(1, &frameFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glGenTextures(1, &historyTexture);
+	glBindTexture(GL_TEXTURE_2D, historyTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+	glGenFramebuffers(1, &historyFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTexture, 0);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (!complete) {
+		std::cerr << "Incomplete history framebuffers, the stochastic variant is drawn without average" << std::endl;
+		release();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(boundFramebuffer));
+}
+
+void GlintHistory::begin(bool reset)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	if (!isValid())
+		return;
+
+	if (reset)
+		frameCount = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, frameFramebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GlintHistory::end()
+{
+	if (!isValid())
+		return;
+
+	GLint previousProgram = 0, previousVertexArray = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	program.use();
+	glBindVertexArray(vertexArray);
+
+	// history += (frame - history) / n, the first frame replaces the history
+	++frameCount;
+	glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffer);
+	glEnable(GL_BLEND);
+	glBlendColor(0.f, 0.f, 0.f, 1.f / float(frameCount));
+	glBlendFunc(GL_CONSTANT_ALPHA, frameCount == 1 ? GL_ZERO : GL_ONE_MINUS_CONSTANT_ALPHA);
+	drawTexture(frameTexture, false);
+	glDisable(GL_BLEND);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+	drawTexture(historyTexture, true);
+
+	glBindVertexArray(GLuint(previousVertexArray));
+	glUseProgram(GLuint(previousProgram));
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+}
+
+void GlintHistory::drawTexture(GLuint texture, bool gamma)
+{
+	// On the unit 10, after the ones of the glint shader
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	program.setUniform("Source", 10);
+	program.setUniform("Gamma", gamma);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GlintHistory::release()
+{
+	if (frameFramebuffer)
+		glDeleteFramebuffers(1, &frameFramebuffer);
+	if (historyFramebuffer)
+		glDeleteFramebuffers(1, &historyFramebuffer);
+	if (frameTexture)
+		glDeleteTextures(1, &frameTexture);
+	if (historyTexture)
+		glDeleteTextures(1, &historyTexture);
+	if (depthRenderbuffer)
+		glDeleteRenderbuffers(1, &depthRenderbuffer);
+	frameFramebuffer = historyFramebuffer = frameTexture = historyTexture = depthRenderbuffer = 0;
+	frameCount = 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "glslprogram.h"
+#include "openglogl.h"
+
+// Running average of the linear radiance of the frames, in an RGBA32F texture, for the stochastic variant of
+// glint.frag.glsl (see GlintPermutation::Stochastic). A frame is drawn into its own float framebuffer, then blended
+// into the history with the weight 1 / n of the n-th frame since the last reset (the fragments of a frame hidden by
+// the depth test must not be blended), then a resolve pass writes the gamma of the average to the framebuffer bound
+// before. The application resets the history when the view, the light or the material change.
+class GlintHistory {
+public:
+	GlintHistory();
+	~GlintHistory();
+
+	GlintHistory(const GlintHistory&) = delete;
+	GlintHistory& operator=(const GlintHistory&) = delete;
+
+	// Compile the blend and resolve passes, with an OpenGL context
+	void init();
+	// Size of the framebuffer, the history is reset
+	void resize(int width, int height);
+	bool isValid() const { return initialized && historyTexture != 0; }
+
+	// Bind the cleared framebuffer of a frame, for its draws
+	void begin(bool reset);
+	// Average the frame into the history, and resolve it to the framebuffer bound before begin
+	void end();
+
+	// Frames averaged since the last reset
+	int frames() const { return frameCount; }
+	GLuint texture() const { return historyTexture; }
+
+private:
+	GLSLProgram program;
+	GLuint frameTexture;
+	GLuint depthRenderbuffer;
+	GLuint historyTexture;
+	GLuint frameFramebuffer;
+	GLuint historyFramebuffer;
+	GLuint vertexArray;
+	bool initialized;
+	int width;
+	int height;
+	int frameCount;
+	GLint previousFramebuffer;
+
+	// Draw the triangle covering the viewport, the fragments fetch the texture
+	void drawTexture(GLuint texture, bool gamma);
+	void release();
+};
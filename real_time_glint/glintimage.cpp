@@ -0,0 +1,67 @@
+#include "glintimage.h"
+
+#include "tinyexr.h"
+#include "stb/stb_image_write.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+bool GlintImage::loadEXR(const std::string& fileName)
+{
+	float* rgba = nullptr;
+	const char* err = nullptr;
+	if (LoadEXR(&rgba, &width, &height, fileName.c_str(), &err) != TINYEXR_SUCCESS) {
+		std::cerr << "Unable to read " << fileName << (err ? std::string(": ") + err : std::string()) << std::endl;
+		FreeEXRErrorMessage(err);
+		width = height = 0;
+		rgb.clear();
+		return false;
+	}
+	rgb.resize(size_t(width) * height * 3);
+	for (size_t k = 0; k < size_t(width) * height; ++k)
+		for (int c = 0; c < 3; ++c)
+			rgb[k * 3 + c] = rgba[k * 4 + c];
+	free(rgba);
+	return true;
+}
+
+bool GlintImage::saveEXR(const std::string& fileName) const
+{
+	const char* err = nullptr;
+	if (SaveEXR(rgb.data(), width, height, 3, 0, fileName.c_str(), &err) != TINYEXR_SUCCESS) {
+		std::cerr << "Unable to write " << fileName << (err ? std::string(": ") + err : std::string()) << std::endl;
+		FreeEXRErrorMessage(err);
+		return false;
+	}
+	return true;
+}
+
+bool GlintImage::savePNG(const std::string& fileName) const
+{
+	std::vector<unsigned char> bytes(rgb.size());
+	for (size_t k = 0; k < rgb.size(); ++k) {
+		// Gamma of glint.frag.glsl
+		float value = std::pow(std::max(rgb[k], 0.f), 1.f / 2.2f);
+		bytes[k] = (unsigned char)(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+	}
+	if (!stbi_write_png(fileName.c_str(), width, height, 3, bytes.data(), width * 3)) {
+		std::cerr << "Unable to write " << fileName << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool GlintImage::save(const std::string& fileName) const
+{
+	std::string extension = fileName.size() >= 4 ? fileName.substr(fileName.size() - 4) : std::string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	if (extension == ".exr")
+		return saveEXR(fileName);
+	if (extension == ".png")
+		return savePNG(fileName);
+	std::cerr << "Unknown image format " << fileName << ", expected .exr or .png" << std::endl;
+	return false;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Linear RGB float image of the renderers without GPU, top row first
+struct GlintImage {
+	int width;
+	int height;
+	std::vector<float> rgb;
+
+	GlintImage() : width(0), height(0) {}
+	GlintImage(int width, int height) : width(width), height(height), rgb(size_t(width) * height * 3, 0.f) {}
+
+	float* pixel(int x, int y) { return &rgb[(size_t(y) * width + x) * 3]; }
+	const float* pixel(int x, int y) const { return &rgb[(size_t(y) * width + x) * 3]; }
+
+	// OpenEXR of the linear values
+	bool loadEXR(const std::string& fileName);
+	bool saveEXR(const std::string& fileName) const;
+	// 8 bit PNG, with the gamma of glint.frag.glsl
+	bool savePNG(const std::string& fileName) const;
+	// saveEXR or savePNG, from the extension of the file name
+	bool save(const std::string& fileName) const;
+};
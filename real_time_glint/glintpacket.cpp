@@ -0,0 +1,524 @@
+#include "glintpacket.h"
+
+#include <cstdlib>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GLINTPACKET_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// The kernels are compiled for their instruction set whatever the global flags, and only called after a CPUID check.
+// Every function between GLINTPACKET_TARGET_BEGIN and GLINTPACKET_TARGET_END gets the target attribute.
+#define GLINTPACKET_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define GLINTPACKET_TARGET_BEGIN(isa) GLINTPACKET_PRAGMA(clang attribute push(__attribute__((target(isa))), apply_to = function))
+#define GLINTPACKET_TARGET_END GLINTPACKET_PRAGMA(clang attribute pop)
+#elif defined(__GNUC__)
+#define GLINTPACKET_TARGET_BEGIN(isa) GLINTPACKET_PRAGMA(GCC push_options) GLINTPACKET_PRAGMA(GCC target(isa))
+#define GLINTPACKET_TARGET_END GLINTPACKET_PRAGMA(GCC pop_options)
+#else
+#define GLINTPACKET_TARGET_BEGIN(isa)
+#define GLINTPACKET_TARGET_END
+#endif
+
+namespace {
+
+	// Uniforms of the cell loop
+	struct KernelUniforms {
+		const float* rows;     // GlintDictionary::rows
+		const float* support;  // GlintDictionary::support
+		const float* resident; // nlevels + 1 entries: 1 for the resident levels, 0 for the others and for nlevels
+		int width;
+		int n;
+		int nlevels;
+		int distPerChannel;
+		float microfacetRelativeArea;
+		float scaleFactorX;
+		float scaleFactorY;
+		float alpha_dist_isqrt2_4;
+		float expMinusAlpha; // Weight of the edge of the EWA filter
+		float rotation;      // Rotation of the cells of hash 1: 2 pi, 0 without rotation
+	};
+
+	// Inputs of the cell loop for one of the two LODs of the lanes, and its output
+	struct LevelLanes {
+		static const int Size = GlintPacket::Size;
+
+		int active[Size]; // 0 for the lanes without EWA filter
+		float stS[Size], stT[Size];
+		float A[Size], B[Size], C[Size];
+		float radius2[Size];
+		int minS[Size], minT[Size], maxS[Size], maxT[Size];
+		int twoToTheL[Size];
+		float lDistMean[Size]; // l_dist of glintCell, before its randomisation
+		float slopeX[Size], slopeY[Size];
+		float beckmann[Size];  // p22_beckmann_anisotropic of the slope
+		float average[Size];   // P22__P_
+	};
+
+#ifdef GLINTPACKET_X86
+
+	//=================================================================================================================
+	// SSE4.1, 4 lanes
+
+GLINTPACKET_TARGET_BEGIN("sse4.1")
+	namespace Sse41 {
+		const int Width = 4;
+
+		struct Mask { __m128 v; };
+		inline Mask operator&(Mask a, Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+		inline bool any(Mask m) { return _mm_movemask_ps(m.v) != 0; }
+
+		struct Float {
+			__m128 v;
+			Float() {}
+			Float(__m128 v) : v(v) {}
+			explicit Float(float f) : v(_mm_set1_ps(f)) {}
+			static Float load(const float* p) { return _mm_loadu_ps(p); }
+			void store(float* p) const { _mm_storeu_ps(p, v); }
+		};
+		inline Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+		inline Float operator-(Float a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.f)); }
+		inline Mask operator<(Float a, Float b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+		inline Mask operator>(Float a, Float b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+		inline Mask operator<=(Float a, Float b) { return { _mm_cmple_ps(a.v, b.v) }; }
+		inline Mask operator>=(Float a, Float b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+		inline Mask operator==(Float a, Float b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+		inline Mask operator!=(Float a, Float b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+
+		struct Int {
+			__m128i v;
+			Int() {}
+			Int(__m128i v) : v(v) {}
+			explicit Int(int i) : v(_mm_set1_epi32(i)) {}
+			static Int load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+		};
+		inline Int operator+(Int a, Int b) { return _mm_add_epi32(a.v, b.v); }
+		inline Int operator-(Int a, Int b) { return _mm_sub_epi32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return _mm_mullo_epi32(a.v, b.v); }
+		inline Int operator&(Int a, Int b) { return _mm_and_si128(a.v, b.v); }
+		inline Int operator|(Int a, Int b) { return _mm_or_si128(a.v, b.v); }
+		inline Int operator^(Int a, Int b) { return _mm_xor_si128(a.v, b.v); }
+		inline Mask operator==(Int a, Int b) { return { _mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v)) }; }
+		inline Mask operator!=(Int a, Int b) { return { _mm_castsi128_ps(_mm_xor_si128(_mm_cmpeq_epi32(a.v, b.v), _mm_set1_epi32(-1))) }; }
+		inline Mask operator>(Int a, Int b) { return { _mm_castsi128_ps(_mm_cmpgt_epi32(a.v, b.v)) }; }
+		inline Mask operator<=(Int a, Int b) { return { _mm_castsi128_ps(_mm_xor_si128(_mm_cmpgt_epi32(a.v, b.v), _mm_set1_epi32(-1))) }; }
+		template <int Count> Int shiftLeft(Int a) { return _mm_slli_epi32(a.v, Count); }
+		template <int Count> Int shiftRight(Int a) { return _mm_srli_epi32(a.v, Count); }
+
+		inline Float select(Mask m, Float a, Float b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+		inline Int select(Mask m, Int a, Int b) { return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), m.v)); }
+		inline Float toFloat(Int a) { return _mm_cvtepi32_ps(a.v); }
+		inline Int truncate(Float a) { return _mm_cvttps_epi32(a.v); }
+		inline Float floor(Float a) { return _mm_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		inline Float trunc(Float a) { return _mm_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+		inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+		inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+		inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+		inline Int min(Int a, Int b) { return _mm_min_epi32(a.v, b.v); }
+		inline Int max(Int a, Int b) { return _mm_max_epi32(a.v, b.v); }
+		inline Int asInt(Float a) { return _mm_castps_si128(a.v); }
+		inline Float asFloat(Int a) { return _mm_castsi128_ps(a.v); }
+		// No gather instruction before AVX2
+		inline Float gather(const float* base, Int index)
+		{
+			alignas(16) int i[Width];
+			_mm_store_si128(reinterpret_cast<__m128i*>(i), index.v);
+			return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+		}
+
+#include "glintpacketkernel.h"
+	}
+GLINTPACKET_TARGET_END
+
+	//=================================================================================================================
+	// AVX2, 8 lanes
+
+GLINTPACKET_TARGET_BEGIN("avx2,fma")
+	namespace Avx2 {
+		const int Width = 8;
+
+		struct Mask { __m256 v; };
+		inline Mask operator&(Mask a, Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+		inline bool any(Mask m) { return _mm256_movemask_ps(m.v) != 0; }
+
+		struct Float {
+			__m256 v;
+			Float() {}
+			Float(__m256 v) : v(v) {}
+			explicit Float(float f) : v(_mm256_set1_ps(f)) {}
+			static Float load(const float* p) { return _mm256_loadu_ps(p); }
+			void store(float* p) const { _mm256_storeu_ps(p, v); }
+		};
+		inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+		inline Float operator-(Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+		inline Mask operator<(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+		inline Mask operator>(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+		inline Mask operator<=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+		inline Mask operator>=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+		inline Mask operator==(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+		inline Mask operator!=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ) }; }
+
+		struct Int {
+			__m256i v;
+			Int() {}
+			Int(__m256i v) : v(v) {}
+			explicit Int(int i) : v(_mm256_set1_epi32(i)) {}
+			static Int load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+		};
+		inline Int operator+(Int a, Int b) { return _mm256_add_epi32(a.v, b.v); }
+		inline Int operator-(Int a, Int b) { return _mm256_sub_epi32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return _mm256_mullo_epi32(a.v, b.v); }
+		inline Int operator&(Int a, Int b) { return _mm256_and_si256(a.v, b.v); }
+		inline Int operator|(Int a, Int b) { return _mm256_or_si256(a.v, b.v); }
+		inline Int operator^(Int a, Int b) { return _mm256_xor_si256(a.v, b.v); }
+		inline Mask operator==(Int a, Int b) { return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) }; }
+		inline Mask operator!=(Int a, Int b) { return { _mm256_castsi256_ps(_mm256_xor_si256(_mm256_cmpeq_epi32(a.v, b.v), _mm256_set1_epi32(-1))) }; }
+		inline Mask operator>(Int a, Int b) { return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(a.v, b.v)) }; }
+		inline Mask operator<=(Int a, Int b) { return { _mm256_castsi256_ps(_mm256_xor_si256(_mm256_cmpgt_epi32(a.v, b.v), _mm256_set1_epi32(-1))) }; }
+		template <int Count> Int shiftLeft(Int a) { return _mm256_slli_epi32(a.v, Count); }
+		template <int Count> Int shiftRight(Int a) { return _mm256_srli_epi32(a.v, Count); }
+
+		inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+		inline Int select(Mask m, Int a, Int b) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v)); }
+		inline Float toFloat(Int a) { return _mm256_cvtepi32_ps(a.v); }
+		inline Int truncate(Float a) { return _mm256_cvttps_epi32(a.v); }
+		inline Float floor(Float a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		inline Float trunc(Float a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+		inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+		inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+		inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+		inline Int min(Int a, Int b) { return _mm256_min_epi32(a.v, b.v); }
+		inline Int max(Int a, Int b) { return _mm256_max_epi32(a.v, b.v); }
+		inline Int asInt(Float a) { return _mm256_castps_si256(a.v); }
+		inline Float asFloat(Int a) { return _mm256_castsi256_ps(a.v); }
+		inline Float gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index.v, 4); }
+
+#include "glintpacketkernel.h"
+	}
+GLINTPACKET_TARGET_END
+
+	//=================================================================================================================
+	// AVX-512F, 16 lanes
+
+GLINTPACKET_TARGET_BEGIN("avx512f")
+	namespace Avx512 {
+		const int Width = 16;
+
+		struct Mask { __mmask16 v; };
+		inline Mask operator&(Mask a, Mask b) { return { __mmask16(a.v & b.v) }; }
+		inline bool any(Mask m) { return m.v != 0; }
+
+		struct Float {
+			__m512 v;
+			Float() {}
+			Float(__m512 v) : v(v) {}
+			explicit Float(float f) : v(_mm512_set1_ps(f)) {}
+			static Float load(const float* p) { return _mm512_loadu_ps(p); }
+			void store(float* p) const { _mm512_storeu_ps(p, v); }
+		};
+		inline Float operator+(Float a, Float b) { return _mm512_add_ps(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return _mm512_sub_ps(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return _mm512_mul_ps(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return _mm512_div_ps(a.v, b.v); }
+		// _mm512_xor_ps is AVX-512DQ
+		inline Float operator-(Float a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(int(0x80000000u)))); }
+		inline Mask operator<(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+		inline Mask operator>(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+		inline Mask operator<=(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+		inline Mask operator>=(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+		inline Mask operator==(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+		inline Mask operator!=(Float a, Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ) }; }
+
+		struct Int {
+			__m512i v;
+			Int() {}
+			Int(__m512i v) : v(v) {}
+			explicit Int(int i) : v(_mm512_set1_epi32(i)) {}
+			static Int load(const int* p) { return _mm512_loadu_si512(p); }
+		};
+		inline Int operator+(Int a, Int b) { return _mm512_add_epi32(a.v, b.v); }
+		inline Int operator-(Int a, Int b) { return _mm512_sub_epi32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return _mm512_mullo_epi32(a.v, b.v); }
+		inline Int operator&(Int a, Int b) { return _mm512_and_si512(a.v, b.v); }
+		inline Int operator|(Int a, Int b) { return _mm512_or_si512(a.v, b.v); }
+		inline Int operator^(Int a, Int b) { return _mm512_xor_si512(a.v, b.v); }
+		inline Mask operator==(Int a, Int b) { return { _mm512_cmp_epi32_mask(a.v, b.v, _MM_CMPINT_EQ) }; }
+		inline Mask operator!=(Int a, Int b) { return { _mm512_cmp_epi32_mask(a.v, b.v, _MM_CMPINT_NE) }; }
+		inline Mask operator>(Int a, Int b) { return { _mm512_cmp_epi32_mask(a.v, b.v, _MM_CMPINT_NLE) }; }
+		inline Mask operator<=(Int a, Int b) { return { _mm512_cmp_epi32_mask(a.v, b.v, _MM_CMPINT_LE) }; }
+		template <int Count> Int shiftLeft(Int a) { return _mm512_slli_epi32(a.v, Count); }
+		template <int Count> Int shiftRight(Int a) { return _mm512_srli_epi32(a.v, Count); }
+
+		inline Float select(Mask m, Float a, Float b) { return _mm512_mask_blend_ps(m.v, b.v, a.v); }
+		inline Int select(Mask m, Int a, Int b) { return _mm512_mask_blend_epi32(m.v, b.v, a.v); }
+		inline Float toFloat(Int a) { return _mm512_cvtepi32_ps(a.v); }
+		inline Int truncate(Float a) { return _mm512_cvttps_epi32(a.v); }
+		inline Float floor(Float a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		inline Float trunc(Float a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		inline Float sqrt(Float a) { return _mm512_sqrt_ps(a.v); }
+		inline Float abs(Float a) { return _mm512_abs_ps(a.v); }
+		inline Float min(Float a, Float b) { return _mm512_min_ps(a.v, b.v); }
+		inline Float max(Float a, Float b) { return _mm512_max_ps(a.v, b.v); }
+		inline Int min(Int a, Int b) { return _mm512_min_epi32(a.v, b.v); }
+		inline Int max(Int a, Int b) { return _mm512_max_epi32(a.v, b.v); }
+		inline Int asInt(Float a) { return _mm512_castps_si512(a.v); }
+		inline Float asFloat(Int a) { return _mm512_castsi512_ps(a.v); }
+		inline Float gather(const float* base, Int index) { return _mm512_i32gather_ps(index.v, base, 4); }
+
+#include "glintpacketkernel.h"
+	}
+GLINTPACKET_TARGET_END
+
+	bool detect(GlintISA isa)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		bool avx512f = (info[1] & (1 << 16)) != 0;
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		switch (isa) {
+		case GlintISA::SSE41: return sse41;
+		case GlintISA::AVX2: return avx2 && fma && (xcr0 & 0x6) == 0x6;
+		case GlintISA::AVX512: return avx512f && (xcr0 & 0xe6) == 0xe6;
+		default: return true;
+		}
+#else
+		__builtin_cpu_init();
+		switch (isa) {
+		case GlintISA::SSE41: return __builtin_cpu_supports("sse4.1");
+		case GlintISA::AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case GlintISA::AVX512: return __builtin_cpu_supports("avx512f");
+		default: return true;
+		}
+#endif
+	}
+#endif
+
+	// Scalar part of GlintBRDF::f_P for one lane: returns false when f_P is null. Without EWA filter, D is D_P.
+	// Otherwise D is the divisor of P22_P, w the weight of the second LOD, and levels get the inputs of the cell loops.
+	bool setupLane(const GlintBRDF& brdf, const GlintPacket& packet, int k, LevelLanes* levels,
+		float& G, float& D, float& w, bool& ewa)
+	{
+		glm::vec3 wo(packet.woX[k], packet.woY[k], packet.woZ[k]);
+		glm::vec3 wi(packet.wiX[k], packet.wiY[k], packet.wiZ[k]);
+		if (wo.z <= 0.f || wi.z <= 0.f)
+			return false;
+		glm::vec3 wh = glm::normalize(wo + wi);
+		if (wh.z <= 0.f)
+			return false;
+		if (glm::dot(wo, wh) <= 0.f || glm::dot(wi, wh) <= 0.f)
+			return false;
+		glm::vec2 slope_h(-wh.x / wh.z, -wh.y / wh.z);
+
+		// V-cavity masking shadowing
+		float G1wowh = std::min(1.f, 2.f * wh.z * wo.z / glm::dot(wo, wh));
+		float G1wiwh = std::min(1.f, 2.f * wh.z * wi.z / glm::dot(wi, wh));
+		G = G1wowh * G1wiwh;
+
+		glm::vec2 texCoord(packet.s[k], packet.t[k]);
+		glm::vec2 dst0(packet.dst0S[k], packet.dst0T[k]);
+		glm::vec2 dst1(packet.dst1S[k], packet.dst1T[k]);
+		float minorLength = brdf.clampFootprint(dst0, dst1);
+		const GlintDictionary* dictionary = brdf.dictionary;
+		ewa = !(minorLength == 0.f || brdf.residentLevels == 0 || dictionary == nullptr);
+		if (!ewa) {
+			D = GlintBRDF::ndf_beckmann_anisotropic(wh, brdf.alpha_x, brdf.alpha_y);
+			return true;
+		}
+
+		float l = brdf.footprintLOD(minorLength);
+		int il = int(std::floor(l));
+		w = l - float(il);
+		// The LOD of weight up to lodBlendCutoff is skipped
+		if (w <= brdf.lodBlendCutoff)
+			w = 0.f;
+		else if (w >= 1.f - brdf.lodBlendCutoff)
+			w = 1.f;
+		D = wh.z * wh.z * wh.z * wh.z;
+		float beckmann = GlintBRDF::p22_beckmann_anisotropic(slope_h.x, slope_h.y, brdf.alpha_x, brdf.alpha_y);
+		float density = std::exp(brdf.logMicrofacetDensity);
+		for (int lod = 0; lod < 2; ++lod) {
+			// A level without weight is not scanned
+			if (w == float(1 - lod))
+				continue;
+			LevelLanes& level = levels[lod];
+			int levelIndex = il + lod;
+			GlintBRDF::EWAFootprint footprint = brdf.ewaFootprint(levelIndex, texCoord, dst0, dst1);
+			level.active[k] = 1;
+			level.stS[k] = footprint.st.x;
+			level.stT[k] = footprint.st.y;
+			level.A[k] = footprint.A;
+			level.B[k] = footprint.B;
+			level.C[k] = footprint.C;
+			level.radius2[k] = footprint.radius2;
+			level.minS[k] = footprint.min.x;
+			level.minT[k] = footprint.min.y;
+			level.maxS[k] = footprint.max.x;
+			level.maxT[k] = footprint.max.y;
+			// As glintCell
+			level.twoToTheL[k] = int(std::pow(2.f, float(levelIndex)));
+			float n = std::pow(2.f, float(2 * levelIndex - (2 * (dictionary->nlevels - 1))));
+			n *= density;
+			level.lDistMean[k] = std::log(n) / 1.38629f;
+			level.slopeX[k] = slope_h.x;
+			level.slopeY[k] = slope_h.y;
+			level.beckmann[k] = beckmann;
+		}
+		return true;
+	}
+}
+
+namespace GlintISAs {
+
+const char* name(GlintISA isa)
+{
+	switch (isa) {
+	case GlintISA::SSE41: return "sse4.1";
+	case GlintISA::AVX2: return "avx2";
+	case GlintISA::AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
+
+bool parse(const std::string& isaName, GlintISA& isa)
+{
+	for (int k = 0; k < Count; ++k) {
+		if (isaName == name(static_cast<GlintISA>(k))) {
+			isa = static_cast<GlintISA>(k);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool isSupported(GlintISA isa)
+{
+#ifdef GLINTPACKET_X86
+	static const bool supported[Count] = { true, detect(GlintISA::SSE41), detect(GlintISA::AVX2), detect(GlintISA::AVX512) };
+	return supported[int(isa)];
+#else
+	return isa == GlintISA::Scalar;
+#endif
+}
+
+GlintISA best()
+{
+	GlintISA limit = GlintISA::AVX512;
+	const char* env = std::getenv("GLINT_SIMD");
+	if (env != nullptr && !parse(env, limit)) {
+		std::cerr << "Unknown GLINT_SIMD " << env << ", expected scalar, sse4.1, avx2 or avx512" << std::endl;
+		limit = GlintISA::AVX512;
+	}
+	for (int k = int(limit); k > 0; --k)
+		if (isSupported(static_cast<GlintISA>(k)))
+			return static_cast<GlintISA>(k);
+	return GlintISA::Scalar;
+}
+
+} // namespace GlintISAs
+
+GlintPacketEvaluator::GlintPacketEvaluator(const GlintBRDF& brdf, GlintISA isa) :
+	brdf(brdf),
+	kernel(GlintISAs::isSupported(isa) ? isa : GlintISA::Scalar)
+{
+}
+
+int GlintPacketEvaluator::width() const
+{
+	switch (kernel) {
+	case GlintISA::SSE41: return 4;
+	case GlintISA::AVX2: return 8;
+	case GlintISA::AVX512: return 16;
+	default: return 1;
+	}
+}
+
+void GlintPacketEvaluator::f_P(const GlintPacket& packet, int count, float* result) const
+{
+	if (kernel == GlintISA::Scalar) {
+		for (int k = 0; k < count; ++k)
+			result[k] = brdf.f_P(glm::vec3(packet.woX[k], packet.woY[k], packet.woZ[k]),
+				glm::vec3(packet.wiX[k], packet.wiY[k], packet.wiZ[k]), glm::vec2(packet.s[k], packet.t[k]),
+				glm::vec2(packet.dst0S[k], packet.dst0T[k]), glm::vec2(packet.dst1S[k], packet.dst1T[k])).x;
+		return;
+	}
+
+	// The lanes past count, and the lanes without EWA filter, stay inactive
+	LevelLanes levels[2] = {};
+	float G[GlintPacket::Size], D[GlintPacket::Size], w[GlintPacket::Size];
+	bool valid[GlintPacket::Size], ewa[GlintPacket::Size];
+	bool anyEWA = false;
+	for (int k = 0; k < count; ++k) {
+		valid[k] = setupLane(brdf, packet, k, levels, G[k], D[k], w[k], ewa[k]);
+		anyEWA = anyEWA || (valid[k] && ewa[k]);
+	}
+
+	if (anyEWA) {
+		const GlintDictionary* dictionary = brdf.dictionary;
+		// residentLevels holds 32 levels
+		float resident[33];
+		int nlevels = std::min(dictionary->nlevels, 32);
+		for (int l = 0; l < nlevels; ++l)
+			resident[l] = (brdf.residentLevels & (1u << l)) != 0 ? 1.f : 0.f;
+		resident[nlevels] = 0.f;
+
+		KernelUniforms uniforms;
+		uniforms.rows = dictionary->rows.data();
+		uniforms.support = dictionary->support.data();
+		uniforms.resident = resident;
+		uniforms.width = dictionary->width;
+		uniforms.n = dictionary->n;
+		uniforms.nlevels = nlevels;
+		uniforms.distPerChannel = dictionary->n / 3;
+		uniforms.microfacetRelativeArea = brdf.microfacetRelativeArea;
+		uniforms.scaleFactorX = brdf.alpha_x / dictionary->alpha;
+		uniforms.scaleFactorY = brdf.alpha_y / dictionary->alpha;
+		uniforms.alpha_dist_isqrt2_4 = dictionary->alpha * 0.707106f * 4.f;
+		uniforms.expMinusAlpha = std::exp(-2.f);
+		uniforms.rotation = brdf.cellRotation ? 2.f * 3.141592f : 0.f;
+
+		for (LevelLanes& level : levels) {
+#ifdef GLINTPACKET_X86
+			switch (kernel) {
+			case GlintISA::SSE41: Sse41::evaluate(uniforms, level, count); break;
+			case GlintISA::AVX2: Avx2::evaluate(uniforms, level, count); break;
+			case GlintISA::AVX512: Avx512::evaluate(uniforms, level, count); break;
+			default: break;
+			}
+#endif
+		}
+	}
+
+	for (int k = 0; k < count; ++k) {
+		if (!valid[k]) {
+			result[k] = 0.f;
+			continue;
+		}
+		// Alg. 1, lines 8 and 10
+		float D_P = D[k];
+		if (ewa[k])
+			D_P = ((w[k] < 1.f ? (1.f - w[k]) * levels[0].average[k] : 0.f) + (w[k] > 0.f ? w[k] * levels[1].average[k] : 0.f)) / D[k];
+		result[k] = (G[k] * D_P) / (4.f * packet.woZ[k]);
+	}
+}
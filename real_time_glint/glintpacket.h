@@ -0,0 +1,67 @@
+#pragma once
+
+#include "glintbrdf.h"
+
+#include <string>
+
+// Instruction sets of the packet kernels of GlintPacketEvaluator
+enum class GlintISA : int {
+	Scalar = 0, // GlintBRDF::f_P lane by lane
+	SSE41 = 1,  // 4 lanes
+	AVX2 = 2,   // 8 lanes, with FMA
+	AVX512 = 3  // 16 lanes, AVX-512F
+};
+
+namespace GlintISAs {
+	const int Count = 4;
+	const char* name(GlintISA isa);
+	// "scalar", "sse4.1", "avx2" or "avx512", false for other names
+	bool parse(const std::string& name, GlintISA& isa);
+	// True when the CPU (and the OS) supports the instruction set, checked with CPUID
+	bool isSupported(GlintISA isa);
+	// Best instruction set of the CPU, lowered by GLINT_SIMD (an instruction set name) when set
+	GlintISA best();
+}
+
+// Lanes of GlintPacketEvaluator::f_P, as a structure of arrays: lane k is the element k of each array
+struct GlintPacket {
+	static const int Size = 16;
+
+	float woX[Size], woY[Size], woZ[Size];
+	float wiX[Size], wiY[Size], wiZ[Size];
+	float s[Size], t[Size];         // texCoord
+	float dst0S[Size], dst0T[Size]; // dFdx of texCoord
+	float dst1S[Size], dst1T[Size]; // dFdy of texCoord
+
+	void set(int lane, glm::vec3 wo, glm::vec3 wi, glm::vec2 texCoord, glm::vec2 dst0, glm::vec2 dst1)
+	{
+		woX[lane] = wo.x; woY[lane] = wo.y; woZ[lane] = wo.z;
+		wiX[lane] = wi.x; wiY[lane] = wi.y; wiZ[lane] = wi.z;
+		s[lane] = texCoord.x; t[lane] = texCoord.y;
+		dst0S[lane] = dst0.x; dst0T[lane] = dst0.y;
+		dst1S[lane] = dst1.x; dst1T[lane] = dst1.y;
+	}
+};
+
+// GlintBRDF::f_P for packets of lanes. The setup of a lane (half vector, footprint clamp, LOD and EWA ellipses)
+// is scalar; the loop over the cells of the footprints, where the time goes, runs Width lanes at once:
+// cell hashing, erfinv, exp, sin and cos are vectorised, and the dictionary rows and support are gathered.
+// Lanes leave the loop when their own footprint is done. The kernel is chosen at runtime (see GlintISAs::best).
+// Results match GlintBRDF::f_P up to the rounding of the vectorised math functions.
+class GlintPacketEvaluator {
+public:
+	// The parameters of brdf are read at each evaluation
+	explicit GlintPacketEvaluator(const GlintBRDF& brdf, GlintISA isa = GlintISAs::best());
+
+	GlintISA isa() const { return kernel; }
+	// Lanes evaluated at once by the kernel
+	int width() const;
+
+	// GlintBRDF::f_P of the first count lanes of the packet. The BRDF is grey (the Fresnel term is one):
+	// result[k] is the value of the three channels of lane k.
+	void f_P(const GlintPacket& packet, int count, float* result) const;
+
+private:
+	const GlintBRDF& brdf;
+	GlintISA kernel;
+};
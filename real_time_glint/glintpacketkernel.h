@@ -0,0 +1,244 @@
+// Cell loop of GlintPacketEvaluator, included by glintpacket.cpp once per instruction set, in the namespace of the
+// instruction set. No include guard: the namespace defines Width, the vectors Float and Int, their Mask, and
+// select, any, toFloat, truncate, floor, trunc, sqrt, abs, min, max, asInt, asFloat, shiftLeft, shiftRight and gather.
+// Each function mirrors the GlintBRDF function of the same name, lane by lane.
+
+inline Float exp(Float x)
+{
+	// Cephes expf: exp(x) = 2^n exp(r), with |r| <= ln(2) / 2
+	x = min(max(x, Float(-87.3365f)), Float(88.7228f));
+	Float n = floor(x * Float(1.44269504088896341f) + Float(0.5f));
+	Float r = x - n * Float(0.693359375f) - n * Float(-2.12194440e-4f);
+	Float r2 = r * r;
+	Float p = Float(1.9875691500e-4f);
+	p = p * r + Float(1.3981999507e-3f);
+	p = p * r + Float(8.3334519073e-3f);
+	p = p * r + Float(4.1665795894e-2f);
+	p = p * r + Float(1.6666665459e-1f);
+	p = p * r + Float(5.0000001201e-1f);
+	p = p * r2 + r + Float(1.f);
+	return p * asFloat(shiftLeft<23>(truncate(n) + Int(127)));
+}
+
+inline Float log(Float x)
+{
+	// Cephes logf: log(x) = e log(2) + log(m), with m in [sqrt(1/2), sqrt(2)). x is positive or null.
+	Int bits = asInt(x);
+	Int e = shiftRight<23>(bits) - Int(126);
+	Float m = asFloat((bits & Int(0x007fffff)) | Int(0x3f000000));
+	Mask small = m < Float(0.707106781186547524f);
+	e = select(small, e - Int(1), e);
+	m = select(small, m + m, m) - Float(1.f);
+	Float z = m * m;
+	Float y = Float(7.0376836292e-2f);
+	y = y * m + Float(-1.1514610310e-1f);
+	y = y * m + Float(1.1676998740e-1f);
+	y = y * m + Float(-1.2420140846e-1f);
+	y = y * m + Float(1.4249322787e-1f);
+	y = y * m + Float(-1.6668057665e-1f);
+	y = y * m + Float(2.0000714765e-1f);
+	y = y * m + Float(-2.4999993993e-1f);
+	y = y * m + Float(3.3333331174e-1f);
+	y = y * m * z;
+	Float fe = toFloat(e);
+	y = y + fe * Float(-2.12194440e-4f);
+	y = y - Float(0.5f) * z;
+	Float result = m + y + fe * Float(0.693359375f);
+	return select(x == Float(0.f), Float(-std::numeric_limits<float>::infinity()), result);
+}
+
+inline void sincos(Float x, Float& sinX, Float& cosX)
+{
+	// Cephes sincosf for x >= 0: reduction to [-pi/4, pi/4] by a multiple j of pi/4
+	Int j = truncate(x * Float(1.27323954473516f));
+	j = (j + Int(1)) & Int(~1);
+	Float y = toFloat(j);
+	x = ((x - y * Float(0.78515625f)) - y * Float(2.4187564849853515625e-4f)) - y * Float(3.77489497744594108e-8f);
+	Float z = x * x;
+	Float c = Float(2.443315711809948e-5f);
+	c = c * z + Float(-1.388731625493765e-3f);
+	c = c * z + Float(4.166664568298827e-2f);
+	c = c * z * z - Float(0.5f) * z + Float(1.f);
+	Float s = Float(-1.9515295891e-4f);
+	s = s * z + Float(8.3321608736e-3f);
+	s = s * z + Float(-1.6666654611e-1f);
+	s = s * z * x + x;
+	Mask swap = (j & Int(2)) == Int(2);
+	Mask sinNegative = (j & Int(4)) == Int(4);
+	Mask cosNegative = ((j + Int(2)) & Int(4)) == Int(4);
+	Float sinY = select(swap, c, s);
+	Float cosY = select(swap, s, c);
+	sinX = select(sinNegative, -sinY, sinY);
+	cosX = select(cosNegative, -cosY, cosY);
+}
+
+inline Float erfinv(Float x)
+{
+	Float w = -log((Float(1.f) - x) * (Float(1.f) + x));
+	Float wc = w - Float(2.5f);
+	Float p = Float(2.81022636e-08f);
+	p = Float(3.43273939e-07f) + p * wc;
+	p = Float(-3.5233877e-06f) + p * wc;
+	p = Float(-4.39150654e-06f) + p * wc;
+	p = Float(0.00021858087f) + p * wc;
+	p = Float(-0.00125372503f) + p * wc;
+	p = Float(-0.00417768164f) + p * wc;
+	p = Float(0.246640727f) + p * wc;
+	p = Float(1.50140941f) + p * wc;
+	Float wt = sqrt(w) - Float(3.f);
+	Float q = Float(-0.000200214257f);
+	q = Float(0.000100950558f) + q * wt;
+	q = Float(0.00134934322f) + q * wt;
+	q = Float(-0.00367342844f) + q * wt;
+	q = Float(0.00573950773f) + q * wt;
+	q = Float(-0.0076224613f) + q * wt;
+	q = Float(0.00943887047f) + q * wt;
+	q = Float(1.00167406f) + q * wt;
+	q = Float(2.83297682f) + q * wt;
+	return select(w < Float(5.f), p, q) * x;
+}
+
+inline Float hashIQ(Int n)
+{
+	// integer hash copied from Hugo Elias, the products wrap as the unsigned ones
+	n = shiftLeft<13>(n) ^ n;
+	n = n * (n * n * Int(15731) + Int(789221)) + Int(1376312589);
+	// float(0x7fffffff) rounds to 2^31: the division is exact as a product
+	return toFloat(n & Int(0x7fffffff)) * Float(1.f / 2147483648.f);
+}
+
+// std::round: halfway cases away from zero
+inline Int roundToInt(Float x)
+{
+	Float t = trunc(x);
+	Float d = x - t;
+	t = select(d >= Float(0.5f), t + Float(1.f), t);
+	t = select(d <= Float(-0.5f), t - Float(1.f), t);
+	return truncate(t);
+}
+
+// GlintDictionary::lookup of the channel of a row
+inline Float lookup(const KernelUniforms& u, Float texel, Int row, Int channel)
+{
+	Float x = texel - Float(0.5f);
+	Int t0 = min(max(truncate(floor(x)), Int(0)), Int(u.width - 1));
+	Int t1 = min(t0 + Int(1), Int(u.width - 1));
+	Float w = min(max(x - toFloat(t0), Float(0.f)), Float(1.f));
+	Int base = row * Int(u.width);
+	Float p0 = gather(u.rows, (base + t0) * Int(3) + channel);
+	Float p1 = gather(u.rows, (base + t1) * Int(3) + channel);
+	return p0 + (p1 - p0) * w;
+}
+
+// GlintBRDF::P22_theta_alpha of the cells (s0, t0) of the level of each lane, for the lanes of active.
+// beckmann is p22_beckmann_anisotropic of the slope of each lane.
+inline Float P22_theta_alpha(const KernelUniforms& u, Mask active, Float slopeX, Float slopeY, Float beckmann,
+	Float lDistMean, Int twoToTheL, Int s0, Int t0)
+{
+	// GlintBRDF::glintCell
+	s0 = s0 * twoToTheL;
+	t0 = t0 * twoToTheL;
+	Int rngSeed = s0 + Int(1549) * t0;
+
+	Float uMicrofacetRelativeArea = hashIQ(rngSeed * Int(13));
+	Mask discarded = uMicrofacetRelativeArea > Float(u.microfacetRelativeArea);
+
+	Float uDensityRandomisation = hashIQ(rngSeed * Int(2171));
+	Float l_dist = Float(2.f * 1.414213f) * erfinv(Float(2.f) * uDensityRandomisation - Float(1.f)) + lDistMean;
+	Int lDist = min(max(roundToInt(l_dist), Int(0)), Int(u.nlevels));
+	// The entry nlevels of the residency table is null
+	Mask dictionaryCell = gather(u.resident, lDist) != Float(0.f);
+
+	Float theta = Float(u.rotation) * hashIQ(rngSeed);
+	Float u1 = hashIQ(rngSeed * Int(16807));
+	Float u2 = hashIQ(rngSeed * Int(48271));
+	// u1 and u2 round to 1 for a few seeds: the rows are clamped to the dictionary
+	Int i = min(truncate(u1 * Float(float(u.n))), Int(u.n - 1));
+	Int j = min(truncate(u2 * Float(float(u.n))), Int(u.n - 1));
+
+	// GlintBRDF::P22_dictionary
+	Mask lanes = active & dictionaryCell;
+	Float value(0.f);
+	if (any(lanes)) {
+		Float cosTheta, sinTheta;
+		sincos(theta, sinTheta, cosTheta);
+		Float scaleX(u.scaleFactorX), scaleY(u.scaleFactorY);
+		Float x = slopeX * cosTheta / scaleX + slopeY * sinTheta / scaleY;
+		Float y = -slopeX * sinTheta / scaleX + slopeY * cosTheta / scaleY;
+		Float absX = abs(x), absY = abs(y);
+		Float alphaDist(u.alpha_dist_isqrt2_4);
+		lanes = lanes & (absX <= alphaDist) & (absY <= alphaDist);
+
+		Float texCoordX = absX / alphaDist * Float(float(u.width));
+		Float texCoordY = absY / alphaDist * Float(float(u.width));
+		// i / 3 as a product, exact for i < 2^15
+		Int iDiv3 = shiftRight<17>(i * Int(43691));
+		Int jDiv3 = shiftRight<17>(j * Int(43691));
+		Int layerX = lDist * Int(u.distPerChannel) + iDiv3;
+		Int layerY = lDist * Int(u.distPerChannel) + jDiv3;
+		// Inactive lanes read the first layer
+		layerX = select(lanes, layerX, Int(0));
+		layerY = select(lanes, layerY, Int(0));
+
+		Float supportX0 = gather(u.support, layerX * Int(2));
+		Float supportX1 = gather(u.support, layerX * Int(2) + Int(1));
+		Float supportY0 = gather(u.support, layerY * Int(2));
+		Float supportY1 = gather(u.support, layerY * Int(2) + Int(1));
+		lanes = lanes & (texCoordX >= supportX0) & (texCoordX <= supportX1) & (texCoordY >= supportY0) & (texCoordY <= supportY1);
+
+		if (any(lanes)) {
+			Float P_i = lookup(u, texCoordX, layerX, i - iDiv3 * Int(3));
+			Float P_j = lookup(u, texCoordY, layerY, j - jDiv3 * Int(3));
+			value = select(lanes, P_i * P_j / Float(u.scaleFactorX * u.scaleFactorY), Float(0.f));
+		}
+	}
+	value = select(dictionaryCell, value, beckmann);
+	return select(discarded, Float(0.f), value);
+}
+
+// GlintBRDF::P22__P_ of the lanes first to first + Width - 1 of the level
+inline void P22__P_(const KernelUniforms& u, LevelLanes& level, int first)
+{
+	Float stS = Float::load(level.stS + first), stT = Float::load(level.stT + first);
+	Float A = Float::load(level.A + first), B = Float::load(level.B + first), C = Float::load(level.C + first);
+	Float radius2 = Float::load(level.radius2 + first);
+	Int minS = Int::load(level.minS + first), minT = Int::load(level.minT + first);
+	Int maxS = Int::load(level.maxS + first), maxT = Int::load(level.maxT + first);
+	Float slopeX = Float::load(level.slopeX + first), slopeY = Float::load(level.slopeY + first);
+	Float beckmann = Float::load(level.beckmann + first);
+	Float lDistMean = Float::load(level.lDistMean + first);
+	Int twoToTheL = Int::load(level.twoToTheL + first);
+
+	// Each lane goes through the cells of its bounding box in the order of GlintBRDF::forEachCell, up to its maxCells
+	// cells inside
+	Mask live = (Int::load(level.active + first) != Int(0)) & (minS <= maxS) & (minT <= maxT);
+	Int is = minS, it = minT;
+	Int cells(0);
+	Float sum(0.f), sumWts(0.f);
+	while (any(live)) {
+		Float ss = toFloat(is) - stS;
+		Float tt = toFloat(it) - stT;
+		Float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+		Mask inside = live & (r2 < radius2);
+		if (any(inside)) {
+			Float W_P = exp(Float(-2.f) * r2) - Float(u.expMinusAlpha);
+			Float P22 = P22_theta_alpha(u, inside, slopeX, slopeY, beckmann, lDistMean, twoToTheL, is, it);
+			sum = sum + select(inside, P22 * W_P, Float(0.f));
+			sumWts = sumWts + select(inside, W_P, Float(0.f));
+			cells = cells + select(inside, Int(1), Int(0));
+		}
+		// Next cell
+		is = is + Int(1);
+		Mask nextRow = is > maxS;
+		is = select(nextRow, minS, is);
+		it = select(nextRow, it + Int(1), it);
+		live = live & (it <= maxT) & (Int(GlintBRDF::maxCells) > cells);
+	}
+	(sum / sumWts).store(level.average + first);
+}
+
+inline void evaluate(const KernelUniforms& u, LevelLanes& level, int count)
+{
+	for (int first = 0; first < count; first += Width)
+		P22__P_(u, level, first);
+}
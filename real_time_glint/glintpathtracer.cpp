@@ -0,0 +1,427 @@
+#include "glintpathtracer.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+	const float Pi = 3.14159265f;
+
+	// PCG32 (O'Neill 2014), one stream per pixel and iteration
+	class Random {
+	public:
+		explicit Random(uint64_t seed) : state(0)
+		{
+			next();
+			state += seed;
+			next();
+		}
+
+		float uniform()
+		{
+			return std::min(float(next() >> 8) * (1.f / 16777216.f), 0.99999994f);
+		}
+
+	private:
+		uint64_t state;
+
+		uint32_t next()
+		{
+			uint64_t old = state;
+			state = old * 6364136223846793005ull + 1442695040888963407ull;
+			uint32_t shifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+			uint32_t rotation = uint32_t(old >> 59u);
+			return (shifted >> rotation) | (shifted << ((0u - rotation) & 31u));
+		}
+	};
+
+	uint64_t mix(uint64_t x)
+	{
+		// splitmix64 finalizer
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	// Orthonormal frame of the interpolated normal and tangent (Gram-Schmidt), binormal as in glint.frag.glsl
+	struct Frame {
+		glm::vec3 t, b, n;
+
+		Frame(glm::vec3 normal, glm::vec3 tangent)
+		{
+			n = glm::normalize(normal);
+			t = tangent - n * glm::dot(n, tangent);
+			float length = glm::length(t);
+			if (length > 1e-6f)
+				t /= length;
+			else
+				t = std::abs(n.x) < 0.9f ? glm::normalize(glm::cross(n, glm::vec3(1.f, 0.f, 0.f))) : glm::normalize(glm::cross(n, glm::vec3(0.f, 1.f, 0.f)));
+			b = glm::cross(n, t);
+		}
+
+		glm::vec3 toLocal(glm::vec3 v) const { return glm::vec3(glm::dot(t, v), glm::dot(b, v), glm::dot(n, v)); }
+		glm::vec3 toWorld(glm::vec3 v) const { return t * v.x + b * v.y + n * v.z; }
+	};
+
+	double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+// Ray with its differentials: the derivatives of the origin and of the direction with respect to the pixel x and y
+struct GlintPathTracer::Ray {
+	glm::vec3 origin, direction;
+	glm::vec3 dOdx, dOdy, dDdx, dDdy;
+	bool hasDifferentials;
+};
+
+struct GlintPathTracer::Hit {
+	float t;
+	float b1, b2; // Barycentric coordinates of the vertices 1 and 2
+	int triangle;
+};
+
+GlintPathTracer::GlintPathTracer(const std::vector<Mesh>& meshes) :
+	meshes(meshes),
+	brdf(nullptr),
+	environment(0.f),
+	maxBounces(4),
+	iterationCount(0)
+{
+}
+
+void GlintPathTracer::setView(const GlintView& newView, GlintBRDF& newBRDF)
+{
+	view = newView;
+	view.applyMaterial(newBRDF);
+	brdf = &newBRDF;
+	accumulated.assign(size_t(view.width) * view.height * 3, 0.f);
+	iterationCount = 0;
+
+	// The triangles in world space, as the outputs of glint.vert.glsl
+	triangles.clear();
+	glm::mat4 modelMatrix = view.modelMatrix();
+	for (const Mesh& mesh : meshes) {
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			Triangle triangle;
+			for (int k = 0; k < 3; ++k) {
+				const Vertex& vertex = mesh.vertices[mesh.indices[i + k]];
+				glm::vec4 position = modelMatrix * glm::vec4(vertex.Position, 1.f);
+				glm::vec4 normal = modelMatrix * glm::vec4(vertex.Normal, 0.f);
+				glm::vec4 tangent = modelMatrix * glm::vec4(vertex.Tangent, 0.f);
+				triangle.p[k] = glm::vec3(position.x, position.y, position.z);
+				triangle.n[k] = glm::normalize(glm::vec3(normal.x, normal.y, normal.z));
+				triangle.t[k] = glm::normalize(glm::vec3(tangent.x, tangent.y, tangent.z));
+				triangle.uv[k] = vertex.TexCoords;
+			}
+			triangles.push_back(triangle);
+		}
+	}
+
+	nodes.clear();
+	if (triangles.empty())
+		return;
+	std::vector<glm::vec3> centroids(triangles.size());
+	for (size_t i = 0; i < triangles.size(); ++i)
+		centroids[i] = (triangles[i].p[0] + triangles[i].p[1] + triangles[i].p[2]) / 3.f;
+	nodes.reserve(2 * triangles.size());
+	buildNode(0, int(triangles.size()), centroids);
+}
+
+int GlintPathTracer::buildNode(int first, int count, std::vector<glm::vec3>& centroids)
+{
+	int index = int(nodes.size());
+	nodes.push_back(BVHNode());
+	glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+	glm::vec3 centroidLo = lo, centroidHi = hi;
+	for (int i = first; i < first + count; ++i) {
+		for (int k = 0; k < 3; ++k) {
+			lo = glm::min(lo, triangles[i].p[k]);
+			hi = glm::max(hi, triangles[i].p[k]);
+		}
+		centroidLo = glm::min(centroidLo, centroids[i]);
+		centroidHi = glm::max(centroidHi, centroids[i]);
+	}
+	nodes[index].min = lo;
+	nodes[index].max = hi;
+
+	// Median split on the largest axis of the centroids
+	glm::vec3 extent = centroidHi - centroidLo;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	if (count <= 4 || !(extent[axis] > 0.f)) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+	int middle = first + count / 2;
+	std::vector<int> order(count);
+	for (int i = 0; i < count; ++i)
+		order[i] = first + i;
+	std::nth_element(order.begin(), order.begin() + count / 2, order.end(),
+		[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	std::vector<Triangle> sortedTriangles(count);
+	std::vector<glm::vec3> sortedCentroids(count);
+	for (int i = 0; i < count; ++i) {
+		sortedTriangles[i] = triangles[order[i]];
+		sortedCentroids[i] = centroids[order[i]];
+	}
+	std::copy(sortedTriangles.begin(), sortedTriangles.end(), triangles.begin() + first);
+	std::copy(sortedCentroids.begin(), sortedCentroids.end(), centroids.begin() + first);
+
+	buildNode(first, middle - first, centroids);
+	int right = buildNode(middle, first + count - middle, centroids);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+bool GlintPathTracer::intersect(const Ray& ray, float tMax, Hit* hit) const
+{
+	if (nodes.empty())
+		return false;
+	glm::vec3 invDirection = 1.f / ray.direction;
+	bool found = false;
+	int stack[64];
+	int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0) {
+		const BVHNode& node = nodes[stack[--depth]];
+
+		// Slabs
+		glm::vec3 t0 = (node.min - ray.origin) * invDirection;
+		glm::vec3 t1 = (node.max - ray.origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		if (!(enter <= exit))
+			continue;
+
+		if (node.count == 0) {
+			stack[depth++] = node.first;
+			stack[depth++] = int(&node - nodes.data()) + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			// Moller-Trumbore, both sides
+			const Triangle& triangle = triangles[i];
+			glm::vec3 e1 = triangle.p[1] - triangle.p[0];
+			glm::vec3 e2 = triangle.p[2] - triangle.p[0];
+			glm::vec3 p = glm::cross(ray.direction, e2);
+			float determinant = glm::dot(e1, p);
+			if (std::abs(determinant) < 1e-12f)
+				continue;
+			float invDeterminant = 1.f / determinant;
+			glm::vec3 s = ray.origin - triangle.p[0];
+			float b1 = glm::dot(s, p) * invDeterminant;
+			if (b1 < 0.f || b1 > 1.f)
+				continue;
+			glm::vec3 q = glm::cross(s, e1);
+			float b2 = glm::dot(ray.direction, q) * invDeterminant;
+			if (b2 < 0.f || b1 + b2 > 1.f)
+				continue;
+			float t = glm::dot(e2, q) * invDeterminant;
+			if (t <= 0.f || t >= tMax)
+				continue;
+			if (hit == nullptr)
+				return true;
+			tMax = t;
+			hit->t = t;
+			hit->b1 = b1;
+			hit->b2 = b2;
+			hit->triangle = i;
+			found = true;
+		}
+	}
+	return found;
+}
+
+double GlintPathTracer::iterate(unsigned int threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	Camera camera(view.cameraPosition, glm::vec3(0.f, 1.f, 0.f), view.cameraYaw, view.cameraPitch);
+	float tanHalfFovy = std::tan(glm::radians(view.fovy) * 0.5f);
+	float aspect = float(view.width) / float(view.height);
+	glm::vec3 right = camera.Right * (tanHalfFovy * aspect);
+	glm::vec3 up = camera.Up * tanHalfFovy;
+	int iteration = iterationCount;
+
+	// Rows are handed out one by one; each pixel has its own random stream, so the image does not depend on the threads
+	Parallel::forEachIndex(size_t(view.height), [&](size_t row) {
+		int y = view.height - 1 - int(row); // Window coordinates, y up
+		for (int x = 0; x < view.width; ++x) {
+			uint64_t seed = mix((uint64_t(iteration) << 40) ^ (uint64_t(y) << 20) ^ uint64_t(x));
+			Random random(seed);
+			glm::vec2 p(float(x) + random.uniform(), float(y) + random.uniform());
+			auto direction = [&](glm::vec2 window) {
+				glm::vec2 ndc = window / glm::vec2(float(view.width), float(view.height)) * 2.f - 1.f;
+				return glm::normalize(camera.Front + ndc.x * right + ndc.y * up);
+			};
+
+			// The differentials span one pixel, the footprint of dFdx and dFdy
+			Ray ray;
+			ray.origin = view.cameraPosition;
+			ray.direction = direction(p);
+			ray.dOdx = ray.dOdy = glm::vec3(0.f);
+			ray.dDdx = direction(p + glm::vec2(1.f, 0.f)) - ray.direction;
+			ray.dDdy = direction(p + glm::vec2(0.f, 1.f)) - ray.direction;
+			ray.hasDifferentials = true;
+
+			glm::vec3 radiance = trace(ray, mix(seed + 1));
+			float* sum = &accumulated[(row * view.width + x) * 3];
+			sum[0] += radiance.x;
+			sum[1] += radiance.y;
+			sum[2] += radiance.z;
+		}
+	}, threads);
+	++iterationCount;
+	return secondsSince(start);
+}
+
+glm::vec3 GlintPathTracer::trace(Ray ray, uint64_t seed) const
+{
+	Random random(seed);
+	glm::vec3 lightPosition(view.lightPosition.x, view.lightPosition.y, view.lightPosition.z);
+	glm::vec3 radiance(0.f), throughput(1.f);
+
+	for (int bounce = 0; ; ++bounce) {
+		Hit hit;
+		if (!intersect(ray, std::numeric_limits<float>::max(), &hit)) {
+			// The environment lights the surfaces only, the background is black as in the real time renderer
+			if (bounce > 0)
+				radiance += throughput * environment;
+			break;
+		}
+
+		const Triangle& triangle = triangles[hit.triangle];
+		float b0 = 1.f - hit.b1 - hit.b2;
+		glm::vec3 e1 = triangle.p[1] - triangle.p[0];
+		glm::vec3 e2 = triangle.p[2] - triangle.p[0];
+		glm::vec3 position = b0 * triangle.p[0] + hit.b1 * triangle.p[1] + hit.b2 * triangle.p[2];
+		glm::vec3 normal = b0 * triangle.n[0] + hit.b1 * triangle.n[1] + hit.b2 * triangle.n[2];
+		glm::vec3 tangent = b0 * triangle.t[0] + hit.b1 * triangle.t[1] + hit.b2 * triangle.t[2];
+		glm::vec2 texCoord = b0 * triangle.uv[0] + hit.b1 * triangle.uv[1] + hit.b2 * triangle.uv[2];
+		glm::vec3 geometricNormal = glm::normalize(glm::cross(e1, e2));
+		Frame frame(normal, tangent);
+		glm::vec3 wo = glm::normalize(frame.toLocal(-ray.direction));
+		if (wo.z <= 0.f)
+			break;
+
+		// Footprint: transfer of the differentials to the plane of the triangle (Igehy 1999), then the barycentric
+		// coordinates of the offsets give the derivatives of the texture coordinates
+		glm::vec2 dst0(0.f), dst1(0.f);
+		glm::vec2 dbdx(0.f), dbdy(0.f); // Derivatives of (b1, b2)
+		glm::vec3 dPdx(0.f), dPdy(0.f);
+		if (ray.hasDifferentials) {
+			float dn = glm::dot(ray.direction, geometricNormal);
+			auto transfer = [&](glm::vec3 dO, glm::vec3 dD) {
+				glm::vec3 dP = dO + hit.t * dD;
+				return dP - ray.direction * (glm::dot(dP, geometricNormal) / dn);
+			};
+			float e11 = glm::dot(e1, e1), e12 = glm::dot(e1, e2), e22 = glm::dot(e2, e2);
+			float invGram = 1.f / (e11 * e22 - e12 * e12);
+			auto barycentric = [&](glm::vec3 dP) {
+				float d1 = glm::dot(e1, dP), d2 = glm::dot(e2, dP);
+				return glm::vec2(e22 * d1 - e12 * d2, e11 * d2 - e12 * d1) * invGram;
+			};
+			if (std::abs(dn) > 1e-6f && std::isfinite(invGram)) {
+				dPdx = transfer(ray.dOdx, ray.dDdx);
+				dPdy = transfer(ray.dOdy, ray.dDdy);
+				dbdx = barycentric(dPdx);
+				dbdy = barycentric(dPdy);
+				glm::vec2 duv1 = triangle.uv[1] - triangle.uv[0], duv2 = triangle.uv[2] - triangle.uv[0];
+				dst0 = dbdx.x * duv1 + dbdx.y * duv2;
+				dst1 = dbdy.x * duv1 + dbdy.y * duv2;
+			}
+		}
+
+		// Offset of the secondary rays, out of the side of the triangle they leave
+		float epsilon = 1e-4f * std::max(1.f, glm::length(position));
+		auto offset = [&](glm::vec3 direction) {
+			return position + geometricNormal * (glm::dot(direction, geometricNormal) > 0.f ? epsilon : -epsilon);
+		};
+		// BRDF times the cosine, as glint.frag.glsl weights its two lobes
+		auto f = [&](glm::vec3 wi) {
+			return 0.5f * GlintBRDF::f_diffuse(wo, wi) + 0.5f * brdf->f_P(wo, wi, texCoord, dst0, dst1);
+		};
+
+		// Point light
+		glm::vec3 toLight = lightPosition - position;
+		float distanceSquared = glm::dot(toLight, toLight);
+		float distance = std::sqrt(distanceSquared);
+		glm::vec3 toLightDirection = toLight / distance;
+		glm::vec3 wi = glm::normalize(frame.toLocal(toLightDirection));
+		if (wi.z > 0.f) {
+			Ray shadow;
+			shadow.origin = offset(toLightDirection);
+			shadow.direction = toLightDirection;
+			if (!intersect(shadow, distance * (1.f - 1e-4f), nullptr))
+				radiance += throughput * f(wi) * view.lightIntensity / distanceSquared;
+		}
+
+		if (bounce == maxBounces)
+			break;
+
+		// Bounce: the Lambertian or the glint lobe, weighted by the density of their mixture
+		bool glint = random.uniform() < 0.5f;
+		glm::vec3 wh;
+		if (glint) {
+			glm::vec4 u(random.uniform(), random.uniform(), random.uniform(), random.uniform());
+			glm::vec2 slope_h;
+			if (!brdf->sample_P22(u, texCoord, dst0, dst1, slope_h))
+				break;
+			wh = glm::normalize(glm::vec3(-slope_h.x, -slope_h.y, 1.f));
+			wi = 2.f * glm::dot(wo, wh) * wh - wo;
+		}
+		else {
+			// Cosine weighted
+			float u1 = random.uniform(), u2 = random.uniform();
+			float r = std::sqrt(u1), phi = 2.f * Pi * u2;
+			wi = glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.f, 1.f - u1)));
+			wh = glm::normalize(wo + wi);
+		}
+		if (wi.z <= 0.f || wh.z <= 0.f || glm::dot(wo, wh) <= 0.f)
+			break;
+		glm::vec2 slope_h(-wh.x / wh.z, -wh.y / wh.z);
+		float pdfGlint = brdf->pdf_P22(slope_h, texCoord, dst0, dst1) / (wh.z * wh.z * wh.z) / (4.f * glm::dot(wo, wh));
+		float pdf = 0.5f * wi.z / Pi + 0.5f * pdfGlint;
+		if (!(pdf > 0.f))
+			break;
+		throughput *= f(wi) / pdf;
+
+		glm::vec3 direction = frame.toWorld(wi);
+		Ray next;
+		next.origin = offset(direction);
+		next.direction = glm::normalize(direction);
+		next.hasDifferentials = ray.hasDifferentials && glint;
+		if (next.hasDifferentials) {
+			// Mirror reflection about the microfacet normal, which follows the interpolated normal across the footprint
+			glm::vec3 m = frame.toWorld(wh);
+			glm::vec3 dn1 = triangle.n[1] - triangle.n[0], dn2 = triangle.n[2] - triangle.n[0];
+			auto reflect = [&](glm::vec3 dD, glm::vec2 db) {
+				glm::vec3 dm = db.x * dn1 + db.y * dn2;
+				float dDm = glm::dot(dD, m) + glm::dot(ray.direction, dm);
+				return dD - 2.f * (glm::dot(ray.direction, m) * dm + dDm * m);
+			};
+			next.dOdx = dPdx;
+			next.dOdy = dPdy;
+			next.dDdx = reflect(ray.dDdx, dbdx);
+			next.dDdy = reflect(ray.dDdy, dbdy);
+		}
+		ray = next;
+	}
+	return radiance;
+}
+
+GlintImage GlintPathTracer::image() const
+{
+	GlintImage result(view.width, view.height);
+	float scale = iterationCount > 0 ? 1.f / float(iterationCount) : 0.f;
+	for (size_t k = 0; k < accumulated.size(); ++k)
+		result.rgb[k] = accumulated[k] * scale;
+	return result;
+}
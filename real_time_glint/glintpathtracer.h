@@ -0,0 +1,68 @@
+#pragma once
+
+#include "glintimage.h"
+#include "glintview.h"
+#include "mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+// Progressive path tracer of the glint scene without GPU, for ground truth and offline stills.
+// The surfaces have the material of glint.frag.glsl: half the Lambertian BRDF and half the glint BRDF. They are lit by
+// the point light of the view (with shadow rays) and by an optional uniform environment, seen by the bounces only:
+// the background stays black as in the real time renderer. The bounces pick the Lambertian or the glint lobe with
+// equal probability, the glint lobe by GlintBRDF::sample_P22, and are weighted by the density of the mixture.
+// Camera rays carry ray differentials: at the hits, they give the derivatives of the texture coordinates that the
+// shader takes from dFdx and dFdy. They follow the reflections of the glint lobe (Igehy 1999); after a Lambertian
+// bounce the footprint is unknown and the glint BRDF falls back to its Beckmann lobe.
+class GlintPathTracer {
+public:
+	// The meshes must outlive the path tracer
+	explicit GlintPathTracer(const std::vector<Mesh>& meshes);
+
+	// Radiance of the environment, black by default
+	void setEnvironment(glm::vec3 radiance) { environment = radiance; }
+	// Maximum number of bounces after the camera ray, 4 by default
+	void setMaxBounces(int bounces) { maxBounces = bounces; }
+
+	// Place the meshes and the camera of the view, and restart the accumulation.
+	// The material of the view is copied to brdf, which must outlive the rendering.
+	void setView(const GlintView& view, GlintBRDF& brdf);
+
+	// Add one sample per pixel, on threads threads (Parallel::threadCount() for 0). Returns the seconds it took.
+	double iterate(unsigned int threads = 0);
+	int iterations() const { return iterationCount; }
+	// Average of the samples: the linear radiance
+	GlintImage image() const;
+
+private:
+	struct Triangle {
+		glm::vec3 p[3];
+		glm::vec3 n[3];
+		glm::vec3 t[3];
+		glm::vec2 uv[3];
+	};
+
+	struct BVHNode {
+		glm::vec3 min, max;
+		int first; // First triangle of a leaf, right child of an inner node (the left one follows the node)
+		int count; // Number of triangles of a leaf, 0 for an inner node
+	};
+
+	struct Ray;
+	struct Hit;
+
+	const std::vector<Mesh>& meshes;
+	std::vector<Triangle> triangles;
+	std::vector<BVHNode> nodes;
+	GlintView view;
+	const GlintBRDF* brdf;
+	glm::vec3 environment;
+	int maxBounces;
+	std::vector<float> accumulated; // Sums of the samples, RGB, top row first
+	int iterationCount;
+
+	int buildNode(int first, int count, std::vector<glm::vec3>& centroids);
+	bool intersect(const Ray& ray, float tMax, Hit* hit) const;
+	glm::vec3 trace(Ray ray, uint64_t seed) const;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+// Variants of glint.frag.glsl. A permutation key is a set of features, each fixed at compile time by the macro of its
+// bit (see the head of the shader): the specialisations constant-fold the branches and the hashes of the material
+// parameters they fix, without changing the image, the other features select a code path.
+namespace GlintPermutation {
+	const unsigned int Isotropic = 1u << 0;   // GLINT_ISOTROPIC: alpha_y is alpha_x
+	const unsigned int FullArea = 1u << 1;    // GLINT_FULL_AREA: microfacet relative area of 1, no cell is discarded
+	const unsigned int NoRotation = 1u << 2;  // GLINT_NO_ROTATION: the distributions of the cells are not rotated
+	const unsigned int FusedLevels = 1u << 3; // GLINT_FUSED_LEVELS: the two LODs of f_P are scanned together
+	const unsigned int Stochastic = 1u << 4;  // GLINT_STOCHASTIC: f_P picks a few cells, averaged over the frames
+	const int Count = 5;
+
+	// Features that leave the image as it is, dropped from the key of the generic shader
+	const unsigned int Specialisations = Isotropic | FullArea;
+
+	inline const char* macro(int bit)
+	{
+		static const char* const macros[Count] = { "GLINT_ISOTROPIC", "GLINT_FULL_AREA", "GLINT_NO_ROTATION", "GLINT_FUSED_LEVELS",
+			"GLINT_STOCHASTIC" };
+		return macros[bit];
+	}
+
+	// Key of the shader specialised for a material
+	inline unsigned int key(float alpha_x, float alpha_y, float microfacetRelativeArea, bool cellRotation, bool fusedLevels,
+		bool stochastic)
+	{
+		unsigned int features = 0;
+		if (alpha_x == alpha_y)
+			features |= Isotropic;
+		if (microfacetRelativeArea >= 1.f)
+			features |= FullArea;
+		if (!cellRotation)
+			features |= NoRotation;
+		if (fusedLevels)
+			features |= FusedLevels;
+		if (stochastic)
+			features |= Stochastic;
+		return features;
+	}
+
+	// Features of a key, "generic" for the key 0
+	inline std::string name(unsigned int key)
+	{
+		static const char* const names[Count] = { "isotropic", "full area", "no rotation", "fused LODs", "stochastic" };
+		std::string features;
+		for (int bit = 0; bit < Count; ++bit) {
+			if (key & (1u << bit))
+				features += (features.empty() ? "" : ", ") + std::string(names[bit]);
+		}
+		return features.empty() ? "generic" : features;
+	}
+}
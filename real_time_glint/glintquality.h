@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+
+// Quality presets of the glint BRDF, which bound the cost of a pixel
+enum class GlintQuality : int {
+	Low = 0,
+	Medium = 1,
+	High = 2,     // Default
+	Reference = 3 // Every cell of the EWA filter
+};
+
+// Parameters of f_P set by a preset (see GlintBRDF)
+struct GlintQualitySettings {
+	int cellBudget;      // Cells of the EWA filter evaluated per LOD and pixel, 0 for no budget
+	float maxAnisotropy; // Clamp of the eccentricity of the footprint
+	float lodBias;       // Added to the LOD of the footprint, positive values select coarser LODs with fewer cells
+};
+
+namespace GlintQualities {
+	const int Count = 4;
+
+	inline const char* name(GlintQuality quality)
+	{
+		switch (quality) {
+		case GlintQuality::Low: return "low";
+		case GlintQuality::Medium: return "medium";
+		case GlintQuality::High: return "high";
+		default: return "reference";
+		}
+	}
+
+	// "low", "medium", "high" or "reference", false for other names
+	inline bool parse(const std::string& qualityName, GlintQuality& quality)
+	{
+		for (int k = 0; k < Count; ++k) {
+			if (qualityName == name(static_cast<GlintQuality>(k))) {
+				quality = static_cast<GlintQuality>(k);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Over random footprints, the ellipse of a level holds up to 35 cells at a maximum anisotropy of 4, 119 at 8 and 236
+	// at 16: the budgets drop the cells of the lowest weights beyond theirs, the reference keeps them all (see maxCells)
+	inline GlintQualitySettings settings(GlintQuality quality)
+	{
+		switch (quality) {
+		case GlintQuality::Low: return { 8, 4.f, 0.5f };
+		case GlintQuality::Medium: return { 16, 8.f, 0.25f };
+		case GlintQuality::High: return { 64, 8.f, 0.f };
+		default: return { 0, 16.f, 0.f };
+		}
+	}
+}
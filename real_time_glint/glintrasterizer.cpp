@@ -0,0 +1,242 @@
+#include "glintrasterizer.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+	double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+GlintRasterizer::GlintRasterizer(const std::vector<Mesh>& meshes) :
+	meshes(meshes),
+	lastTimings{ 0., 0. }
+{
+}
+
+GlintImage GlintRasterizer::render(const GlintView& view, GlintBRDF& brdf, unsigned int threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	int tilesX = (view.width + TileSize - 1) / TileSize;
+	int tilesY = (view.height + TileSize - 1) / TileSize;
+	setupTriangles(view);
+	binTriangles(tilesX, tilesY);
+	lastTimings.setup = secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	view.applyMaterial(brdf);
+	GlintPacketEvaluator evaluator(brdf);
+	GlintImage image(view.width, view.height);
+	// Tiles are handed out one by one: the threads done with empty tiles take the next ones
+	Parallel::forEachIndex(size_t(tilesX) * tilesY, [&](size_t tile) {
+		renderTile(int(tile % tilesX), int(tile / tilesX), view, evaluator, image);
+	}, threads);
+	lastTimings.shading = secondsSince(start);
+	return image;
+}
+
+void GlintRasterizer::setupTriangles(const GlintView& view)
+{
+	triangles.clear();
+	glm::mat4 modelMatrix = view.modelMatrix();
+	glm::mat4 mvp = view.projectionMatrix() * view.viewMatrix() * modelMatrix;
+
+	std::vector<ClipVertex> clipVertices;
+	for (const Mesh& mesh : meshes) {
+		// glint.vert.glsl
+		clipVertices.resize(mesh.vertices.size());
+		for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+			const Vertex& vertex = mesh.vertices[v];
+			ClipVertex& out = clipVertices[v];
+			glm::vec4 normal = modelMatrix * glm::vec4(vertex.Normal, 0.f);
+			glm::vec4 tangent = modelMatrix * glm::vec4(vertex.Tangent, 0.f);
+			glm::vec4 position = modelMatrix * glm::vec4(vertex.Position, 1.f);
+			out.normal = glm::normalize(glm::vec3(normal.x, normal.y, normal.z));
+			out.tangent = glm::normalize(glm::vec3(tangent.x, tangent.y, tangent.z));
+			out.texCoord = vertex.TexCoords;
+			out.worldPosition = glm::vec3(position.x, position.y, position.z);
+			out.position = mvp * glm::vec4(vertex.Position, 1.f);
+		}
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			const ClipVertex* in[3] = { &clipVertices[mesh.indices[i]], &clipVertices[mesh.indices[i + 1]], &clipVertices[mesh.indices[i + 2]] };
+			// Clip to the near plane z = -w (Sutherland-Hodgman), the attributes are linear in clip space
+			ClipVertex polygon[4];
+			int count = 0;
+			for (int k = 0; k < 3; ++k) {
+				const ClipVertex& current = *in[k];
+				const ClipVertex& next = *in[(k + 1) % 3];
+				float dCurrent = current.position.z + current.position.w;
+				float dNext = next.position.z + next.position.w;
+				if (dCurrent >= 0.f)
+					polygon[count++] = current;
+				if ((dCurrent >= 0.f) != (dNext >= 0.f)) {
+					float t = dCurrent / (dCurrent - dNext);
+					ClipVertex& clipped = polygon[count++];
+					clipped.position = current.position + (next.position - current.position) * t;
+					clipped.worldPosition = current.worldPosition + (next.worldPosition - current.worldPosition) * t;
+					clipped.normal = current.normal + (next.normal - current.normal) * t;
+					clipped.tangent = current.tangent + (next.tangent - current.tangent) * t;
+					clipped.texCoord = current.texCoord + (next.texCoord - current.texCoord) * t;
+				}
+			}
+			for (int k = 1; k + 1 < count; ++k)
+				addTriangle(polygon[0], polygon[k], polygon[k + 1], view.width, view.height);
+		}
+	}
+}
+
+void GlintRasterizer::addTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int width, int height)
+{
+	Triangle triangle;
+	triangle.vertices[0] = a;
+	triangle.vertices[1] = b;
+	triangle.vertices[2] = c;
+	for (int k = 0; k < 3; ++k) {
+		const glm::vec4& position = triangle.vertices[k].position;
+		triangle.invW[k] = 1.f / position.w;
+		triangle.screen[k] = glm::vec2((position.x * triangle.invW[k] * 0.5f + 0.5f) * float(width),
+			(position.y * triangle.invW[k] * 0.5f + 0.5f) * float(height));
+		triangle.depth[k] = position.z * triangle.invW[k] * 0.5f + 0.5f;
+	}
+
+	// Twice the signed area: the barycentric coordinates are positive inside the triangle whatever its orientation
+	const glm::vec2* s = triangle.screen;
+	float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+	if (!(std::abs(area) > 0.f))
+		return;
+	for (int k = 0; k < 3; ++k) {
+		// Edge opposite to the vertex k
+		const glm::vec2& p0 = s[(k + 1) % 3];
+		const glm::vec2& p1 = s[(k + 2) % 3];
+		triangle.edgeX[k] = -(p1.y - p0.y) / area;
+		triangle.edgeY[k] = (p1.x - p0.x) / area;
+		triangle.edge0[k] = ((p1.y - p0.y) * p0.x - (p1.x - p0.x) * p0.y) / area;
+	}
+
+	// Pixels whose center may be covered
+	glm::vec2 lo = glm::min(s[0], glm::min(s[1], s[2]));
+	glm::vec2 hi = glm::max(s[0], glm::max(s[1], s[2]));
+	triangle.min = glm::ivec2(std::max(int(std::ceil(lo.x - 0.5f)), 0), std::max(int(std::ceil(lo.y - 0.5f)), 0));
+	triangle.max = glm::ivec2(std::min(int(std::floor(hi.x - 0.5f)), width - 1), std::min(int(std::floor(hi.y - 0.5f)), height - 1));
+	if (triangle.min.x > triangle.max.x || triangle.min.y > triangle.max.y)
+		return;
+	triangles.push_back(triangle);
+}
+
+void GlintRasterizer::binTriangles(int tilesX, int tilesY)
+{
+	bins.resize(size_t(tilesX) * tilesY);
+	for (std::vector<unsigned int>& bin : bins)
+		bin.clear();
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		const Triangle& triangle = triangles[t];
+		for (int ty = triangle.min.y / TileSize; ty <= triangle.max.y / TileSize; ++ty)
+			for (int tx = triangle.min.x / TileSize; tx <= triangle.max.x / TileSize; ++tx)
+				bins[size_t(ty) * tilesX + tx].push_back(unsigned(t));
+	}
+}
+
+void GlintRasterizer::renderTile(int tileX, int tileY, const GlintView& view, const GlintPacketEvaluator& evaluator, GlintImage& image) const
+{
+	int x0 = tileX * TileSize, y0 = tileY * TileSize;
+	int x1 = std::min(x0 + TileSize, view.width) - 1, y1 = std::min(y0 + TileSize, view.height) - 1;
+	const std::vector<unsigned int>& bin = bins[size_t(tileY) * ((view.width + TileSize - 1) / TileSize) + tileX];
+	if (bin.empty())
+		return;
+
+	// Visibility: depth test GL_LESS against a depth cleared to 1
+	float depth[TileSize * TileSize];
+	int visible[TileSize * TileSize];
+	std::fill(depth, depth + TileSize * TileSize, 1.f);
+	std::fill(visible, visible + TileSize * TileSize, -1);
+	for (unsigned int t : bin) {
+		const Triangle& triangle = triangles[t];
+		for (int y = std::max(y0, triangle.min.y); y <= std::min(y1, triangle.max.y); ++y) {
+			float py = float(y) + 0.5f;
+			for (int x = std::max(x0, triangle.min.x); x <= std::min(x1, triangle.max.x); ++x) {
+				float px = float(x) + 0.5f;
+				glm::vec3 barycentric = triangle.edgeX * px + triangle.edgeY * py + triangle.edge0;
+				if (barycentric.x < 0.f || barycentric.y < 0.f || barycentric.z < 0.f)
+					continue;
+				float z = barycentric.x * triangle.depth[0] + barycentric.y * triangle.depth[1] + barycentric.z * triangle.depth[2];
+				int k = (y - y0) * TileSize + (x - x0);
+				if (z < depth[k] && z >= 0.f) {
+					depth[k] = z;
+					visible[k] = int(t);
+				}
+			}
+		}
+	}
+
+	// Shading of the visible pixels, by packets for the glint BRDF
+	GlintPacket packet;
+	glm::vec3 Li[GlintPacket::Size], diffuse[GlintPacket::Size];
+	glm::ivec2 pixels[GlintPacket::Size];
+	float specular[GlintPacket::Size];
+	int lanes = 0;
+	auto flush = [&]() {
+		evaluator.f_P(packet, lanes, specular);
+		for (int k = 0; k < lanes; ++k) {
+			glm::vec3 radiance = 0.5f * diffuse[k] * Li[k] + 0.5f * specular[k] * Li[k];
+			float* rgb = image.pixel(pixels[k].x, view.height - 1 - pixels[k].y);
+			rgb[0] = radiance.x;
+			rgb[1] = radiance.y;
+			rgb[2] = radiance.z;
+		}
+		lanes = 0;
+	};
+
+	glm::vec3 lightPosition(view.lightPosition.x, view.lightPosition.y, view.lightPosition.z);
+	for (int y = y0; y <= y1; ++y) {
+		for (int x = x0; x <= x1; ++x) {
+			int t = visible[(y - y0) * TileSize + (x - x0)];
+			if (t < 0)
+				continue;
+			const Triangle& triangle = triangles[t];
+			const ClipVertex* v = triangle.vertices;
+			glm::vec2 p(float(x) + 0.5f, float(y) + 0.5f);
+			glm::vec3 barycentric = triangle.edgeX * p.x + triangle.edgeY * p.y + triangle.edge0;
+
+			// Perspective correct interpolation: the attributes divided by w, and 1 / w, are linear in screen space
+			glm::vec3 perW = barycentric * glm::vec3(triangle.invW[0], triangle.invW[1], triangle.invW[2]);
+			float q = perW.x + perW.y + perW.z;
+			glm::vec3 weights = perW / q;
+			glm::vec3 position = weights.x * v[0].worldPosition + weights.y * v[1].worldPosition + weights.z * v[2].worldPosition;
+			glm::vec3 normal = weights.x * v[0].normal + weights.y * v[1].normal + weights.z * v[2].normal;
+			glm::vec3 tangent = weights.x * v[0].tangent + weights.y * v[1].tangent + weights.z * v[2].tangent;
+			glm::vec2 texCoord = weights.x * v[0].texCoord + weights.y * v[1].texCoord + weights.z * v[2].texCoord;
+
+			// dFdx and dFdy: derivatives of (sum of b_k uv_k / w_k) / q
+			glm::vec3 perWdx = triangle.edgeX * glm::vec3(triangle.invW[0], triangle.invW[1], triangle.invW[2]);
+			glm::vec3 perWdy = triangle.edgeY * glm::vec3(triangle.invW[0], triangle.invW[1], triangle.invW[2]);
+			glm::vec2 uvdx = perWdx.x * v[0].texCoord + perWdx.y * v[1].texCoord + perWdx.z * v[2].texCoord;
+			glm::vec2 uvdy = perWdy.x * v[0].texCoord + perWdy.y * v[1].texCoord + perWdy.z * v[2].texCoord;
+			glm::vec2 dst0 = (uvdx - texCoord * (perWdx.x + perWdx.y + perWdx.z)) / q;
+			glm::vec2 dst1 = (uvdy - texCoord * (perWdy.x + perWdy.y + perWdy.z)) / q;
+
+			// main of glint.frag.glsl
+			glm::vec3 binormal = glm::cross(normal, tangent);
+			glm::vec3 toLight = glm::normalize(lightPosition - position);
+			glm::vec3 toCamera = glm::normalize(view.cameraPosition - position);
+			glm::vec3 wi = glm::normalize(glm::vec3(glm::dot(tangent, toLight), glm::dot(binormal, toLight), glm::dot(normal, toLight)));
+			glm::vec3 wo = glm::normalize(glm::vec3(glm::dot(tangent, toCamera), glm::dot(binormal, toCamera), glm::dot(normal, toCamera)));
+			glm::vec3 toLightVector = lightPosition - position;
+			float distanceSquared = glm::dot(toLightVector, toLightVector);
+
+			packet.set(lanes, wo, wi, texCoord, dst0, dst1);
+			Li[lanes] = view.lightIntensity / distanceSquared;
+			diffuse[lanes] = GlintBRDF::f_diffuse(wo, wi);
+			pixels[lanes] = glm::ivec2(x, y);
+			if (++lanes == GlintPacket::Size)
+				flush();
+		}
+	}
+	if (lanes > 0)
+		flush();
+}
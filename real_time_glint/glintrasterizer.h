@@ -0,0 +1,66 @@
+#pragma once
+
+#include "glintimage.h"
+#include "glintpacket.h"
+#include "glintview.h"
+#include "mesh.h"
+
+#include <vector>
+
+// Rasterizer of the glint scene without GPU: the triangles are clipped to the near plane, projected and binned
+// into screen tiles, then the tiles are rasterized, depth tested and shaded on a pool of threads (see
+// Parallel::forEachIndex). As glint.frag.glsl, a pixel is shaded with half the Lambertian BRDF and half the glint
+// BRDF of the point light; the derivatives of the texture coordinates (dFdx and dFdy in the shader) are the
+// analytical derivatives of their perspective correct interpolation. The glint BRDF is evaluated by packets
+// (see GlintPacketEvaluator).
+class GlintRasterizer {
+public:
+	static const int TileSize = 32;
+
+	// Time of the last render, in seconds
+	struct Timings {
+		double setup;   // Vertices, clipping and binning
+		double shading; // Rasterization and shading of the tiles
+	};
+
+	// The meshes must outlive the rasterizer
+	explicit GlintRasterizer(const std::vector<Mesh>& meshes);
+
+	// Render the view, with the material of the view, on threads threads (Parallel::threadCount() for 0).
+	// The image holds the linear radiance, before the gamma of the shader.
+	GlintImage render(const GlintView& view, GlintBRDF& brdf, unsigned int threads = 0);
+
+	const Timings& timings() const { return lastTimings; }
+
+private:
+	// Outputs of glint.vert.glsl
+	struct ClipVertex {
+		glm::vec4 position; // Clip space
+		glm::vec3 worldPosition;
+		glm::vec3 normal;
+		glm::vec3 tangent;
+		glm::vec2 texCoord;
+	};
+
+	// Projected triangle, with the screen gradients of its barycentric coordinates
+	struct Triangle {
+		ClipVertex vertices[3];
+		glm::vec2 screen[3]; // Window coordinates, y up
+		float depth[3];      // Window depth
+		float invW[3];
+		glm::vec3 edgeX;     // Barycentric coordinates of the window point p: edgeX * p.x + edgeY * p.y + edge0
+		glm::vec3 edgeY;
+		glm::vec3 edge0;
+		glm::ivec2 min, max; // Pixel bounding box, clamped to the framebuffer
+	};
+
+	const std::vector<Mesh>& meshes;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<unsigned int>> bins;
+	Timings lastTimings;
+
+	void setupTriangles(const GlintView& view);
+	void addTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int width, int height);
+	void binTriangles(int tilesX, int tilesY);
+	void renderTile(int tileX, int tileY, const GlintView& view, const GlintPacketEvaluator& evaluator, GlintImage& image) const;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "camera.h"
+#include "glintbrdf.h"
+#include "glintquality.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// The setup of SceneGlint as plain values, for the renderers without GPU: framebuffer, camera, orientation of the
+// sphere, point light and material sliders. The defaults are the ones of SceneGlint in its 1600x800 window.
+struct GlintView {
+	int width;
+	int height;
+	glm::vec3 cameraPosition;
+	float cameraYaw;   // Degrees, see Camera
+	float cameraPitch;
+	float fovy;        // Degrees
+	float zNear;
+	float zFar;
+	float objectOrientation; // Radians, added to the half turn of the sphere around y
+	glm::vec4 lightPosition;
+	glm::vec3 lightIntensity;
+
+	// Material sliders
+	float alpha_x;
+	float alpha_y;
+	float logMicrofacetDensity;
+	float microfacetRelativeArea;
+	float maxAnisotropy;
+	bool cellRotation;
+
+	// Blend weight up to which f_P skips a LOD, see GlintBRDF::lodBlendCutoff
+	float lodBlendCutoff;
+	// Set by the quality preset with maxAnisotropy, see GlintQualities
+	int cellBudget;
+	float lodBias;
+
+	GlintView() :
+		width(1600), height(800), cameraPosition(0.f, 0.f, 2.2f), cameraYaw(YAW), cameraPitch(PITCH),
+		fovy(60.f), zNear(0.3f), zFar(100.f), objectOrientation(0.f),
+		lightPosition(5.f, 5.f, 5.f, 1.f), lightIntensity(100.f),
+		alpha_x(0.5f), alpha_y(0.5f), logMicrofacetDensity(27.f), microfacetRelativeArea(1.f), maxAnisotropy(8.f),
+		cellRotation(true), lodBlendCutoff(GlintBRDF::DefaultLodBlendCutoff), cellBudget(64), lodBias(0.f) {}
+
+	glm::mat4 viewMatrix() const
+	{
+		Camera camera(cameraPosition, glm::vec3(0.f, 1.f, 0.f), cameraYaw, cameraPitch);
+		return camera.GetViewMatrix();
+	}
+
+	glm::mat4 projectionMatrix() const
+	{
+		return glm::perspective(glm::radians(fovy), float(width) / float(height), zNear, zFar);
+	}
+
+	// As SceneGlint::drawScene
+	glm::mat4 modelMatrix() const
+	{
+		return glm::rotate(glm::mat4(1.f), glm::radians(180.f) + objectOrientation, glm::vec3(0.f, 1.f, 0.f));
+	}
+
+	// Set maxAnisotropy, cellBudget and lodBias to a quality preset
+	void setQuality(GlintQuality quality)
+	{
+		GlintQualitySettings settings = GlintQualities::settings(quality);
+		cellBudget = settings.cellBudget;
+		maxAnisotropy = settings.maxAnisotropy;
+		lodBias = settings.lodBias;
+	}
+
+	// Copy the material sliders, the LOD blend cutoff and the quality to the uniforms of the BRDF
+	void applyMaterial(GlintBRDF& brdf) const
+	{
+		brdf.alpha_x = alpha_x;
+		brdf.alpha_y = alpha_y;
+		brdf.logMicrofacetDensity = logMicrofacetDensity;
+		brdf.microfacetRelativeArea = microfacetRelativeArea;
+		brdf.maxAnisotropy = maxAnisotropy;
+		brdf.cellRotation = cellRotation;
+		brdf.lodBlendCutoff = lodBlendCutoff;
+		brdf.cellBudget = cellBudget;
+		brdf.lodBias = lodBias;
+	}
+};
@@ -1,9 +1,13 @@
 #include "scene.h"
 #include "scenerunner.h"
 #include "sceneglint.h"
+#include "sceneglintbenchmark.h"
+#include "sceneglintcheck.h"
 
 std::map<std::string, std::string> sceneInfo = {
-	{ "glint", "Rendering real time glint"}
+	{ "glint", "Rendering real time glint"},
+	{ "glintbench", "GPU time of the glint scene for each dictionary storage layout"},
+	{ "glintcheck", "Glint shader against the CPU renderer, in a hidden window; fails above the error thresholds"}
 };
 
 
@@ -11,11 +15,19 @@ int main(int argc, char *argv[])
 {
 	std::string sceneName = (argc == 1) ? "glint" : SceneRunner::parseCLArgs(argc, argv, sceneInfo);
 
-	SceneRunner runner("Real Time Glint - " + sceneName);
+	// The check renders off screen
+	bool visible = sceneName != "glintcheck";
+	SceneRunner runner("Real Time Glint - " + sceneName, WIN_WIDTH, WIN_HEIGHT, 0, visible);
 	std::unique_ptr<Scene> scene;
 	if (sceneName == "glint") {
 		scene = std::unique_ptr<Scene>(new SceneGlint());
 	}
+	else if (sceneName == "glintbench") {
+		scene = std::unique_ptr<Scene>(new SceneGlintBenchmark());
+	}
+	else if (sceneName == "glintcheck") {
+		scene = std::unique_ptr<Scene>(new SceneGlintCheck());
+	}
 
 	return runner.run(std::move(scene));
 }
@@ -1,6 +1,10 @@
 #include "sceneglint.h"
 #include "texture.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -9,20 +13,79 @@
 #include "imgui/imgui_impl_opengl3.h"
 
 SceneGlint::SceneGlint() :
+	prog(nullptr),
+	programKey(0),
 	tPrev(0.0f),
 	lightPos(5.0f, 5.0f, 5.0f, 1.0f),
 	objectOrientation(0.),
+	rotateObject(true),
 	sphere(MEDIA_PATH + std::string("sphere/sphere.obj")),
 	camera(glm::vec3(0., 0., 2.2)),
 	maxAnisotropy(8.f),
+	cellBudget(64),
+	lodBias(0.f),
+	lodBlendCutoff(0.02f),
+	fusedLevels(false),
+	cellRotation(true),
+	specialisedShader(true),
+	stochasticCells(0),
 	microfacetRelativeArea(1.f),
 	alpha_x(0.5f),
 	alpha_y(0.5f),
-	logMicrofacetDensity(27.f) {}
+	logMicrofacetDensity(27.f),
+	dictionaryIndex(0),
+	dictionaryErrorReported(false),
+	dictionaryResident(false),
+	dictionaryFailed(false),
+	bakedCells(true),
+	residentLevels(0),
+	frameIndex(0)
+{
+	// GPU memory budget of the dictionaries, in MB
+	if (const char* budget = getenv("GLINT_DICTIONARY_BUDGET_MB"))
+		dictionaries.setBudget(size_t(std::atoi(budget)) << 20);
+	// Storage of the dictionaries: array (default), atlas, tbo or ssbo
+	if (const char* layoutName = getenv("GLINT_DICTIONARY_LAYOUT")) {
+		DictionaryLayout layout;
+		if (DictionaryLayouts::parse(layoutName, layout))
+			dictionaries.setStorageLayout(layout);
+		else
+			std::cerr << "Unknown dictionary layout " << layoutName << ", expected array, atlas, tbo or ssbo" << std::endl;
+	}
+	// 0 to render with the generic shader instead of the variant specialised for the material
+	if (const char* specialised = getenv("GLINT_SPECIALISED_SHADER"))
+		specialisedShader = std::atoi(specialised) != 0;
+	// Baked cell attributes: 0 to hash all the cells, and the side of the finest baked level
+	if (const char* baked = getenv("GLINT_BAKED_CELLS"))
+		bakedCells = std::atoi(baked) != 0;
+	if (const char* size = getenv("GLINT_BAKED_CELLS_SIZE"))
+		cells.setMaxSize(std::atoi(size));
+	// Cells of the stochastic variant, 0 (default) to evaluate all the cells
+	if (const char* stochastic = getenv("GLINT_STOCHASTIC_CELLS"))
+		stochasticCells = std::max(std::atoi(stochastic), 0);
+	// Quality preset: low, medium, high (default) or reference
+	if (const char* qualityName = getenv("GLINT_QUALITY")) {
+		GlintQuality preset;
+		if (GlintQualities::parse(qualityName, preset))
+			applyQuality(preset);
+		else
+			std::cerr << "Unknown glint quality " << qualityName << ", expected low, medium, high or reference" << std::endl;
+	}
+}
+
+void SceneGlint::applyQuality(GlintQuality preset)
+{
+	GlintQualitySettings settings = GlintQualities::settings(preset);
+	cellBudget = settings.cellBudget;
+	maxAnisotropy = settings.maxAnisotropy;
+	lodBias = settings.lodBias;
+}
 
 void SceneGlint::initScene() {
 
-	compileAndLinkShader();
+	useProgram(permutationKey());
+	cells.init();
+	history.init();
 
 	glEnable(GL_DEPTH_TEST);
 
@@ -30,25 +93,16 @@ void SceneGlint::initScene() {
 
 	projection = glm::perspective(glm::radians(50.0f), (float)width / height, 0.001f, 10000.0f);
 
-	prog.setUniform("Light.L", glm::vec3(100.0f));
-	prog.setUniform("Light.Position", lightPos);
+	prog->setUniform("Light.Position", lightPos);
 
-	// Load dictionary of marginal distributions
-	int numberOfLevels = 16;
-	int numberOfDistributionsPerChannel = 64;
+	// Stream the dictionary of the material (see bindDictionary) in the background.
+	// The Beckmann lobe is rendered for the levels not resident yet.
+	// Once loaded, rewritten dictionary files are patched into the texture.
+	findDictionaries();
+	dictionaries.setHotReload(true);
+	bindDictionary();
 
-	GLuint dicoTex = Texture::loadMultiscaleMarginalDistributions(MEDIA_PATH+std::string("dictionary/dict_16_192_64_0p5_0p02"), numberOfLevels, numberOfDistributionsPerChannel);
-//	GLuint dicoTex = Texture::loadMultiscaleMarginalDistributions("../media/dictionary/dict_16_192_64_0p5_0p02", numberOfLevels, numberOfDistributionsPerChannel);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_1D_ARRAY, dicoTex);
-
-	prog.setUniform("Dictionary.Alpha", 0.5f);
-	prog.setUniform("Dictionary.N", numberOfDistributionsPerChannel * 3);
-	prog.setUniform("Dictionary.NLevels", numberOfLevels);
-	prog.setUniform("Dictionary.Pyramid0Size", 1 << (numberOfLevels - 1));
-
-	prog.setUniform("CameraPosition", camera.Position);
+	prog->setUniform("CameraPosition", camera.Position);
 
 }
 
@@ -65,6 +119,55 @@ void SceneGlint::update(float t, GLFWwindow* window) {
 		ImGui::SliderFloat("Roughness Y", &alpha_y, 0.01f, 1.0f);
 		ImGui::SliderFloat("Log microfacet density", &logMicrofacetDensity, 15.f, 40.f);
 		ImGui::SliderFloat("Microfacet relative area", &microfacetRelativeArea, 0.01f, 1.f);
+		if (ImGui::BeginCombo("Dictionary", std::filesystem::path(dictionaryNames[dictionaryIndex]).filename().string().c_str())) {
+			for (int d = 0; d < int(dictionaryNames.size()); ++d) {
+				if (ImGui::Selectable(std::filesystem::path(dictionaryNames[d]).filename().string().c_str(), d == dictionaryIndex)) {
+					dictionaryIndex = d;
+					dictionaryErrorReported = false;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::BeginCombo("Dictionary storage", DictionaryLayouts::name(dictionaries.storageLayout()))) {
+			for (int k = 0; k < DictionaryLayouts::Count; ++k) {
+				DictionaryLayout layout = static_cast<DictionaryLayout>(k);
+				if (ImGui::Selectable(DictionaryLayouts::name(layout), layout == dictionaries.storageLayout())) {
+					dictionaries.setStorageLayout(layout);
+					dictionaryErrorReported = false;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		// The presets set the three sliders below, which can then be tuned
+		const char* qualityName = "custom";
+		for (int k = 0; k < GlintQualities::Count; ++k) {
+			GlintQualitySettings settings = GlintQualities::settings(static_cast<GlintQuality>(k));
+			if (settings.cellBudget == cellBudget && settings.maxAnisotropy == maxAnisotropy && settings.lodBias == lodBias)
+				qualityName = GlintQualities::name(static_cast<GlintQuality>(k));
+		}
+		if (ImGui::BeginCombo("Quality", qualityName)) {
+			for (int k = 0; k < GlintQualities::Count; ++k) {
+				GlintQuality preset = static_cast<GlintQuality>(k);
+				if (ImGui::Selectable(GlintQualities::name(preset)))
+					applyQuality(preset);
+			}
+			ImGui::EndCombo();
+		}
+		ImGui::SliderInt("Cell budget (0: none)", &cellBudget, 0, 128);
+		ImGui::SliderFloat("Max anisotropy", &maxAnisotropy, 1.f, 16.f);
+		ImGui::SliderFloat("LOD bias", &lodBias, 0.f, 2.f);
+		ImGui::Checkbox("Baked cell attributes", &bakedCells);
+		ImGui::Checkbox("Fused LOD scan", &fusedLevels);
+		ImGui::Checkbox("Random cell rotation", &cellRotation);
+		ImGui::Checkbox("Specialised shader", &specialisedShader);
+		// Averaged over the frames while the view is static
+		ImGui::SliderInt("Stochastic cells (0: all)", &stochasticCells, 0, 8);
+		ImGui::Checkbox("Rotate the sphere", &rotateObject);
+		if (stochasticCells > 0)
+			ImGui::Text("Frames averaged: %d", history.frames());
+		ImGui::Text("Shader: %s, %d variants compiled", GlintPermutation::name(programKey).c_str(), int(programs.size()));
+		ImGui::Text("Dictionaries: %d loaded, %.1f / %.1f MB", int(dictionaries.dictionaryCount()),
+			dictionaries.gpuBytes() / 1048576.f, dictionaries.budget() / 1048576.f);
 
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 		ImGui::End();
@@ -74,7 +177,8 @@ void SceneGlint::update(float t, GLFWwindow* window) {
 	float deltaT = t - tPrev;
 	if (tPrev == 0.0f) deltaT = 0.0f;
 	tPrev = t;
-	objectOrientation = glm::mod(objectOrientation + deltaT * 0.1f, glm::two_pi<float>());
+	if (rotateObject)
+		objectOrientation = glm::mod(objectOrientation + deltaT * 0.1f, glm::two_pi<float>());
 
 	// Camera update
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
@@ -97,11 +201,137 @@ void SceneGlint::update(float t, GLFWwindow* window) {
 
 	view = camera.GetViewMatrix();
 
-	prog.setUniform("CameraPosition", camera.Position);
-	prog.setUniform("MicrofacetRelativeArea", microfacetRelativeArea);
-	prog.setUniform("MaxAnisotropy", maxAnisotropy);
-	prog.setUniform("Material.LogMicrofacetDensity", logMicrofacetDensity);
-	prog.setUniform("DictionaryTex", 0);  //layout binding not supported on 4.1 mac
+	// Variant of the material
+	useProgram(permutationKey());
+
+	// Dictionary streaming
+	bindDictionary();
+	dictionaries.update();
+
+	setUniforms();
+}
+
+void SceneGlint::setUniforms()
+{
+	prog->setUniform("CameraPosition", camera.Position);
+	prog->setUniform("MicrofacetRelativeArea", microfacetRelativeArea);
+	prog->setUniform("MaxAnisotropy", maxAnisotropy);
+	prog->setUniform("CellBudget", cellBudget);
+	prog->setUniform("LodBias", lodBias);
+	prog->setUniform("LodBlendCutoff", lodBlendCutoff);
+	prog->setUniform("StochasticCells", stochasticCells);
+	prog->setUniform("Material.LogMicrofacetDensity", logMicrofacetDensity);
+}
+
+unsigned int SceneGlint::permutationKey() const
+{
+	unsigned int key = GlintPermutation::key(alpha_x, alpha_y, microfacetRelativeArea, cellRotation, fusedLevels,
+		stochasticCells > 0);
+	return specialisedShader ? key : key & ~GlintPermutation::Specialisations;
+}
+
+void SceneGlint::useProgram(unsigned int key)
+{
+	if (prog && key == programKey)
+		return;
+
+	std::unique_ptr<GLSLProgram>& program = programs[key];
+	if (!program) {
+		program.reset(new GLSLProgram());
+		compileAndLinkShader(*program, key);
+	}
+	prog = program.get();
+	programKey = key;
+	prog->use();
+
+	prog->setUniform("Light.L", glm::vec3(100.0f));
+	prog->setUniform("Resolution", glm::ivec2(width, height));
+	for (int shard = 0; shard < DictionaryStreamer::MaxShards; ++shard)  //layout binding not supported on 4.1 mac
+		prog->setUniform(("DictionaryTex[" + std::to_string(shard) + "]").c_str(), dictionaryShardUnit(shard));
+	prog->setUniform("DictionaryScaleOffset", 1);
+	prog->setUniform("DictionarySupport", 2);
+	prog->setUniform("DictionaryAtlas", 6);
+	prog->setUniform("DictionaryTexels", 7);
+	prog->setUniform("DictionaryInverseCDF", 8);
+	prog->setUniform("GlintCells", 9);
+}
+
+void SceneGlint::findDictionaries()
+{
+	// The dictionary of the paper, then the packed dictionaries (see tools/dictpack and tools/dictgen)
+	std::string directory = MEDIA_PATH + std::string("dictionary");
+	std::string paperDictionary = directory + "/dict_16_192_64_0p5_0p02";
+	dictionaryNames.push_back(paperDictionary);
+	std::error_code ec;
+	for (const auto& file : std::filesystem::directory_iterator(directory, ec)) {
+		if (file.path().extension() != ".dict")
+			continue;
+		std::string name = (file.path().parent_path() / file.path().stem()).string();
+		if (std::filesystem::path(name) != std::filesystem::path(paperDictionary))
+			dictionaryNames.push_back(name);
+	}
+	std::sort(dictionaryNames.begin() + 1, dictionaryNames.end());
+}
+
+void SceneGlint::bindDictionary()
+{
+	// The EXR set parameters, packed dictionaries replace them by the values of their header
+	int numberOfLevels = 16;
+	int numberOfDistributionsPerChannel = 64;
+	float dictionaryAlpha = 0.5f;
+
+	DictionaryStreamer& dictionary = dictionaries.acquire(dictionaryNames[dictionaryIndex], numberOfLevels,
+		numberOfDistributionsPerChannel, dictionaryAlpha, dictionaryLevelPriority(numberOfLevels));
+
+	// Levels used by the current view first
+	if (!dictionary.isResident())
+		dictionary.setLevelPriority(dictionaryLevelPriority(dictionary.levelCount()));
+	dictionaryResident = dictionary.isResident();
+	dictionaryFailed = dictionary.hasFailed();
+	residentLevels = int(dictionary.residentLevels());
+	if (dictionary.hasFailed() && !dictionaryErrorReported) {
+		std::cerr << "Dictionary loading failed, rendering the Beckmann lobe" << std::endl;
+		dictionaryErrorReported = true;
+	}
+
+	// Attributes of the cells of the coarse levels, baked for the material, on the unit 9
+	if (bakedCells)
+		cells.update(int(dictionary.levelCount()), dictionary.distributionsPerChannel() * 3, logMicrofacetDensity, microfacetRelativeArea);
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, cells.texture());
+
+	// Shards on the units 0 then 3 to 5, the buffer textures on the units 1 and 2, the atlas and the texel buffer on the units 6 and 7,
+	// the inverse CDF tables on the unit 8
+	for (int shard = 0; shard < DictionaryStreamer::MaxShards; ++shard) {
+		glActiveTexture(GL_TEXTURE0 + dictionaryShardUnit(shard));
+		glBindTexture(GL_TEXTURE_1D_ARRAY, dictionary.texture(shard));
+	}
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, dictionary.scaleOffsetTexture());
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, dictionary.supportTexture());
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_2D, dictionary.atlasTexture());
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_BUFFER, dictionary.texelBufferTexture());
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, dictionary.inverseCDFTexture());
+	glActiveTexture(GL_TEXTURE0);
+	// The storage block of the shader uses the binding point 0
+	if (dictionary.storageBuffer())
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, dictionary.storageBuffer());
+
+	prog->setUniform("Dictionary.Alpha", dictionary.alpha());
+	prog->setUniform("Dictionary.N", dictionary.distributionsPerChannel() * 3);
+	prog->setUniform("Dictionary.NLevels", int(dictionary.levelCount()));
+	prog->setUniform("Dictionary.Pyramid0Size", 1 << (dictionary.levelCount() - 1));
+	prog->setUniform("Dictionary.ResidentLevels", residentLevels);
+	prog->setUniform("Dictionary.Quantized", dictionary.isQuantized());
+	prog->setUniform("Dictionary.ShardLayers", int(std::max(dictionary.layersPerShard(), 1u)));
+	prog->setUniform("Dictionary.Layout", int(dictionary.storageLayout()));
+	prog->setUniform("Dictionary.Width", dictionary.rowWidth());
+	prog->setUniform("Dictionary.AtlasColumns", dictionary.atlasColumns());
+	prog->setUniform("GlintCellLevel", bakedCells ? cells.firstLevel() : int(dictionary.levelCount()));
 }
 
 void SceneGlint::render()
@@ -110,8 +340,11 @@ void SceneGlint::render()
 	ImGui::Render();
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	prog.setUniform("Light.Position", lightPos);
-	drawScene();
+	prog->setUniform("Light.Position", lightPos);
+	if (stochasticCells > 0)
+		drawStochastic(historyChanged());
+	else
+		drawScene();
 
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -121,27 +354,56 @@ void SceneGlint::resize(int w, int h)
 	glViewport(0, 0, w, h);
 	width = w;
 	height = h;
-	prog.setUniform("Resolution", glm::ivec2(width, height));
+	prog->setUniform("Resolution", glm::ivec2(width, height));
 	projection = glm::perspective(glm::radians(60.0f), (float)w / h, 0.3f, 100.0f);
+	history.resize(w, h);
+}
+
+bool SceneGlint::historyChanged()
+{
+	std::vector<float> state(&view[0][0], &view[0][0] + 16);
+	state.insert(state.end(), &projection[0][0], &projection[0][0] + 16);
+	state.insert(state.end(), {
+		objectOrientation, lightPos.x, lightPos.y, lightPos.z, alpha_x, alpha_y, logMicrofacetDensity,
+		microfacetRelativeArea, maxAnisotropy, float(cellBudget), lodBias, lodBlendCutoff, float(cellRotation),
+		float(stochasticCells), float(dictionaryIndex), float(residentLevels) });
+	bool changed = state != historyState;
+	historyState.swap(state);
+	return changed;
+}
+
+void SceneGlint::drawStochastic(bool reset)
+{
+	// New random numbers each frame
+	prog->setUniform("FrameIndex", frameIndex++);
+	history.begin(reset);
+	drawScene();
+	history.end();
 }
 
 void SceneGlint::setMatrices()
 {
 	glm::mat4 mv = view * model;
-	prog.setUniform("ModelMatrix", model);
-	prog.setUniform("MVP", projection * mv);
+	prog->setUniform("ModelMatrix", model);
+	prog->setUniform("MVP", projection * mv);
 }
 
-void SceneGlint::compileAndLinkShader() {
+void SceneGlint::compileAndLinkShader(GLSLProgram& program, unsigned int key) {
 	try {
-		prog.compileShader( (SHADER_PATH+std::string("glint.vert.glsl")).c_str() );
-		prog.compileShader( (SHADER_PATH+std::string("glint.frag.glsl")).c_str() );
+		// The features of the key, fixed at compile time
+		for (int bit = 0; bit < GlintPermutation::Count; ++bit)
+			if (key & (1u << bit))
+				program.addDefine(GlintPermutation::macro(bit));
+
+		program.compileShader( (SHADER_PATH+std::string("glint.vert.glsl")).c_str() );
+		// The functions of the cells shared with glintcells.frag.glsl
+		program.addInclude( (SHADER_PATH+std::string("glintcommon.glsl")).c_str() );
+		program.compileShader( (SHADER_PATH+std::string("glint.frag.glsl")).c_str() );
 
-		// prog.compileShader("shader/glint.vert.glsl");
-		// prog.compileShader("shader/glint.frag.glsl");
+		// program.compileShader("shader/glint.vert.glsl");
+		// program.compileShader("shader/glint.frag.glsl");
 
-		prog.link();
-		prog.use();
+		program.link();
 	}
 	catch (GLSLProgramException& e) {
 		std::cerr << e.what() << std::endl;
@@ -149,6 +411,46 @@ void SceneGlint::compileAndLinkShader() {
 	}
 }
 
+int SceneGlint::dictionaryShardUnit(int shard)
+{
+	return shard == 0 ? 0 : 2 + shard;
+}
+
+std::vector<int> SceneGlint::dictionaryLevelPriority(unsigned int nlevels) const
+{
+	// Footprint of a pixel at the point of the unit sphere closest to the camera, in texture space.
+	// u covers the 2 pi circumference of the sphere.
+	float distance = glm::max(glm::length(camera.Position) - 1.f, 1e-3f);
+	float pixelSize = 2.f * distance / (projection[1][1] * height);
+	float minorLength = pixelSize / glm::two_pi<float>();
+
+	// LOD of the pyramid, Alg. 1, line 6
+	float l = glm::max(0.f, float(nlevels) - 1.f + std::log2(minorLength) + lodBias);
+	int il = int(std::floor(l));
+	float w = l - float(il);
+
+	// Histogram of the dictionary levels l_dist sampled by P22_theta_alpha for the pyramid levels il and il + 1.
+	// l_dist is normally distributed around log(n) / log(4), with a standard deviation of 2 (Alg. 3, lines 5 to 9)
+	const float densityRandomisation = 2.f;
+	std::vector<float> histogram(nlevels, 0.f);
+	for (int k = 0; k < 2; ++k) {
+		float weight = k == 0 ? 1.f - w : w;
+		float mean = float(il + k) - float(nlevels - 1) + logMicrofacetDensity / 1.38629f;
+		for (int d = 0; d < int(nlevels); ++d) {
+			float lo = d == 0 ? -1e30f : (d - 0.5f - mean) / densityRandomisation;
+			float hi = (d + 0.5f - mean) / densityRandomisation;
+			histogram[d] += weight * 0.5f * (std::erf(hi * 0.707106f) - std::erf(lo * 0.707106f));
+		}
+	}
+
+	std::vector<int> levels;
+	for (int d = 0; d < int(nlevels); ++d)
+		if (histogram[d] > 1e-3f)
+			levels.push_back(d);
+	std::stable_sort(levels.begin(), levels.end(), [&](int a, int b) { return histogram[a] > histogram[b]; });
+	return levels;
+}
+
 void SceneGlint::drawScene() {
 
 	glm::vec3 color(1., 1., 1.);
@@ -156,12 +458,12 @@ void SceneGlint::drawScene() {
 	glm::vec3 scale(1., 1., 1.);
 
 	model = glm::mat4(1.0f);
-	prog.setUniform("Material.Alpha_x", alpha_x);
-	prog.setUniform("Material.Alpha_y", alpha_y);
+	prog->setUniform("Material.Alpha_x", alpha_x);
+	prog->setUniform("Material.Alpha_y", alpha_y);
 	model = glm::rotate(model, glm::radians(180.0f) + objectOrientation, glm::vec3(0.0f, 1.0f, 0.0f));
 	model = glm::scale(model, glm::vec3(scale.x, scale.y, scale.z));
 
 	setMatrices();
 
-	sphere.Draw(prog);
+	sphere.Draw(*prog);
 }
\ No newline at end of file
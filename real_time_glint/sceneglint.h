@@ -6,18 +6,43 @@
 
 #include "model.h"
 #include "camera.h"
+#include "dictionarymanager.h"
+#include "glintcelltexture.h"
+#include "glinthistory.h"
+#include "glintpermutation.h"
+#include "glintquality.h"
 
 #include <glm/glm.hpp>
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 class SceneGlint : public Scene {
-private:
-    GLSLProgram prog;
+protected:
+    std::map<unsigned int, std::unique_ptr<GLSLProgram>> programs; // Variants of glint.frag.glsl compiled so far, by permutation key
+    GLSLProgram* prog;       // Variant of the current material (see useProgram)
+    unsigned int programKey;
 
     Model sphere;
     Camera camera;
+    DictionaryManager dictionaries;
+    std::vector<std::string> dictionaryNames; // Dictionaries found in media/dictionary, the material uses one of them
+    int dictionaryIndex;
+    bool dictionaryErrorReported;
+    bool dictionaryResident; // The dictionary bound by the last bindDictionary is resident
+    bool dictionaryFailed;   // Its loading failed, the Beckmann lobe is rendered
+    GlintCellTexture cells;
+    bool bakedCells;         // The shader fetches the baked cells instead of hashing them
+    int residentLevels;      // Bit l is set once the level l is resident, see Dictionary.ResidentLevels
+    GlintHistory history;
+    std::vector<float> historyState; // Setup of the frames averaged by history (see historyChanged)
+    int frameIndex;
 	
 	glm::vec4 lightPos;
     float objectOrientation;
+    bool rotateObject;
 
     float tPrev;
 
@@ -26,9 +51,35 @@ private:
     float logMicrofacetDensity;
     float microfacetRelativeArea;
     float maxAnisotropy;
+    int cellBudget;          // Cells of the EWA filter evaluated per LOD, 0 for no budget
+    float lodBias;
+    float lodBlendCutoff;    // Blend weight up to which a LOD is skipped
+    bool fusedLevels;        // The two LODs of a pixel are scanned together (see P22__P_levels in glint.frag.glsl)
+    bool cellRotation;       // The distributions of the cells are rotated
+    bool specialisedShader;  // The variant is specialised for the material, generic otherwise (see GlintPermutation)
+    int stochasticCells;     // Cells evaluated per pixel and frame by the stochastic variant, 0 for all the cells
 
     void setMatrices();
-    void compileAndLinkShader();
+    // Set the cell budget, the maximum anisotropy and the LOD bias of a quality preset
+    void applyQuality(GlintQuality preset);
+    // Dictionary levels sampled by the current view, most used first
+    std::vector<int> dictionaryLevelPriority(unsigned int nlevels) const;
+    // Permutation key of the variant of the current material
+    unsigned int permutationKey() const;
+    // Use the variant of key, compiled at its first use, and set its uniforms constant over the frames
+    void useProgram(unsigned int key);
+    // Uniforms of the camera and of the material set each frame, after bindDictionary
+    void setUniforms();
+    void compileAndLinkShader(GLSLProgram& program, unsigned int key);
+    void findDictionaries();
+    // Acquire the dictionary of the material, and bind it
+    void bindDictionary();
+    // Texture unit of a shard of the dictionary
+    static int dictionaryShardUnit(int shard);
+    // The frame differs from the ones averaged by history: view, light, material or resident levels
+    bool historyChanged();
+    // Draw the scene with the stochastic variant, averaged by history over the frames since the last reset
+    void drawStochastic(bool reset);
 
 	void drawScene();
 public:
@@ -0,0 +1,168 @@
+#include "sceneglintbenchmark.h"
+
+#include <iomanip>
+#include <iostream>
+
+SceneGlintBenchmark::SceneGlintBenchmark() :
+	phase(Phase::Loading),
+	layoutIndex(0),
+	scanIndex(0),
+	phaseFrames(0),
+	currentQuery(0)
+{
+	for (int k = 0; k < DictionaryLayouts::Count; ++k) {
+		for (int scan = 0; scan < Scans; ++scan) {
+			gpuNanoseconds[k][scan] = 0;
+			gpuFrames[k][scan] = 0;
+		}
+		layoutFailed[k] = false;
+	}
+	for (int slot = 0; slot < QuerySlots; ++slot)
+		queries[slot] = { 0, -1, 0, false };
+	dictionaries.setStorageLayout(static_cast<DictionaryLayout>(layoutIndex));
+	applyScan(scanIndex);
+}
+
+SceneGlintBenchmark::~SceneGlintBenchmark()
+{
+	for (int slot = 0; slot < QuerySlots; ++slot)
+		if (queries[slot].query)
+			glDeleteQueries(1, &queries[slot].query);
+}
+
+void SceneGlintBenchmark::initScene()
+{
+	SceneGlint::initScene();
+	for (int slot = 0; slot < QuerySlots; ++slot)
+		glGenQueries(1, &queries[slot].query);
+	std::cout << "Dictionary storage benchmark: " << WarmupFrames << " warmup frames and " << MeasuredFrames
+		<< " measured frames per layout and LOD scan" << std::endl;
+}
+
+void SceneGlintBenchmark::update(float t, GLFWwindow* window)
+{
+	SceneGlint::update(t, window);
+
+	switch (phase) {
+	case Phase::Loading:
+		// Layouts unsupported by the GL fail at the allocation of the storage
+		if (dictionaryFailed) {
+			layoutFailed[layoutIndex] = true;
+			nextLayout();
+		}
+		else if (dictionaryResident) {
+			phase = Phase::Warmup;
+			phaseFrames = 0;
+		}
+		break;
+	case Phase::Warmup:
+		if (++phaseFrames >= WarmupFrames) {
+			phase = Phase::Measure;
+			phaseFrames = 0;
+		}
+		break;
+	case Phase::Measure:
+		if (phaseFrames >= MeasuredFrames)
+			nextScan();
+		break;
+	case Phase::Done:
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+		break;
+	}
+}
+
+void SceneGlintBenchmark::render()
+{
+	if (phase == Phase::Done) {
+		SceneGlint::render();
+		return;
+	}
+
+	// The result of a query is read QuerySlots frames later, the GPU has completed the frame by then
+	TimerQuery& timer = queries[currentQuery];
+	collect(timer);
+	glBeginQuery(GL_TIME_ELAPSED, timer.query);
+	SceneGlint::render();
+	glEndQuery(GL_TIME_ELAPSED);
+	timer.layout = layoutIndex;
+	timer.scan = scanIndex;
+	timer.measured = phase == Phase::Measure;
+	if (timer.measured)
+		++phaseFrames;
+	currentQuery = (currentQuery + 1) % QuerySlots;
+}
+
+void SceneGlintBenchmark::collect(TimerQuery& timer)
+{
+	if (timer.layout < 0)
+		return;
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(timer.query, GL_QUERY_RESULT, &nanoseconds);
+	if (timer.measured) {
+		gpuNanoseconds[timer.layout][timer.scan] += nanoseconds;
+		++gpuFrames[timer.layout][timer.scan];
+	}
+	timer.layout = -1;
+}
+
+void SceneGlintBenchmark::applyScan(int scan)
+{
+	lodBlendCutoff = scan == 0 ? 0.f : 0.02f;
+	fusedLevels = scan == 2;
+	stochasticCells = scan == 3 ? 1 : 0;
+}
+
+void SceneGlintBenchmark::nextScan()
+{
+	if (++scanIndex < Scans) {
+		applyScan(scanIndex);
+		phase = Phase::Warmup;
+		phaseFrames = 0;
+		return;
+	}
+	scanIndex = 0;
+	applyScan(scanIndex);
+	nextLayout();
+}
+
+void SceneGlintBenchmark::nextLayout()
+{
+	if (!layoutFailed[layoutIndex])
+		std::cout << DictionaryLayouts::name(static_cast<DictionaryLayout>(layoutIndex)) << " measured" << std::endl;
+	if (++layoutIndex < DictionaryLayouts::Count) {
+		// The loaded dictionaries are released, and streamed again in the new layout
+		dictionaries.setStorageLayout(static_cast<DictionaryLayout>(layoutIndex));
+		dictionaryErrorReported = false;
+		phase = Phase::Loading;
+		phaseFrames = 0;
+		return;
+	}
+
+	for (int slot = 0; slot < QuerySlots; ++slot)
+		collect(queries[slot]);
+	report();
+	phase = Phase::Done;
+}
+
+void SceneGlintBenchmark::report() const
+{
+	std::cout << "Dictionary storage layout, GPU ms/frame of the LOD scans (" << width << "x" << height << ")" << std::endl;
+	for (int k = 0; k < DictionaryLayouts::Count; ++k) {
+		std::cout << "  " << std::setw(6) << std::left << DictionaryLayouts::name(static_cast<DictionaryLayout>(k)) << std::right;
+		if (layoutFailed[k] || gpuFrames[k][0] == 0 || gpuFrames[k][1] == 0 || gpuFrames[k][2] == 0 || gpuFrames[k][3] == 0) {
+			std::cout << "  unsupported" << std::endl;
+			continue;
+		}
+		double twoScans = gpuNanoseconds[k][0] / 1e6 / gpuFrames[k][0];
+		double skip = gpuNanoseconds[k][1] / 1e6 / gpuFrames[k][1];
+		double fused = gpuNanoseconds[k][2] / 1e6 / gpuFrames[k][2];
+		double stochastic = gpuNanoseconds[k][3] / 1e6 / gpuFrames[k][3];
+		std::cout << std::fixed << std::setprecision(3) << std::setw(9) << twoScans << " two scans, "
+			<< std::setw(9) << skip << " LOD skip (" << std::setprecision(1)
+			<< 100. * (twoScans - skip) / twoScans << "% saved), " << std::setprecision(3)
+			<< std::setw(9) << fused << " fused (" << std::setprecision(1)
+			<< 100. * (twoScans - fused) / twoScans << "% saved), " << std::setprecision(3)
+			<< std::setw(9) << stochastic << " stochastic (" << std::setprecision(1)
+			<< 100. * (twoScans - stochastic) / twoScans << "% saved)" << std::endl;
+	}
+}
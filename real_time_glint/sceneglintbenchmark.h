@@ -0,0 +1,54 @@
+#pragma once
+
+#include "sceneglint.h"
+
+#include <cstdint>
+
+// The glint scene rendered with each storage layout of the dictionary (see DictionaryLayout) in turn.
+// Each layout is streamed, then measured with each LOD scan of f_P: two scans with no LOD skipped, two scans with the
+// LOD of negligible weight skipped (lodBlendCutoff), the fused scan (fusedLevels), and the stochastic variant with one
+// cell per pixel and frame (stochasticCells, its history included). Each is warmed up, then the GPU
+// time of the frames is measured with timer queries. The average ms/frame of each layout and scan is printed, then
+// the window closes.
+class SceneGlintBenchmark : public SceneGlint {
+private:
+    static const int WarmupFrames = 30;
+    static const int MeasuredFrames = 200;
+    static const int QuerySlots = 4;
+    static const int Scans = 4; // Two scans, two scans with the LOD skip, fused scan with the LOD skip, stochastic
+
+    enum class Phase { Loading, Warmup, Measure, Done };
+
+    struct TimerQuery {
+        GLuint query;
+        int layout;    // Layout of the frame, -1 when the slot is free
+        int scan;
+        bool measured; // Issued during the measure of the layout
+    };
+
+    Phase phase;
+    int layoutIndex;
+    int scanIndex;
+    int phaseFrames;
+    TimerQuery queries[QuerySlots];
+    int currentQuery;
+    uint64_t gpuNanoseconds[DictionaryLayouts::Count][Scans];
+    int gpuFrames[DictionaryLayouts::Count][Scans];
+    bool layoutFailed[DictionaryLayouts::Count];
+
+    // Wait for the result of a query slot, and account it
+    void collect(TimerQuery& timer);
+    // Set the LOD blend cutoff, the fused scan and the stochastic cells of a scan
+    void applyScan(int scan);
+    void nextScan();
+    void nextLayout();
+    void report() const;
+
+public:
+    SceneGlintBenchmark();
+    ~SceneGlintBenchmark();
+
+    void initScene();
+    void update(float t, GLFWwindow* window);
+    void render();
+};
@@ -0,0 +1,403 @@
+#include "sceneglintcheck.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+const SceneGlintCheck::CheckView SceneGlintCheck::views[] = {
+	// name, orientation, camera distance, alpha_x, alpha_y, log microfacet density, microfacet relative area, quality
+	{ "default", 0.f, 2.2f, 0.5f, 0.5f, 27.f, 1.f, GlintQuality::High },
+	{ "turned", 1.3f, 2.2f, 0.5f, 0.5f, 27.f, 1.f, GlintQuality::High },
+	{ "anisotropic", 0.4f, 2.2f, 0.3f, 0.7f, 27.f, 1.f, GlintQuality::High },
+	{ "sparse", 2.5f, 2.2f, 0.5f, 0.5f, 20.f, 0.3f, GlintQuality::High },
+	{ "close", 0.8f, 1.6f, 0.2f, 0.2f, 30.f, 1.f, GlintQuality::High },
+	{ "low quality", 0.4f, 2.2f, 0.3f, 0.7f, 27.f, 1.f, GlintQuality::Low }
+};
+const int SceneGlintCheck::ViewCount = int(sizeof(views) / sizeof(views[0]));
+
+SceneGlintCheck::SceneGlintCheck() :
+	phase(Phase::Loading),
+	viewIndex(0),
+	failed(false),
+	maxError(0.02f),
+	maxOutliers(0.01f),
+	maxCoverage(0.001f),
+	framebuffer(0),
+	colorTexture(0),
+	depthRenderbuffer(0),
+	timerQuery(0),
+	cpuBRDF(&cpuDictionary),
+	rasterizer(sphere.getMeshes())
+{
+	if (const char* error = getenv("GLINT_CHECK_MAX_ERROR"))
+		maxError = float(std::atof(error));
+	if (const char* outliers = getenv("GLINT_CHECK_MAX_OUTLIERS"))
+		maxOutliers = float(std::atof(outliers));
+	if (const char* coverage = getenv("GLINT_CHECK_MAX_COVERAGE"))
+		maxCoverage = float(std::atof(coverage));
+}
+
+SceneGlintCheck::~SceneGlintCheck()
+{
+	releaseFramebuffer();
+	if (timerQuery)
+		glDeleteQueries(1, &timerQuery);
+}
+
+void SceneGlintCheck::initScene()
+{
+	SceneGlint::initScene();
+	glGenQueries(1, &timerQuery);
+
+	// The dictionary of the material, with the parameters of SceneGlint::bindDictionary
+	if (!cpuDictionary.load(dictionaryNames[dictionaryIndex], 16, 64, 0.5f)) {
+		std::cerr << "Unable to load the dictionary " << dictionaryNames[dictionaryIndex] << " on the CPU" << std::endl;
+		failed = true;
+		phase = Phase::Done;
+		return;
+	}
+	// sample_P22 and pdf_P22 are in no variant of the materials: the check compiles them
+	GLSLProgram sampling;
+	try {
+		sampling.addDefine("GLINT_SAMPLING");
+		sampling.compileShader((SHADER_PATH + std::string("glint.vert.glsl")).c_str());
+		sampling.addInclude((SHADER_PATH + std::string("glintcommon.glsl")).c_str());
+		sampling.compileShader((SHADER_PATH + std::string("glint.frag.glsl")).c_str());
+		sampling.link();
+	}
+	catch (GLSLProgramException& e) {
+		std::cerr << "The GLINT_SAMPLING variant does not compile: " << e.what() << std::endl;
+		failed = true;
+	}
+
+	std::cout << "Glint consistency check, GPU against CPU (" << GlintISAs::name(GlintISAs::best()) << " kernel): "
+		<< ViewCount << " views, max relative error " << maxError << ", max outliers " << maxOutliers << ", max coverage " << maxCoverage << std::endl;
+}
+
+void SceneGlintCheck::update(float t, GLFWwindow* window)
+{
+	if (phase != Phase::Done)
+		applyView(views[viewIndex]);
+	SceneGlint::update(t, window);
+	// Instead of the animation of SceneGlint::update
+	if (phase != Phase::Done)
+		objectOrientation = views[viewIndex].objectOrientation;
+
+	switch (phase) {
+	case Phase::Loading:
+		if (dictionaryFailed) {
+			std::cerr << "Dictionary loading failed on the GPU" << std::endl;
+			failed = true;
+			phase = Phase::Done;
+		}
+		else if (dictionaryResident)
+			phase = Phase::Check;
+		break;
+	case Phase::Check:
+		break;
+	case Phase::Done:
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+		break;
+	}
+}
+
+void SceneGlintCheck::render()
+{
+	if (phase == Phase::Check)
+		checkView();
+	SceneGlint::render();
+}
+
+void SceneGlintCheck::resize(int w, int h)
+{
+	SceneGlint::resize(w, h);
+
+	// Float color buffer: the radiance is compared before the 8 bit quantization of the window
+	releaseFramebuffer();
+	glGenTextures(1, &colorTexture);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Incomplete float framebuffer" << std::endl;
+		failed = true;
+		phase = Phase::Done;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+int SceneGlintCheck::exitStatus() const
+{
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void SceneGlintCheck::applyView(const CheckView& checkView)
+{
+	camera.Position = glm::vec3(0.f, 0.f, checkView.cameraDistance);
+	alpha_x = checkView.alpha_x;
+	alpha_y = checkView.alpha_y;
+	logMicrofacetDensity = checkView.logMicrofacetDensity;
+	microfacetRelativeArea = checkView.microfacetRelativeArea;
+	applyQuality(checkView.quality);
+}
+
+GlintView SceneGlintCheck::glintView() const
+{
+	GlintView glintView;
+	glintView.width = width;
+	glintView.height = height;
+	glintView.cameraPosition = camera.Position;
+	glintView.cameraYaw = camera.Yaw;
+	glintView.cameraPitch = camera.Pitch;
+	glintView.objectOrientation = objectOrientation;
+	glintView.lightPosition = lightPos;
+	glintView.alpha_x = alpha_x;
+	glintView.alpha_y = alpha_y;
+	glintView.logMicrofacetDensity = logMicrofacetDensity;
+	glintView.microfacetRelativeArea = microfacetRelativeArea;
+	glintView.maxAnisotropy = maxAnisotropy;
+	glintView.cellRotation = cellRotation;
+	glintView.lodBlendCutoff = lodBlendCutoff;
+	glintView.cellBudget = cellBudget;
+	glintView.lodBias = lodBias;
+	return glintView;
+}
+
+GlintImage SceneGlintCheck::renderGPU(double& gpuMilliseconds, double& wallMilliseconds)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	prog->setUniform("Light.Position", lightPos);
+	GLuint64 total = 0;
+	double wallSeconds = 0.;
+	for (int frame = 0; frame < WarmupFrames + MeasuredFrames; ++frame) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		bool measured = frame >= WarmupFrames;
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		if (measured)
+			glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+		drawScene();
+		if (measured) {
+			// Waits for the frame: the frames are timed one by one
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &nanoseconds);
+			glFinish();
+			total += nanoseconds;
+			wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+	// Software renderers such as llvmpipe may report null elapsed times, the wall time of the finished frames is used instead
+	gpuMilliseconds = double(total) / 1e6 / MeasuredFrames;
+	wallMilliseconds = wallSeconds * 1e3 / MeasuredFrames;
+
+	std::vector<float> rgba(size_t(width) * height * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, rgba.data());
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Bottom row first, and the gamma of the shader: back to the linear radiance, top row first
+	GlintImage image(width, height);
+	for (int y = 0; y < height; ++y) {
+		const float* row = &rgba[size_t(height - 1 - y) * width * 4];
+		for (int x = 0; x < width; ++x)
+			for (int c = 0; c < 3; ++c)
+				image.pixel(x, y)[c] = std::pow(std::max(row[x * 4 + c], 0.f), 2.2f);
+	}
+	return image;
+}
+
+GlintImage SceneGlintCheck::renderStochastic(double& wallMilliseconds)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	prog->setUniform("Light.Position", lightPos);
+	double wallSeconds = 0.;
+	for (int frame = 0; frame < StochasticFrames; ++frame) {
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		drawStochastic(frame == 0);
+		glFinish();
+		wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	wallMilliseconds = wallSeconds * 1e3 / StochasticFrames;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Bottom row first: back to top row first, the history holds the linear radiance
+	GlintImage image(width, height);
+	if (!history.isValid())
+		return image;
+	std::vector<float> rgba(size_t(width) * height * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, history.texture());
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, rgba.data());
+	for (int y = 0; y < height; ++y) {
+		const float* row = &rgba[size_t(height - 1 - y) * width * 4];
+		for (int x = 0; x < width; ++x)
+			for (int c = 0; c < 3; ++c)
+				image.pixel(x, y)[c] = row[x * 4 + c];
+	}
+	return image;
+}
+
+double SceneGlintCheck::bias(const GlintImage& gpu, const GlintImage& cpu)
+{
+	double gpuSum = 0., cpuSum = 0.;
+	for (size_t k = 0; k < cpu.rgb.size(); ++k) {
+		gpuSum += gpu.rgb[k];
+		cpuSum += cpu.rgb[k];
+	}
+	return cpuSum > 0. ? std::abs(gpuSum - cpuSum) / cpuSum : 0.;
+}
+
+SceneGlintCheck::ErrorStatistics SceneGlintCheck::compare(const GlintImage& gpu, const GlintImage& cpu)
+{
+	ErrorStatistics statistics = { 0., 0., 0., 0., 0., 0, 0 };
+	double sumAbsolute = 0., sumSquared = 0., sumRadiance = 0.;
+	size_t covered = 0, outliers = 0;
+	for (int y = 0; y < cpu.height; ++y) {
+		for (int x = 0; x < cpu.width; ++x) {
+			const float* g = gpu.pixel(x, y);
+			const float* c = cpu.pixel(x, y);
+			bool gpuCovered = g[0] > 0.f || g[1] > 0.f || g[2] > 0.f;
+			bool cpuCovered = c[0] > 0.f || c[1] > 0.f || c[2] > 0.f;
+			if (!gpuCovered && !cpuCovered)
+				continue;
+			if (gpuCovered != cpuCovered)
+				++statistics.coverage;
+			++covered;
+			bool outlier = false;
+			for (int k = 0; k < 3; ++k) {
+				double error = std::abs(double(g[k]) - double(c[k]));
+				sumAbsolute += error;
+				sumSquared += error * error;
+				sumRadiance += c[k];
+				statistics.maxAbsolute = std::max(statistics.maxAbsolute, error);
+				outlier = outlier || error > 0.1 * c[k] + 0.01;
+			}
+			if (outlier)
+				++outliers;
+		}
+	}
+	statistics.covered = int(covered);
+	if (covered == 0)
+		return statistics;
+	statistics.meanAbsolute = sumAbsolute / double(3 * covered);
+	statistics.rootMeanSquare = std::sqrt(sumSquared / double(3 * covered));
+	statistics.relative = sumRadiance > 0. ? sumAbsolute / sumRadiance : 0.;
+	statistics.outliers = double(outliers) / double(covered);
+	return statistics;
+}
+
+void SceneGlintCheck::checkView()
+{
+	const CheckView& checkView = views[viewIndex];
+	// Hashed cells, then baked cells (see GlintCellTexture): the baked cells must not change a bit of the image.
+	// Neither must the generic shader, instead of the variant specialised for the material (see GlintPermutation).
+	bool baked = bakedCells;
+	bool specialised = specialisedShader;
+	double gpuMilliseconds = 0., wallMilliseconds = 0., bakedGPUMilliseconds = 0., bakedWallMilliseconds = 0.;
+	double genericGPUMilliseconds = 0., genericWallMilliseconds = 0., stochasticWallMilliseconds = 0.;
+	bakedCells = false;
+	bindDictionary();
+	GlintImage gpu = renderGPU(gpuMilliseconds, wallMilliseconds);
+	bakedCells = true;
+	bindDictionary();
+	GlintImage bakedGPU = renderGPU(bakedGPUMilliseconds, bakedWallMilliseconds);
+	specialisedShader = false;
+	bakedCells = false;
+	useProgram(permutationKey());
+	bindDictionary();
+	setUniforms();
+	GlintImage genericGPU = renderGPU(genericGPUMilliseconds, genericWallMilliseconds);
+	specialisedShader = specialised;
+	bakedCells = baked;
+	int cells = stochasticCells;
+	stochasticCells = StochasticCells;
+	useProgram(permutationKey());
+	bindDictionary();
+	setUniforms();
+	GlintImage stochasticGPU = renderStochastic(stochasticWallMilliseconds);
+	stochasticCells = cells;
+	useProgram(permutationKey());
+	bindDictionary();
+	setUniforms();
+	int bakedDifferences = countDifferences(gpu, bakedGPU);
+	int genericDifferences = countDifferences(gpu, genericGPU);
+
+	GlintImage cpu = rasterizer.render(glintView(), cpuBRDF);
+	const GlintRasterizer::Timings& timings = rasterizer.timings();
+	ErrorStatistics statistics = compare(gpu, cpu);
+	ErrorStatistics stochasticStatistics = compare(stochasticGPU, cpu);
+	double stochasticBias = bias(stochasticGPU, cpu);
+	bool passed = statistics.relative <= maxError && statistics.outliers <= maxOutliers
+		&& statistics.coverage <= maxCoverage * statistics.covered && bakedDifferences == 0
+		&& genericDifferences == 0 && stochasticBias <= maxError;
+
+	if (viewIndex == 0)
+		std::cout << std::setw(12) << "view" << std::setw(11) << "GPU ms" << std::setw(11) << "frame ms"
+			<< std::setw(11) << "baked GPU" << std::setw(13) << "baked frame" << std::setw(13) << "generic GPU"
+			<< std::setw(15) << "generic frame" << std::setw(11) << "CPU ms"
+			<< std::setw(12) << "mean abs" << std::setw(12) << "rmse" << std::setw(12) << "max abs"
+			<< std::setw(11) << "relative" << std::setw(11) << "outliers" << std::setw(10) << "coverage"
+			<< std::setw(12) << "baked diff" << std::setw(14) << "generic diff" << std::setw(14) << "stoch. frame"
+			<< std::setw(13) << "stoch. bias" << std::setw(14) << "stoch. noise" << std::endl;
+	std::cout << std::setw(12) << checkView.name << std::fixed << std::setprecision(3)
+		<< std::setw(11) << gpuMilliseconds << std::setw(11) << wallMilliseconds
+		<< std::setw(11) << bakedGPUMilliseconds << std::setw(13) << bakedWallMilliseconds
+		<< std::setw(13) << genericGPUMilliseconds << std::setw(15) << genericWallMilliseconds
+		<< std::setw(11) << (timings.setup + timings.shading) * 1e3
+		<< std::scientific << std::setprecision(3) << std::setw(12) << statistics.meanAbsolute
+		<< std::setw(12) << statistics.rootMeanSquare << std::setw(12) << statistics.maxAbsolute
+		<< std::fixed << std::setprecision(2) << std::setw(10) << statistics.relative * 100. << "%"
+		<< std::setw(10) << statistics.outliers * 100. << "%" << std::setw(10) << statistics.coverage
+		<< std::setw(12) << bakedDifferences << std::setw(14) << genericDifferences
+		<< std::setw(14) << stochasticWallMilliseconds << std::setw(12) << stochasticBias * 100. << "%"
+		<< std::setw(13) << stochasticStatistics.relative * 100. << "%" << (passed ? "" : "  FAILED")
+		<< std::defaultfloat << std::endl;
+
+	if (!passed) {
+		failed = true;
+		gpu.saveEXR(std::string("glintcheck_") + checkView.name + "_gpu.exr");
+		cpu.saveEXR(std::string("glintcheck_") + checkView.name + "_cpu.exr");
+		if (bakedDifferences > 0)
+			bakedGPU.saveEXR(std::string("glintcheck_") + checkView.name + "_baked.exr");
+		if (genericDifferences > 0)
+			genericGPU.saveEXR(std::string("glintcheck_") + checkView.name + "_generic.exr");
+		if (stochasticBias > maxError)
+			stochasticGPU.saveEXR(std::string("glintcheck_") + checkView.name + "_stochastic.exr");
+	}
+	if (++viewIndex == ViewCount) {
+		std::cout << (failed ? "Glint consistency check failed" : "Glint consistency check passed") << std::endl;
+		phase = Phase::Done;
+	}
+}
+
+int SceneGlintCheck::countDifferences(const GlintImage& a, const GlintImage& b)
+{
+	int differences = 0;
+	for (size_t k = 0; k < a.rgb.size(); k += 3)
+		if (a.rgb[k] != b.rgb[k] || a.rgb[k + 1] != b.rgb[k + 1] || a.rgb[k + 2] != b.rgb[k + 2])
+			++differences;
+	return differences;
+}
+
+void SceneGlintCheck::releaseFramebuffer()
+{
+	if (framebuffer)
+		glDeleteFramebuffers(1, &framebuffer);
+	if (colorTexture)
+		glDeleteTextures(1, &colorTexture);
+	if (depthRenderbuffer)
+		glDeleteRenderbuffers(1, &depthRenderbuffer);
+	framebuffer = colorTexture = depthRenderbuffer = 0;
+}
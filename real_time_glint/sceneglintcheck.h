@@ -0,0 +1,95 @@
+#pragma once
+
+#include "sceneglint.h"
+#include "glintrasterizer.h"
+
+// Consistency check of glint.frag.glsl against the renderer without GPU (see GlintRasterizer).
+// A fixed set of views is rendered off screen into a float framebuffer, in a hidden window, and rendered on the CPU
+// with the same dictionary. The error statistics of the linear radiance and the time of both renderers are printed
+// for each view. The exit status is 1 when a view exceeds the thresholds:
+//   GLINT_CHECK_MAX_ERROR     Mean absolute error relative to the mean radiance, 0.02 by default
+//   GLINT_CHECK_MAX_OUTLIERS  Fraction of the pixels of the sphere whose error exceeds 10% (+0.01), 0.01 by default
+//   GLINT_CHECK_MAX_COVERAGE  Fraction of the pixels of the sphere lit by one renderer only, 0.001 by default (a few
+//                             pixels of the silhouette, where the interpolated normal grazes, differ)
+// The GPU renders each view with hashed then baked cells (see GlintCellTexture), and with the generic shader instead of
+// the variant specialised for the material (see GlintPermutation), which must all give the same image.
+// The images of the failed views are written to glintcheck_<view>_gpu.exr and glintcheck_<view>_cpu.exr.
+// The frame times of the generic shader measure the gain of the specialisation.
+// The stochastic variant (see GlintHistory) is averaged over StochasticFrames frames of StochasticCells cells: the
+// radiance summed over the image must match the CPU within the max error (bias), its noise is printed.
+class SceneGlintCheck : public SceneGlint {
+private:
+    static const int WarmupFrames = 2;
+    static const int MeasuredFrames = 10;
+    static const int StochasticFrames = 16;
+    static const int StochasticCells = 1;
+
+    // Orientation of the sphere, distance of the camera and material of a view
+    struct CheckView {
+        const char* name;
+        float objectOrientation;
+        float cameraDistance;
+        float alpha_x;
+        float alpha_y;
+        float logMicrofacetDensity;
+        float microfacetRelativeArea;
+        GlintQuality quality;
+    };
+
+    struct ErrorStatistics {
+        double meanAbsolute;
+        double rootMeanSquare;
+        double maxAbsolute;
+        double relative;     // Mean absolute error over the mean radiance
+        double outliers;     // Fraction of the pixels of the sphere
+        int coverage;        // Pixels covered by one renderer only
+        int covered;         // Pixels covered by a renderer
+    };
+
+    enum class Phase { Loading, Check, Done };
+
+    Phase phase;
+    int viewIndex;
+    bool failed;
+    float maxError;
+    float maxOutliers;
+    float maxCoverage;
+
+    GLuint framebuffer;
+    GLuint colorTexture;
+    GLuint depthRenderbuffer;
+    GLuint timerQuery;
+
+    GlintDictionary cpuDictionary;
+    GlintBRDF cpuBRDF;
+    GlintRasterizer rasterizer;
+
+    static const CheckView views[];
+    static const int ViewCount;
+
+    void applyView(const CheckView& checkView);
+    GlintView glintView() const;
+    // Render the current view in the float framebuffer, returns the linear radiance. The times per frame are the
+    // GPU time of the timer queries, and the wall time of the finished frame (software renderers such as llvmpipe
+    // do not time their work).
+    GlintImage renderGPU(double& gpuMilliseconds, double& wallMilliseconds);
+    // Average StochasticFrames frames of the current view in the history, returns it. The time per frame is the wall time.
+    GlintImage renderStochastic(double& wallMilliseconds);
+    static ErrorStatistics compare(const GlintImage& gpu, const GlintImage& cpu);
+    // Difference of the radiance summed over the images, relative to the one of cpu
+    static double bias(const GlintImage& gpu, const GlintImage& cpu);
+    // Number of pixels that differ by a bit
+    static int countDifferences(const GlintImage& a, const GlintImage& b);
+    void checkView();
+    void releaseFramebuffer();
+
+public:
+    SceneGlintCheck();
+    ~SceneGlintCheck();
+
+    void initScene();
+    void update(float t, GLFWwindow* window);
+    void render();
+    void resize(int, int);
+    int exitStatus() const;
+};
@@ -1,4 +1,5 @@
 #version 410
+#extension GL_ARB_shader_storage_buffer_object : enable
 
 // The MIT License
 // Copyright © 2020 Xavier Chermain (ICUBE), Basile Sauvage (ICUBE), Jean-Michel Dishler (ICUBE) and Carsten Dachsbacher (KIT)
@@ -27,19 +28,59 @@ uniform struct MaterialInfo
     float LogMicrofacetDensity; // Logarithmic microfacet density
 } Material;
 
+// Permutations of the shader, defined by the application for the material before compiling (see GlintPermutation):
+//   GLINT_ISOTROPIC     Material.Alpha_y is Material.Alpha_x
+//   GLINT_FULL_AREA     MicrofacetRelativeArea is 1, no cell is discarded
+//   GLINT_NO_ROTATION   The distributions of the cells are not rotated
+//   GLINT_FUSED_LEVELS  The two LODs of f_P are evaluated in one scan of the cells (see P22__P_levels)
+//   GLINT_STOCHASTIC    f_P evaluates StochasticCells cells of one LOD (see P22__P_stochastic), and the linear
+//                       radiance is written for GlintHistory to average it over the frames
+// and, outside of the permutations of a material:
+//   GLINT_SAMPLING      sample_P22 and pdf_P22 are compiled (see Importance sampling of the P-SDF of a footprint)
+#ifdef GLINT_ISOTROPIC
+#define MATERIAL_ALPHA_Y Material.Alpha_x
+#else
+#define MATERIAL_ALPHA_Y Material.Alpha_y
+#endif
+
 uniform struct DictionaryInfo
 {
     float Alpha;      // Roughness of the dictionary (\alpha_{dist} in the paper)
     int N;            // Number of marginal distributions in the dictionary
     int NLevels;      // Number of LOD in the dictionary
     int Pyramid0Size; // Number of cells along one axis at LOD 0, for NLevels LODs, in a MIP hierarchy
+    int ResidentLevels; // Bit l is set once the level l is loaded, the Beckmann lobe replaces the other levels
+    bool Quantized;   // Normalized integer rows, rescaled with DictionaryScaleOffset
+    int ShardLayers;  // Number of layers of each shard of DictionaryTex
+    int Layout;       // Storage of the layers: 0 DictionaryTex, 1 DictionaryAtlas, 2 DictionaryTexels, 3 DictionaryTexelData (see DictionaryLayout)
+    int Width;        // Number of texels of a layer
+    int AtlasColumns; // Number of layers in a row of DictionaryAtlas
 } Dictionary;
 
 uniform vec3 CameraPosition;
 uniform float MicrofacetRelativeArea;
 uniform float MaxAnisotropy;
-
-uniform sampler1DArray DictionaryTex; // Array of 1D textures, containing the marginal distributions (the dictionary)
+uniform int CellBudget;       // Cells of the EWA filter evaluated per LOD, 0 for no budget (see GlintQuality)
+uniform float LodBias;        // Added to the LOD of the footprint
+uniform float LodBlendCutoff; // f_P skips the LOD whose blend weight is up to LodBlendCutoff
+uniform int StochasticCells;  // Cells evaluated per pixel by the stochastic variant
+uniform int FrameIndex;       // Seed of the random numbers of the stochastic variant
+
+const int MaxDictionaryShards = 4;
+uniform sampler1DArray DictionaryTex[MaxDictionaryShards]; // Arrays of 1D textures, containing the marginal distributions (the dictionary), split in shards of Dictionary.ShardLayers layers
+uniform samplerBuffer DictionaryScaleOffset; // Scales (texel 2 * layer) and offsets (texel 2 * layer + 1) of a quantized dictionary
+uniform samplerBuffer DictionarySupport; // Per distribution row: texel coordinates below x and above y are null, texel coordinate u is stored at u + w in layer z
+uniform sampler2D DictionaryAtlas; // The layers side by side, Dictionary.AtlasColumns layers per row
+uniform samplerBuffer DictionaryTexels; // The texels of the layers one after the other, filtered by dictionaryLookup
+uniform sampler2D DictionaryInverseCDF; // Per distribution row: inverse CDF of the 3 distributions (texel coordinates), then their integrals (see sample_P22)
+uniform usampler2D GlintCells; // Baked attributes of the cells of the levels GlintCellLevel and above, one level per mip (see glintcells.frag.glsl)
+uniform int GlintCellLevel;    // First baked level, Dictionary.NLevels when the cells are all hashed
+#ifdef GL_ARB_shader_storage_buffer_object
+layout(std430) buffer DictionaryStorage
+{
+    vec4 DictionaryTexelData[]; // Same as DictionaryTexels, as floats
+};
+#endif
 
 layout(location = 0) out vec4 FragColor;
 
@@ -93,54 +134,28 @@ vec3 f_diffuse(vec3 wo, vec3 wi)
     return vec3(0.8, 0., 0.) * m_i_pi * wi.z;
 }
 
+// erfinv, hashIQ and sampleNormalDistribution are in glintcommon.glsl, inserted in this file by the application
+// (see GLSLProgram::addInclude)
+
 //=========================================================================================================================
-//=============================================== Inverse error function ==================================================
+//================================================== Hash function ========================================================
 //=========================================================================================================================
-
-float erfinv(float x)
+// Random numbers of the stochastic variant, a sequence per pixel and frame seeded in main
+// (PCG hash, Jarzynski and Olano, Hash Functions for GPU Rendering, JCGT 2020)
+uint pcgHash(uint v)
 {
-    float w, p;
-    w = -log((1.0 - x) * (1.0 + x));
-    if (w < 5.000000)
-    {
-        w = w - 2.500000;
-        p = 2.81022636e-08;
-        p = 3.43273939e-07 + p * w;
-        p = -3.5233877e-06 + p * w;
-        p = -4.39150654e-06 + p * w;
-        p = 0.00021858087 + p * w;
-        p = -0.00125372503 + p * w;
-        p = -0.00417768164 + p * w;
-        p = 0.246640727 + p * w;
-        p = 1.50140941 + p * w;
-    }
-    else
-    {
-        w = sqrt(w) - 3.000000;
-        p = -0.000200214257;
-        p = 0.000100950558 + p * w;
-        p = 0.00134934322 + p * w;
-        p = -0.00367342844 + p * w;
-        p = 0.00573950773 + p * w;
-        p = -0.0076224613 + p * w;
-        p = 0.00943887047 + p * w;
-        p = 1.00167406 + p * w;
-        p = 2.83297682 + p * w;
-    }
-    return p * x;
+    uint state = v * 747796405U + 2891336453U;
+    uint word = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+    return (word >> 22U) ^ word;
 }
 
-//=========================================================================================================================
-//================================================== Hash function ========================================================
-//================================================== Inigo Quilez =========================================================
-//====================================== https://www.shadertoy.com/view/llGSzw ============================================
-//=========================================================================================================================
-float hashIQ(uint n)
+uint RandomState;
+
+// Uniform in [0, 1)
+float random()
 {
-    // integer hash copied from Hugo Elias
-    n = (n << 13U) ^ n;
-    n = n * (n * n * 15731U + 789221U) + 1376312589U;
-    return float(n & 0x7fffffffU) / float(0x7fffffff);
+    RandomState = pcgHash(RandomState);
+    return float(RandomState >> 8U) / 16777216.;
 }
 
 //=========================================================================================================================
@@ -152,20 +167,93 @@ int pyramidSize(int level)
 }
 
 //=========================================================================================================================
-//========================================= Sampling from a normal distribution ===========================================
+//=============================================== Dictionary texture fetch ================================================
 //=========================================================================================================================
-float sampleNormalDistribution(float U, float mu, float sigma)
+// Linear interpolation of a layer stored in a buffer, as the texture units filter DictionaryTex
+vec3 dictionaryBufferLookup(float texel, int layer)
 {
-    float x = sigma * 1.414213f * erfinv(2.0f * U - 1.0f) + mu;
-    return x;
+    float x = texel - 0.5;
+    int t0 = clamp(int(floor(x)), 0, Dictionary.Width - 1);
+    int t1 = min(t0 + 1, Dictionary.Width - 1);
+    float w = clamp(x - float(t0), 0., 1.);
+    int base = layer * Dictionary.Width;
+#ifdef GL_ARB_shader_storage_buffer_object
+    if (Dictionary.Layout == 3)
+        return mix(DictionaryTexelData[base + t0].rgb, DictionaryTexelData[base + t1].rgb, w);
+#endif
+    return mix(texelFetch(DictionaryTexels, base + t0).rgb, texelFetch(DictionaryTexels, base + t1).rgb, w);
+}
+
+// Texel coordinate texel (in texels, 0 to Dictionary.Width) of a layer of the dictionary, linearly interpolated
+vec3 dictionaryLookup(float texel, float layer)
+{
+    if (Dictionary.Layout == 1) {
+        int atlasLayer = int(layer);
+        vec2 atlasSize = vec2(textureSize(DictionaryAtlas, 0));
+        vec2 coord = vec2(float((atlasLayer % Dictionary.AtlasColumns) * Dictionary.Width) + texel,
+            float(atlasLayer / Dictionary.AtlasColumns) + 0.5);
+        return textureLod(DictionaryAtlas, coord / atlasSize, 0).rgb;
+    }
+    if (Dictionary.Layout >= 2)
+        return dictionaryBufferLookup(texel, int(layer));
+
+    int shard = int(layer) / Dictionary.ShardLayers;
+    vec2 coord = vec2(texel / float(Dictionary.Width), layer - float(shard * Dictionary.ShardLayers));
+    // Sampler arrays are only indexed by dynamically uniform expressions
+    if (shard == 0)
+        return textureLod(DictionaryTex[0], coord, 0).rgb;
+    if (shard == 1)
+        return textureLod(DictionaryTex[1], coord, 0).rgb;
+    if (shard == 2)
+        return textureLod(DictionaryTex[2], coord, 0).rgb;
+    return textureLod(DictionaryTex[3], coord, 0).rgb;
 }
 
 //=========================================================================================================================
-//=================== Spatially-varying, multiscale, rotated, and scaled slope distribution function ======================
-//================================================= Eq. 11, Alg. 3 ========================================================
+//=================================================== Random cell attributes ==============================================
+//================================================= Alg. 3, lines 1 to 18 =================================================
 //=========================================================================================================================
-float P22_theta_alpha(vec2 slope_h, int l, int s0, int t0)
+
+// Attributes of a cell of the level l, drawn from its coherent index
+struct GlintCell
+{
+    bool Discarded; // No microfacet in the cell (microfacet relative area)
+    bool Beckmann;  // The Beckmann distribution replaces the dictionary
+    int LDist;      // Distribution LOD
+    float Theta;    // Rotation of the distribution
+    int I;          // Distribution of the slopes along x
+    int J;          // Distribution of the slopes along y
+};
+
+// Random numbers of a cell, drawn from its coherent index only (see glintCellSeed)
+struct GlintCellSeed
+{
+    bool Discarded;
+    float Deviation; // Randomisation of l_dist
+    float Theta;
+    int I;
+    int J;
+};
+
+// l_dist of the cells of the level l, before its randomisation
+float levelDistMean(int l)
 {
+    // Number of microfacets in a cell
+    // Alg. 3, line 5
+    float n = pow(2., float(2 * l - (2 * (Dictionary.NLevels - 1))));
+    n *= exp(Material.LogMicrofacetDensity);
+
+    // Corresponding continuous distribution LOD
+    // Alg. 3, line 6
+    return log(n) / 1.38629; // 2. * log(2) = 1.38629
+}
+
+// Random numbers of the cell (s0, t0) of the level l. They only depend on its coherent index: the cell (s, t) of the
+// level l + 1 has the ones of the cell (2s, 2t) of the level l.
+GlintCellSeed glintCellSeed(int l, int s0, int t0)
+{
+    GlintCellSeed seed = GlintCellSeed(false, 0., 0., 0, 0);
+
     // Coherent index
     // Eq. 8, Alg. 3, line 1
     int twoToTheL = int(pow(2.,float(l)));
@@ -176,21 +264,17 @@ float P22_theta_alpha(vec2 slope_h, int l, int s0, int t0)
     // Alg. 3, line 2
     uint rngSeed = s0 + 1549 * t0;
 
+#ifndef GLINT_FULL_AREA
     // Alg.3, line 3
     float uMicrofacetRelativeArea = hashIQ(rngSeed * 13U);
     // Discard cells by using microfacet relative area
     // Alg.3, line 4
     if (uMicrofacetRelativeArea > MicrofacetRelativeArea)
-        return 0.f;
-
-    // Number of microfacets in a cell
-    // Alg. 3, line 5
-    float n = pow(2., float(2 * l - (2 * (Dictionary.NLevels - 1))));
-    n *= exp(Material.LogMicrofacetDensity);
-
-    // Corresponding continuous distribution LOD
-    // Alg. 3, line 6
-    float l_dist = log(n) / 1.38629; // 2. * log(2) = 1.38629
+    {
+        seed.Discarded = true;
+        return seed;
+    }
+#endif
 
     // Alg. 3, line 7
     float uDensityRandomisation = hashIQ(rngSeed * 2171U);
@@ -199,35 +283,105 @@ float P22_theta_alpha(vec2 slope_h, int l, int s0, int t0)
     // Notation in the paper: \zeta
     float densityRandomisation = 2.;
 
-    // Sample a Gaussian to randomise the distribution LOD around the distribution level l_dist
+    // Gaussian deviation of the distribution LOD around the distribution level l_dist
     // Alg. 3, line 8
-    l_dist = sampleNormalDistribution(uDensityRandomisation, l_dist, densityRandomisation);
+    seed.Deviation = sampleNormalDistribution(uDensityRandomisation, 0., densityRandomisation);
+
+    // Alg. 3, line 13
+    // Without rotation, the glints are aligned
+#ifndef GLINT_NO_ROTATION
+    float uTheta = hashIQ(rngSeed);
+    seed.Theta = 2.0 * m_pi * uTheta;
+#endif
+
+    // Alg. 3, line 17
+    float u1 = hashIQ(rngSeed * 16807U);
+    float u2 = hashIQ(rngSeed * 48271U);
+
+    // Alg. 3, line 18. hashIQ returns 1 for the largest hashes: the last distribution
+    seed.I = min(int(u1 * float(Dictionary.N)), Dictionary.N - 1);
+    seed.J = min(int(u2 * float(Dictionary.N)), Dictionary.N - 1);
+
+    return seed;
+}
+
+// Attributes of a cell from its random numbers, at a level of l_dist lDistMean (see levelDistMean)
+GlintCell glintCell(GlintCellSeed seed, float lDistMean)
+{
+    GlintCell cell = GlintCell(seed.Discarded, false, 0, seed.Theta, seed.I, seed.J);
+    if (seed.Discarded)
+        return cell;
 
     // Alg. 3, line 9
-    l_dist = clamp(int(round(l_dist)), 0, Dictionary.NLevels);
+    cell.LDist = clamp(int(round(seed.Deviation + lDistMean)), 0, Dictionary.NLevels);
 
     // Alg. 3, line 10
-    if (l_dist == Dictionary.NLevels)
-        return p22_beckmann_anisotropic(slope_h.x, slope_h.y, Material.Alpha_x, Material.Alpha_y);
+    // Levels still being streamed also fall back to the Beckmann distribution
+    cell.Beckmann = cell.LDist == Dictionary.NLevels || (Dictionary.ResidentLevels & (1 << cell.LDist)) == 0;
+    return cell;
+}
 
-    // Alg. 3, line 13
-    float uTheta = hashIQ(rngSeed);
-    float theta = 2.0 * m_pi * uTheta;
+// Alg. 3, lines 1 to 18
+GlintCell glintCell(int l, int s0, int t0)
+{
+    GlintCell cell = GlintCell(false, false, 0, 0., 0, 0);
 
-    // Uncomment to remove random distribution rotation
-    // Lead to glint alignments
-    // theta = 0.;
+    // Baked cell: a fetch replaces the hashes of Alg. 3 (cells outside the pyramid are hashed)
+    int size = pyramidSize(l);
+    if (l >= GlintCellLevel && s0 >= 0 && t0 >= 0 && s0 < size && t0 < size)
+    {
+        uvec2 baked = texelFetch(GlintCells, ivec2(s0, t0), l - GlintCellLevel).rg;
+#ifndef GLINT_FULL_AREA
+        if ((baked.x & 1u) != 0u)
+        {
+            cell.Discarded = true;
+            return cell;
+        }
+#endif
+        cell.LDist = int((baked.x >> 1) & 31u);
+        if (cell.LDist == Dictionary.NLevels || (Dictionary.ResidentLevels & (1 << cell.LDist)) == 0)
+        {
+            cell.Beckmann = true;
+            return cell;
+        }
+#ifndef GLINT_NO_ROTATION
+        cell.Theta = 2.0 * m_pi * uintBitsToFloat(baked.y);
+#endif
+        cell.I = int((baked.x >> 6) & 4095u);
+        cell.J = int((baked.x >> 18) & 4095u);
+        return cell;
+    }
+
+    return glintCell(glintCellSeed(l, s0, t0), levelDistMean(l));
+}
 
+//=========================================================================================================================
+//=================== Spatially-varying, multiscale, rotated, and scaled slope distribution function ======================
+//================================================= Eq. 11, Alg. 3 ========================================================
+//=========================================================================================================================
+
+// Rotate and scale slope, for a cell of rotation theta
+// Alg. 3, line 16
+vec2 cellSlope(vec2 slope_h, float theta)
+{
+    vec2 scaleFactor = vec2(Material.Alpha_x / Dictionary.Alpha,
+                            MATERIAL_ALPHA_Y / Dictionary.Alpha);
+#ifdef GLINT_NO_ROTATION
+    return slope_h / scaleFactor;
+#else
     float cosTheta = cos(theta);
     float sinTheta = sin(theta);
 
-    vec2 scaleFactor = vec2(Material.Alpha_x / Dictionary.Alpha,
-                            Material.Alpha_y / Dictionary.Alpha);
+    return vec2(slope_h.x * cosTheta / scaleFactor.x + slope_h.y * sinTheta / scaleFactor.y,
+                -slope_h.x * sinTheta / scaleFactor.x + slope_h.y * cosTheta / scaleFactor.y);
+#endif
+}
 
-    // Rotate and scale slope
-    // Alg. 3, line 16
-    slope_h = vec2(slope_h.x * cosTheta / scaleFactor.x + slope_h.y * sinTheta / scaleFactor.y,
-                   -slope_h.x * sinTheta / scaleFactor.x + slope_h.y * cosTheta / scaleFactor.y);
+// Alg. 3, lines 14 to 19, for a cell using the dictionary, of rotated and scaled slope (see cellSlope)
+float P22_dictionaryRotated(vec2 slope_h, GlintCell cell)
+{
+    vec2 scaleFactor = vec2(Material.Alpha_x / Dictionary.Alpha,
+                            MATERIAL_ALPHA_Y / Dictionary.Alpha);
 
     vec2 abs_slope_h = vec2(abs(slope_h.x), abs(slope_h.y));
 
@@ -237,98 +391,433 @@ float P22_theta_alpha(vec2 slope_h, int l, int s0, int t0)
     if (abs_slope_h.x > alpha_dist_isqrt2_4 || abs_slope_h.y > alpha_dist_isqrt2_4)
         return 0.f;
 
-    // Alg. 3, line 17
-    float u1 = hashIQ(rngSeed * 16807U);
-    float u2 = hashIQ(rngSeed * 48271U);
-
-    // Alg. 3, line 18
-    int i = int(u1 * float(Dictionary.N));
-    int j = int(u2 * float(Dictionary.N));
+    int i = cell.I;
+    int j = cell.J;
 
     // 3 distributions values in one texel
     int distIdxXOver3 = i / 3;
     int distIdxYOver3 = j / 3;
 
-    float texCoordX = abs_slope_h.x / alpha_dist_isqrt2_4;
-    float texCoordY = abs_slope_h.y / alpha_dist_isqrt2_4;
+    float dictionaryWidth = float(Dictionary.Width);
+    float texCoordX = abs_slope_h.x / alpha_dist_isqrt2_4 * dictionaryWidth;
+    float texCoordY = abs_slope_h.y / alpha_dist_isqrt2_4 * dictionaryWidth;
 
-    vec3 P_i = textureLod(DictionaryTex, vec2(texCoordX, l_dist * Dictionary.N / 3 + distIdxXOver3), 0).rgb;
-    vec3 P_j = textureLod(DictionaryTex, vec2(texCoordY, l_dist * Dictionary.N / 3 + distIdxYOver3), 0).rgb;
+    int layerX = cell.LDist * distPerChannel + distIdxXOver3;
+    int layerY = cell.LDist * distPerChannel + distIdxYOver3;
+
+    // Slopes outside of the support of the distributions have a null density, the dictionary is not fetched
+    vec4 supportX = texelFetch(DictionarySupport, layerX);
+    vec4 supportY = texelFetch(DictionarySupport, layerY);
+    if (texCoordX < supportX.x || texCoordX > supportX.y || texCoordY < supportY.x || texCoordY > supportY.y)
+        return 0.f;
+
+    // Only the support is stored: clamp to its first and last texel centers, as GL_CLAMP_TO_EDGE does for whole rows
+    texCoordX = clamp(texCoordX, max(supportX.x, 0.5), min(supportX.y, dictionaryWidth - 0.5)) + supportX.w;
+    texCoordY = clamp(texCoordY, max(supportY.x, 0.5), min(supportY.y, dictionaryWidth - 0.5)) + supportY.w;
+
+    vec3 P_i = dictionaryLookup(texCoordX, supportX.z);
+    vec3 P_j = dictionaryLookup(texCoordY, supportY.z);
+
+    // Filtering is linear: rescaling the filtered normalized values is exact
+    if (Dictionary.Quantized) {
+        P_i = texelFetch(DictionaryScaleOffset, 2 * layerX + 1).rgb + texelFetch(DictionaryScaleOffset, 2 * layerX).rgb * P_i;
+        P_j = texelFetch(DictionaryScaleOffset, 2 * layerY + 1).rgb + texelFetch(DictionaryScaleOffset, 2 * layerY).rgb * P_j;
+    }
 
     // Alg. 3, line 19
     return P_i[int(mod(i, 3))] * P_j[int(mod(j, 3))] / (scaleFactor.x * scaleFactor.y);
 }
 
+// Alg. 3, lines 14 to 19, for a cell using the dictionary
+float P22_dictionary(vec2 slope_h, GlintCell cell)
+{
+    return P22_dictionaryRotated(cellSlope(slope_h, cell.Theta), cell);
+}
+
+// P22_theta_alpha of a cell whose rotated and scaled slope is slope (see cellSlope). beckmann is the Beckmann P22 of the
+// slope of the half vector.
+float P22_cell(vec2 slope, GlintCell cell, float beckmann)
+{
+    if (cell.Discarded)
+        return 0.f;
+    // Alg. 3, line 11
+    if (cell.Beckmann)
+        return beckmann;
+    return P22_dictionaryRotated(slope, cell);
+}
+
+float P22_theta_alpha(vec2 slope_h, int l, int s0, int t0)
+{
+    GlintCell cell = glintCell(l, s0, t0);
+    if (cell.Discarded)
+        return 0.f;
+
+    // Alg. 3, line 11
+    if (cell.Beckmann)
+        return p22_beckmann_anisotropic(slope_h.x, slope_h.y, Material.Alpha_x, MATERIAL_ALPHA_Y);
+
+    return P22_dictionary(slope_h, cell);
+}
+
 //=========================================================================================================================
 //========================================= Alg. 2, P-SDF for a discrete LOD ==============================================
 //=========================================================================================================================
 
+// Ellipse of a pixel footprint in the cells of a level, and its bounding box
+struct EWAFootprint
+{
+    vec2 St;     // Center, in cells
+    float A;     // Ellipse coefficients, normalized: the ellipse is A s^2 + B s t + C t^2 < 1
+    float B;
+    float C;
+    float Radius2; // Squared radius of the cells kept by the cell budget, 1 without budget
+    ivec2 Min;     // Bounding box of these cells
+    ivec2 Max;
+};
+
+// Shrink steps of the ellipse of a footprint over CellBudget, see ewaFootprint
+const int MaxShrinkPasses = 8;
+
+// Last-resort bound of the cells evaluated by a scan of a footprint, whatever CellBudget: the ellipses hold up to about
+// 240 cells at the maximum anisotropy of the reference preset, fewer under a budget (see GlintQualities::settings)
+const int MaxCells = 256;
+
+// Squared radius of the cells of a footprint, and the bounding box of its ellipse in texture space
+void setRadius2(inout EWAFootprint footprint, float radius2)
+{
+    float det = -footprint.B * footprint.B + 4 * footprint.A * footprint.C;
+    float invDet = 1 / det;
+    float radius = sqrt(radius2);
+    float uSqrt = sqrt(det * footprint.C) * radius, vSqrt = sqrt(footprint.A * det) * radius;
+    footprint.Radius2 = radius2;
+    footprint.Min = ivec2(int(ceil(footprint.St[0] - 2. * invDet * uSqrt)), int(ceil(footprint.St[1] - 2. * invDet * vSqrt)));
+    footprint.Max = ivec2(int(floor(footprint.St[0] + 2. * invDet * uSqrt)), int(floor(footprint.St[1] + 2. * invDet * vSqrt)));
+}
+
+// Lattice cells inside the ellipse of a footprint
+int countCells(EWAFootprint footprint)
+{
+    int cells = 0;
+    for (int it = footprint.Min.y; it <= footprint.Max.y; ++it)
+    {
+        float tt = it - footprint.St[1];
+        for (int is = footprint.Min.x; is <= footprint.Max.x; ++is)
+        {
+            float ss = is - footprint.St[0];
+            if (footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt < footprint.Radius2)
+                cells++;
+        }
+    }
+    return cells;
+}
+
 // Most of this function is similar to pbrt-v3 EWA function,
 // which itself is similar to Heckbert 1889 algorithm, http://www.cs.cmu.edu/~ph/texfund/texfund.pdf, Section 3.5.9.
-// Go through cells within the pixel footprint for a givin LOD
-float P22__P_(int l, vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+// products are the products of the derivatives in the ellipse coefficients (see footprintProducts).
+// Over CellBudget cells, the cells of the lowest EWA weights are dropped: the ellipse shrinks to the area of the budget,
+// then by the ratio of the budget to the lattice cells inside until they fit, the lattice holding a few more cells than
+// the area. The scans keep all the cells inside, so the filter stays centred on st.
+EWAFootprint ewaFootprint(float pyrSize, vec2 st, vec3 products)
 {
-
     // Convert surface coordinates to appropriate scale for level
-    float pyrSize = pyramidSize(l);
     st[0] = st[0] * pyrSize - 0.5f;
     st[1] = st[1] * pyrSize - 0.5f;
-    dst0[0] *= pyrSize;
-    dst0[1] *= pyrSize;
-    dst1[0] *= pyrSize;
-    dst1[1] *= pyrSize;
+    float pyrSize2 = pyrSize * pyrSize;
 
     // Compute ellipse coefficients to bound filter region
-    float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1.;
-    float B = -2. * (dst0[0] * dst0[1] + dst1[0] * dst1[1]);
-    float C = dst0[0] * dst0[0] + dst1[0] * dst1[0] + 1.;
+    float A = pyrSize2 * products.x + 1.;
+    float B = -2. * (pyrSize2 * products.y);
+    float C = pyrSize2 * products.z + 1.;
     float invF = 1. / (A * C - B * B * 0.25f);
     A *= invF;
     B *= invF;
     C *= invF;
 
-    // Compute the ellipse's bounding box in texture space
+    // The ellipse r2 < radius2 covers pi radius2 / sqrt(det / 4) cells
     float det = -B * B + 4 * A * C;
-    float invDet = 1 / det;
-    float uSqrt = sqrt(det * C), vSqrt = sqrt(A * det);
-    int s0 = int(ceil(st[0] - 2. * invDet * uSqrt));
-    int s1 = int(floor(st[0] + 2. * invDet * uSqrt));
-    int t0 = int(ceil(st[1] - 2. * invDet * vSqrt));
-    int t1 = int(floor(st[1] + 2. * invDet * vSqrt));
+    float radius2 = 1.;
+    if (CellBudget > 0)
+        radius2 = min(1., float(CellBudget) * 0.5 * sqrt(det) / m_pi);
+
+    EWAFootprint footprint = EWAFootprint(st, A, B, C, 0., ivec2(0), ivec2(0));
+    setRadius2(footprint, radius2);
+    if (CellBudget > 0)
+    {
+        // One pass for most footprints, the bound only guards the cost of degenerate ones
+        for (int pass = 0; pass < MaxShrinkPasses; ++pass)
+        {
+            int cells = countCells(footprint);
+            if (cells <= CellBudget)
+                break;
+            setRadius2(footprint, footprint.Radius2 * float(CellBudget) / float(cells));
+        }
+    }
+    return footprint;
+}
+
+// Products of the derivatives in the ellipse coefficients, shared by all the levels: scaling them by the squared size
+// of a pyramid, a power of two, is exact
+vec3 footprintProducts(vec2 dst0, vec2 dst1)
+{
+    return vec3(dst0[1] * dst0[1] + dst1[1] * dst1[1],
+                dst0[0] * dst0[1] + dst1[0] * dst1[1],
+                dst0[0] * dst0[0] + dst1[0] * dst1[0]);
+}
+
+EWAFootprint ewaFootprint(int l, vec2 st, vec2 dst0, vec2 dst1)
+{
+    return ewaFootprint(float(pyramidSize(l)), st, footprintProducts(dst0, dst1));
+}
+
+// Weighting function used in pbrt-v3 EWA function, for a squared radius r2 < 1
+float ewaWeight(float r2)
+{
+    float alpha = 2;
+    return exp(-alpha * r2) - exp(-alpha);
+}
+
+bool contains(EWAFootprint footprint, int s, int t)
+{
+    return s >= footprint.Min.x && s <= footprint.Max.x && t >= footprint.Min.y && t <= footprint.Max.y;
+}
+
+// Go through cells within the pixel footprint for a givin LOD
+float P22__P_(int l, vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+{
+    EWAFootprint footprint = ewaFootprint(l, st, dst0, dst1);
+    float A = footprint.A;
+    float B = footprint.B;
+    float C = footprint.C;
+    st = footprint.St;
+    int s0 = footprint.Min.x;
+    int s1 = footprint.Max.x;
+    int t0 = footprint.Min.y;
+    int t1 = footprint.Max.y;
 
     // Scan over ellipse bound and compute quadratic equation
     float sum = 0.f;
     float sumWts = 0;
-    int nbrOfIter = 0;
-    for (int it = t0; it <= t1; ++it)
+    int cells = 0;
+    for (int it = t0; it <= t1 && cells < MaxCells; ++it)
     {
         float tt = it - st[1];
-        for (int is = s0; is <= s1; ++is)
+        for (int is = s0; is <= s1 && cells < MaxCells; ++is)
         {
             float ss = is - st[0];
             // Compute squared radius and filter SDF if inside ellipse
             float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
-            if (r2 < 1)
+            if (r2 < footprint.Radius2)
             {
-                // Weighting function used in pbrt-v3 EWA function
-                float alpha = 2;
-                float W_P = exp(-alpha * r2) - exp(-alpha);
+                cells++;
+                float W_P = ewaWeight(r2);
                 // Alg. 2, line 3
                 sum += P22_theta_alpha(slope_h, l, is, it) * W_P;
                 sumWts += W_P;
             }
-            nbrOfIter++;
-            // Guardrail (Extremely rare case.)
-            if (nbrOfIter > 100)
-                break;
         }
-        // Guardrail (Extremely rare case.)
-        if (nbrOfIter > 100)
-            break;
     }
     return sum / sumWts;
 }
 
+// P22__P_ of the levels l and l + 1 mixed with the weight w of the level l + 1 (Alg. 1, line 8), in one scan. The cell
+// (s, t) of the level l + 1 has the random numbers of the cell (2s, 2t) of the level l (see glintCellSeed): the scan
+// goes through the cells of the level l of both bounding boxes, and the cells of even coordinates are hashed, and the
+// slope rotated, once for both levels. Each level sums the cells of its ellipse, sized by ewaFootprint. Baked levels
+// (see GlintCells) are fetched by two scans.
+// The scan covers more cells than the two bounding boxes: it is faster when the hardware skips the branches of the
+// cells out of all the ellipses, slower on software renderers, which run them masked.
+float P22__P_levels(int l, float w, vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+{
+    vec3 products = footprintProducts(dst0, dst1);
+    EWAFootprint fine = ewaFootprint(float(pyramidSize(l)), st, products);
+    EWAFootprint coarse = ewaFootprint(float(pyramidSize(l + 1)), st, products);
+    // Baked levels are scanned one level after the other
+    if (l + 1 >= GlintCellLevel)
+        return mix(P22__P_(l, slope_h, st, dst0, dst1), P22__P_(l + 1, slope_h, st, dst0, dst1), w);
+
+    // The rows of even coordinates also go through the cells of the level l + 1, from even coordinates: they are
+    // visited at the same iterations by all the fragments
+    int scanMinT = min(fine.Min.y, 2 * coarse.Min.y) & ~1;
+    int scanMaxT = max(fine.Max.y, 2 * coarse.Max.y);
+
+    float fineMean = levelDistMean(l);
+    float coarseMean = levelDistMean(l + 1);
+    float beckmann = p22_beckmann_anisotropic(slope_h.x, slope_h.y, Material.Alpha_x, MATERIAL_ALPHA_Y);
+    GlintCell none = GlintCell(true, false, 0, 0., 0, 0);
+    float fineSum = 0., fineWts = 0.;
+    float coarseSum = 0., coarseWts = 0.;
+    int fineCells = 0, coarseCells = 0;
+    for (int it = scanMinT; it <= scanMaxT && (fineCells < MaxCells || coarseCells < MaxCells); ++it)
+    {
+        float tt = it - fine.St[1];
+        float ttc = it / 2 - coarse.St[1];
+        bool fineRow = it >= fine.Min.y && it <= fine.Max.y;
+        bool coarseRow = (it & 1) == 0 && it / 2 >= coarse.Min.y && it / 2 <= coarse.Max.y;
+        if (!fineRow && !coarseRow)
+            continue;
+        int scanMinS = fineRow ? fine.Min.x : 2 * coarse.Min.x;
+        int scanMaxS = fineRow ? fine.Max.x : 2 * coarse.Max.x;
+        if (coarseRow)
+        {
+            scanMinS = min(scanMinS, 2 * coarse.Min.x) & ~1;
+            scanMaxS = max(scanMaxS, 2 * coarse.Max.x);
+        }
+        for (int is = scanMinS; is <= scanMaxS; ++is)
+        {
+            // Cells out of the ellipses have a squared radius of 1
+            float r2 = 1.;
+            if (contains(fine, is, it))
+            {
+                float ss = is - fine.St[0];
+                r2 = fine.A * ss * ss + fine.B * ss * tt + fine.C * tt * tt;
+            }
+            // The cell of the level l + 1 of the same coherent index
+            float coarseR2 = 1.;
+            if (((is | it) & 1) == 0 && contains(coarse, is / 2, it / 2))
+            {
+                float ssc = is / 2 - coarse.St[0];
+                coarseR2 = coarse.A * ssc * ssc + coarse.B * ssc * ttc + coarse.C * ttc * ttc;
+            }
+            bool fineInside = r2 < fine.Radius2 && fineCells < MaxCells;
+            bool coarseInside = coarseR2 < coarse.Radius2 && coarseCells < MaxCells;
+            if (!fineInside && !coarseInside)
+                continue;
+
+            GlintCellSeed seed = glintCellSeed(l, is, it);
+            GlintCell fineCell = none;
+            if (fineInside)
+                fineCell = glintCell(seed, fineMean);
+            GlintCell coarseCell = none;
+            if (coarseInside)
+                coarseCell = glintCell(seed, coarseMean);
+
+            // Both cells have the same rotation
+            bool fineDictionary = !fineCell.Discarded && !fineCell.Beckmann;
+            bool coarseDictionary = !coarseCell.Discarded && !coarseCell.Beckmann;
+            vec2 slope = slope_h;
+            if (fineDictionary || coarseDictionary)
+                slope = cellSlope(slope_h, fineDictionary ? fineCell.Theta : coarseCell.Theta);
+
+            if (fineInside)
+            {
+                fineCells++;
+                float W_P = ewaWeight(r2);
+                fineSum += P22_cell(slope, fineCell, beckmann) * W_P;
+                fineWts += W_P;
+            }
+            if (coarseInside)
+            {
+                coarseCells++;
+                float W_P = ewaWeight(coarseR2);
+                coarseSum += P22_cell(slope, coarseCell, beckmann) * W_P;
+                coarseWts += W_P;
+            }
+        }
+    }
+    return mix(fineSum / fineWts, coarseSum / coarseWts, w);
+}
+
+//=========================================================================================================================
+//=============================================== Pixel footprint =========================================================
+//=========================================================================================================================
+
+// Tries of P22__P_stochastic to draw a cell, the expected number being 2 to 4
+const int StochasticTries = 16;
+
+// Estimate of P22__P_ from StochasticCells of its cells, drawn with the probability of their EWA weight over the sum of
+// the weights: the mean of the drawn cells has the expected value of P22__P_. A cell is drawn by rejection, without
+// scanning the footprint: a row of the bounding box, then a cell of the chord of the ellipse on the row, are picked
+// uniformly, and kept with the probability of their weight times the cells of the chord, over the bounds of both.
+// After StochasticTries, the last cell inside the ellipse is kept, or none (a footprint without cell estimates 0).
+// The cost does not depend on the size of the footprint.
+float P22__P_stochastic(int l, vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+{
+    EWAFootprint footprint = ewaFootprint(l, st, dst0, dst1);
+    float A = footprint.A;
+    float B = footprint.B;
+    float C = footprint.C;
+    float det = -B * B + 4 * A * C;
+    int rows = footprint.Max.y - footprint.Min.y + 1;
+    // The weight is the highest at the centre, where the chord is the widest
+    float maxWeight = ewaWeight(0.);
+    float maxChord = floor(2. * sqrt(footprint.Radius2 / A)) + 1.;
+
+    int n = max(StochasticCells, 1);
+    float sum = 0.;
+    for (int k = 0; k < n && rows > 0; ++k)
+    {
+        bool inside = false;
+        ivec2 cell = ivec2(0);
+        for (int tries = 0; tries < StochasticTries; ++tries)
+        {
+            int it = footprint.Min.y + min(int(random() * float(rows)), rows - 1);
+            float tt = it - footprint.St[1];
+            // Chord of the row, A ss^2 + B ss tt + C tt^2 < Radius2
+            float disc = 4 * A * footprint.Radius2 - det * tt * tt;
+            if (disc <= 0.)
+                continue;
+            float centre = footprint.St[0] - B * tt / (2 * A);
+            float halfWidth = sqrt(disc) / (2 * A);
+            int s0 = int(ceil(centre - halfWidth));
+            int chord = int(floor(centre + halfWidth)) - s0 + 1;
+            if (chord <= 0)
+                continue;
+            int is = s0 + min(int(random() * float(chord)), chord - 1);
+            float ss = is - footprint.St[0];
+            float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+            if (r2 >= footprint.Radius2)
+                continue;
+            inside = true;
+            cell = ivec2(is, it);
+            if (random() * maxWeight * maxChord < ewaWeight(r2) * float(chord))
+                break;
+        }
+        if (inside)
+            sum += P22_theta_alpha(slope_h, l, cell.x, cell.y);
+    }
+    return sum / float(n);
+}
+
+// LOD of a footprint of minor axis minorLength, Alg. 1, line 6, with the LOD bias
+float footprintLOD(float minorLength)
+{
+    return max(0., Dictionary.NLevels - 1. + log2(minorLength) + LodBias);
+}
+
+// Make dst0 the major axis of the footprint ellipse and clamp its eccentricity, returns the length of the minor axis
+float clampFootprint(inout vec2 dst0, inout vec2 dst1)
+{
+    // Compute ellipse minor and major axes
+    float dst0LengthSquared = dst0.x*dst0.x + dst0.y*dst0.y;
+    float dst1LengthSquared = dst1.x*dst1.x + dst1.y*dst1.y;
+
+    if (dst0LengthSquared < dst1LengthSquared)
+    {
+        // Swap dst0 and dst1
+        vec2 tmp = dst0;
+        float tmpF = dst0LengthSquared;
+
+        dst0 = dst1;
+        dst1 = tmp;
+
+        dst0LengthSquared = dst1LengthSquared;
+        dst1LengthSquared = tmpF;
+    }
+    float majorLength = sqrt(dst0LengthSquared);
+    // Alg. 1, line 5
+    float minorLength = sqrt(dst1LengthSquared);
+
+    // Clamp ellipse eccentricity if too large
+    // Alg. 1, line 4
+    if (minorLength * MaxAnisotropy < majorLength && minorLength > 0.)
+    {
+        float scale = majorLength / (minorLength * MaxAnisotropy);
+        dst1 *= scale;
+        minorLength *= scale;
+    }
+    return minorLength;
+}
+
 //=========================================================================================================================
 //=============================== Evaluation of our procedural physically based glinty BRDF ===============================
 //==================================================== Alg. 1, Eq. 14 =====================================================
@@ -368,55 +857,45 @@ vec3 f_P(vec3 wo, vec3 wi)
     vec2 dst0 = dFdx(texCoord);
     vec2 dst1 = dFdy(texCoord);
 
-    // Compute ellipse minor and major axes
-    float dst0LengthSquared = dst0.x*dst0.x + dst0.y*dst0.y;
-    float dst1LengthSquared = dst1.x*dst1.x + dst1.y*dst1.y;
-
-    if (dst0LengthSquared < dst1LengthSquared)
-    {
-        // Swap dst0 and dst1
-        vec2 tmp = dst0;
-        float tmpF = dst0LengthSquared;
-
-        dst0 = dst1;
-        dst1 = tmp;
-
-        dst0LengthSquared = dst1LengthSquared;
-        dst1LengthSquared = tmpF;
-    }
-    float majorLength = sqrt(dst0LengthSquared);
-    // Alg. 1, line 5
-    float minorLength = sqrt(dst1LengthSquared);
-
-    // Clamp ellipse eccentricity if too large
-    // Alg. 1, line 4
-    if (minorLength * MaxAnisotropy < majorLength && minorLength > 0.)
-    {
-        float scale = majorLength / (minorLength * MaxAnisotropy);
-        dst1 *= scale;
-        minorLength *= scale;
-    }
+    float minorLength = clampFootprint(dst0, dst1);
     // ------------------------------------------------------------------------------------------------------
 
-    // Without footprint, we evaluate the Cook Torrance BRDF
-    if (minorLength == 0)
+    // Without footprint, or without dictionary, we evaluate the Cook Torrance BRDF
+    if (minorLength == 0 || Dictionary.ResidentLevels == 0)
     {
-        D_P = ndf_beckmann_anisotropic(wh, Material.Alpha_x, Material.Alpha_y);
+        D_P = ndf_beckmann_anisotropic(wh, Material.Alpha_x, MATERIAL_ALPHA_Y);
     }
     else
     {
         // Choose LOD
         // Alg. 1, line 6
-        float l = max(0., Dictionary.NLevels - 1. + log2(minorLength));
+        float l = footprintLOD(minorLength);
         int il = int(floor(l));
 
         // Alg. 1, line 7
         float w = l - float(il);
 
-        // Alg. 1, line 8
-        P22_P = mix(P22__P_(il, slope_h, texCoord, dst0, dst1),
-                    P22__P_(il + 1, slope_h, texCoord, dst0, dst1),
-                    w);
+#ifdef GLINT_STOCHASTIC
+        // Alg. 1, line 8, the LOD l + 1 picked with the probability w, without the LOD of weight up to LodBlendCutoff
+        int lod = il;
+        if (w >= 1. - LodBlendCutoff || (w > LodBlendCutoff && random() < w))
+            lod = il + 1;
+        P22_P = P22__P_stochastic(lod, slope_h, texCoord, dst0, dst1);
+#else
+        // Alg. 1, line 8, without the LOD of weight up to LodBlendCutoff
+        if (w <= LodBlendCutoff)
+            P22_P = P22__P_(il, slope_h, texCoord, dst0, dst1);
+        else if (w >= 1. - LodBlendCutoff)
+            P22_P = P22__P_(il + 1, slope_h, texCoord, dst0, dst1);
+        else
+#ifdef GLINT_FUSED_LEVELS
+            P22_P = P22__P_levels(il, w, slope_h, texCoord, dst0, dst1);
+#else
+            P22_P = mix(P22__P_(il, slope_h, texCoord, dst0, dst1),
+                        P22__P_(il + 1, slope_h, texCoord, dst0, dst1),
+                        w);
+#endif
+#endif
 
         // Eq. 6, Alg. 1, line 10
         D_P = P22_P / (wh.z * wh.z * wh.z * wh.z);
@@ -437,11 +916,217 @@ vec3 f_P(vec3 wo, vec3 wi)
     return (F * G * D_P) / (4. * wo.z);
 }
 
+//=========================================================================================================================
+//=================================== Importance sampling of the P-SDF of a footprint =====================================
+//=========================================================================================================================
+
+// Compiled with GLINT_SAMPLING only: the glint renderer evaluates f_P and does not sample it. glintcheck compiles this
+// variant, the CPU path tracer samples with the same functions of GlintBRDF.
+#ifdef GLINT_SAMPLING
+
+// Texel coordinate of the inverse CDF of the distribution channel of a dictionary layer, at the probability u
+float inverseCDF(int layer, int channel, float u)
+{
+    int size = textureSize(DictionaryInverseCDF, 0).x - 1;
+    float x = u * float(size - 1);
+    int k = min(int(x), size - 2);
+    return mix(texelFetch(DictionaryInverseCDF, ivec2(k, layer), 0)[channel],
+               texelFetch(DictionaryInverseCDF, ivec2(k + 1, layer), 0)[channel], x - float(k));
+}
+
+// Integral of the distribution channel of a dictionary layer over the positive slopes
+float distributionIntegral(int layer, int channel)
+{
+    return texelFetch(DictionaryInverseCDF, ivec2(textureSize(DictionaryInverseCDF, 0).x - 1, layer), 0)[channel];
+}
+
+// Density of the slopes sampled by sampleCellSlope: P22_theta_alpha, with the distributions normalized
+float P22_theta_alpha_pdf(vec2 slope_h, int l, int s0, int t0)
+{
+    GlintCell cell = glintCell(l, s0, t0);
+    if (cell.Discarded)
+        return 0.f;
+    if (cell.Beckmann)
+        return p22_beckmann_anisotropic(slope_h.x, slope_h.y, Material.Alpha_x, MATERIAL_ALPHA_Y);
+
+    float P22 = P22_dictionary(slope_h, cell);
+    if (P22 == 0.)
+        return 0.;
+    int distPerChannel = Dictionary.N / 3;
+    // Symmetric distributions: the integral over all the slopes is twice the stored one
+    float integralX = 2. * distributionIntegral(cell.LDist * distPerChannel + cell.I / 3, cell.I % 3);
+    float integralY = 2. * distributionIntegral(cell.LDist * distPerChannel + cell.J / 3, cell.J % 3);
+    return P22 / (integralX * integralY);
+}
+
+// Slope of a cell from two uniform numbers, distributed as P22_theta_alpha_pdf
+vec2 sampleCellSlope(GlintCell cell, vec2 u)
+{
+    if (cell.Beckmann)
+        return vec2(sampleNormalDistribution(u.x, 0., Material.Alpha_x * m_i_sqrt_2),
+                    sampleNormalDistribution(u.y, 0., MATERIAL_ALPHA_Y * m_i_sqrt_2));
+
+    // The sign, then the absolute value of the slope in the distributions i and j, by inversion of their CDF
+    vec2 signs = vec2(u.x < 0.5 ? -1. : 1., u.y < 0.5 ? -1. : 1.);
+    u = fract(2. * u);
+    int distPerChannel = Dictionary.N / 3;
+    float alpha_dist_isqrt2_4 = Dictionary.Alpha * m_i_sqrt_2 * 4.f;
+    vec2 slope = signs * alpha_dist_isqrt2_4 / float(Dictionary.Width)
+        * vec2(inverseCDF(cell.LDist * distPerChannel + cell.I / 3, cell.I % 3, u.x),
+               inverseCDF(cell.LDist * distPerChannel + cell.J / 3, cell.J % 3, u.y));
+
+    // Inverse of the rotation and scale of P22_dictionary
+    vec2 scaleFactor = vec2(Material.Alpha_x / Dictionary.Alpha,
+                            MATERIAL_ALPHA_Y / Dictionary.Alpha);
+#ifdef GLINT_NO_ROTATION
+    return scaleFactor * slope;
+#else
+    float cosTheta = cos(cell.Theta);
+    float sinTheta = sin(cell.Theta);
+    return vec2(scaleFactor.x * (cosTheta * slope.x - sinTheta * slope.y),
+                scaleFactor.y * (sinTheta * slope.x + cosTheta * slope.y));
+#endif
+}
+
+// P22__P_ with the sampling density of the cells
+float pdf__P_(int l, vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+{
+    EWAFootprint footprint = ewaFootprint(l, st, dst0, dst1);
+    float sum = 0.f;
+    float sumWts = 0;
+    int cells = 0;
+    for (int it = footprint.Min.y; it <= footprint.Max.y && cells < MaxCells; ++it)
+    {
+        float tt = it - footprint.St[1];
+        for (int is = footprint.Min.x; is <= footprint.Max.x && cells < MaxCells; ++is)
+        {
+            float ss = is - footprint.St[0];
+            float r2 = footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt;
+            if (r2 < footprint.Radius2)
+            {
+                cells++;
+                float W_P = ewaWeight(r2);
+                sum += P22_theta_alpha_pdf(slope_h, l, is, it) * W_P;
+                sumWts += W_P;
+            }
+        }
+    }
+    return sumWts > 0. ? sum / sumWts : 0.;
+}
+
+// Weight of the LOD l + 1 in f_P, of the fractional LOD w: f_P skips the LOD of weight up to LodBlendCutoff
+float lodBlendWeight(float w)
+{
+    if (w <= LodBlendCutoff)
+        return 0.;
+    if (w >= 1. - LodBlendCutoff)
+        return 1.;
+    return w;
+}
+
+// Sample a slope of the P-SDF that f_P evaluates for the footprint (st, dst0, dst1), from 4 uniform numbers:
+// u.x picks one of the two LODs by their weight in f_P (see lodBlendWeight), u.y a cell of the EWA filter by its
+// weight, u.zw invert the two marginal distributions of the cell.
+// Returns false when the cell has no microfacet, or the footprint no cell: the sample does not contribute.
+// The density of the slopes is pdf_P22, the density of the half vector is pdf_P22 / cos^3(theta_h).
+bool sample_P22(vec4 u, vec2 st, vec2 dst0, vec2 dst1, out vec2 slope_h)
+{
+    float minorLength = clampFootprint(dst0, dst1);
+    if (minorLength == 0 || Dictionary.ResidentLevels == 0)
+    {
+        slope_h = vec2(sampleNormalDistribution(u.z, 0., Material.Alpha_x * m_i_sqrt_2),
+                       sampleNormalDistribution(u.w, 0., MATERIAL_ALPHA_Y * m_i_sqrt_2));
+        return true;
+    }
+
+    // LOD of f_P, Alg. 1, lines 6 to 8
+    float l = footprintLOD(minorLength);
+    int il = int(floor(l));
+    if (u.x < lodBlendWeight(l - float(il)))
+        il += 1;
+
+    // Total weight of the cells, then the cell where the cumulated weight reaches u.y of it, scanned in the order of
+    // P22__P_
+    EWAFootprint footprint = ewaFootprint(il, st, dst0, dst1);
+    float sumWts = 0.;
+    int cells = 0;
+    for (int it = footprint.Min.y; it <= footprint.Max.y && cells < MaxCells; ++it)
+    {
+        float tt = it - footprint.St[1];
+        for (int is = footprint.Min.x; is <= footprint.Max.x && cells < MaxCells; ++is)
+        {
+            float ss = is - footprint.St[0];
+            float r2 = footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt;
+            if (r2 < footprint.Radius2)
+            {
+                cells++;
+                sumWts += ewaWeight(r2);
+            }
+        }
+    }
+
+    slope_h = vec2(0.);
+    if (sumWts == 0.)
+        return false;
+
+    float target = u.y * sumWts;
+    float cumulated = 0.;
+    ivec2 picked = footprint.Min;
+    cells = 0;
+    for (int it = footprint.Min.y; it <= footprint.Max.y && cumulated <= target && cells < MaxCells; ++it)
+    {
+        float tt = it - footprint.St[1];
+        for (int is = footprint.Min.x; is <= footprint.Max.x && cumulated <= target && cells < MaxCells; ++is)
+        {
+            float ss = is - footprint.St[0];
+            float r2 = footprint.A * ss * ss + footprint.B * ss * tt + footprint.C * tt * tt;
+            if (r2 < footprint.Radius2)
+            {
+                cells++;
+                cumulated += ewaWeight(r2);
+                picked = ivec2(is, it);
+            }
+        }
+    }
+
+    GlintCell cell = glintCell(il, picked.x, picked.y);
+    if (cell.Discarded)
+        return false;
+    slope_h = sampleCellSlope(cell, u.zw);
+    return true;
+}
+
+// Density of the slopes sampled by sample_P22 for the footprint (st, dst0, dst1)
+float pdf_P22(vec2 slope_h, vec2 st, vec2 dst0, vec2 dst1)
+{
+    float minorLength = clampFootprint(dst0, dst1);
+    if (minorLength == 0 || Dictionary.ResidentLevels == 0)
+        return p22_beckmann_anisotropic(slope_h.x, slope_h.y, Material.Alpha_x, MATERIAL_ALPHA_Y);
+
+    float l = footprintLOD(minorLength);
+    int il = int(floor(l));
+    float w = lodBlendWeight(l - float(il));
+    if (w == 0.)
+        return pdf__P_(il, slope_h, st, dst0, dst1);
+    if (w == 1.)
+        return pdf__P_(il + 1, slope_h, st, dst0, dst1);
+    return mix(pdf__P_(il, slope_h, st, dst0, dst1),
+               pdf__P_(il + 1, slope_h, st, dst0, dst1),
+               w);
+}
+
+#endif
+
 //=========================================================================================================================
 //=========================================== Evaluate rendering equation =================================================
 //=========================================================================================================================
+
 void main()
 {
+#ifdef GLINT_STOCHASTIC
+    RandomState = pcgHash(uint(gl_FragCoord.x) + pcgHash(uint(gl_FragCoord.y) + pcgHash(uint(FrameIndex))));
+#endif
+
     vec3 binormal = cross(VertexNorm, VertexTang);
 
     // Matrix for transformation to tangent space
@@ -470,8 +1155,10 @@ void main()
 
     radiance = 0.5 * radiance_diffuse + 0.5 * radiance_specular;
 
+#ifndef GLINT_STOCHASTIC
     // Gamma
     radiance = pow(radiance, vec3(1.0 / 2.2));
+#endif
 
     FragColor = vec4(radiance, 1);
 }
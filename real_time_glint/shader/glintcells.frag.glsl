@@ -0,0 +1,57 @@
+#version 410
+
+// Bake of the attributes of the cells of a pyramid level, fetched by glintCell in glint.frag.glsl instead of drawn.
+// The arithmetic is the one of glintCell: keep both in sync for the baked cells to match the drawn ones (the functions
+// they share are in glintcommon.glsl).
+// R: bit 0 discarded, bits 1 to 5 LDist, bits 6 to 17 I, bits 18 to 29 J; G: bits of the uniform number of Theta.
+
+uniform int Level; // Pyramid level of the render target
+uniform int NLevels;
+uniform int N;
+uniform float LogMicrofacetDensity;
+uniform float MicrofacetRelativeArea;
+
+layout(location = 0) out uvec2 Cell;
+
+const float m_pi = 3.141592;
+
+// erfinv, hashIQ and sampleNormalDistribution are in glintcommon.glsl, inserted in this file by GlintCellTexture
+
+void main()
+{
+    int l = Level;
+    int s0 = int(gl_FragCoord.x);
+    int t0 = int(gl_FragCoord.y);
+
+    // Alg. 3, lines 1 and 2
+    int twoToTheL = int(pow(2.,float(l)));
+    s0 *= twoToTheL;
+    t0 *= twoToTheL;
+    uint rngSeed = s0 + 1549 * t0;
+
+    // Alg. 3, lines 3 and 4
+    float uMicrofacetRelativeArea = hashIQ(rngSeed * 13U);
+    if (uMicrofacetRelativeArea > MicrofacetRelativeArea)
+    {
+        Cell = uvec2(1u, 0u);
+        return;
+    }
+
+    // Alg. 3, lines 5 to 9
+    float n = pow(2., float(2 * l - (2 * (NLevels - 1))));
+    n *= exp(LogMicrofacetDensity);
+    float l_dist = log(n) / 1.38629; // 2. * log(2) = 1.38629
+    float uDensityRandomisation = hashIQ(rngSeed * 2171U);
+    float densityRandomisation = 2.;
+    l_dist = sampleNormalDistribution(uDensityRandomisation, l_dist, densityRandomisation);
+    int LDist = clamp(int(round(l_dist)), 0, NLevels);
+
+    // Alg. 3, lines 13 to 18
+    float uTheta = hashIQ(rngSeed);
+    float u1 = hashIQ(rngSeed * 16807U);
+    float u2 = hashIQ(rngSeed * 48271U);
+    int I = min(int(u1 * float(N)), N - 1);
+    int J = min(int(u2 * float(N)), N - 1);
+
+    Cell = uvec2(uint(LDist << 1) | uint(I << 6) | uint(J << 18), floatBitsToUint(uTheta));
+}
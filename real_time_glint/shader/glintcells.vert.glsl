@@ -0,0 +1,8 @@
+#version 410
+
+// Triangle covering the viewport, without vertex buffer
+void main()
+{
+    vec2 position = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+    gl_Position = vec4(position, 0., 1.);
+}
@@ -0,0 +1,61 @@
+// Functions of the cell attributes (Alg. 3) shared by glint.frag.glsl and glintcells.frag.glsl, inserted in both by
+// GLSLProgram::addInclude: the baked cells match the drawn ones only if both compile the same code.
+
+//=========================================================================================================================
+//=============================================== Inverse error function ==================================================
+//=========================================================================================================================
+
+float erfinv(float x)
+{
+    float w, p;
+    w = -log((1.0 - x) * (1.0 + x));
+    if (w < 5.000000)
+    {
+        w = w - 2.500000;
+        p = 2.81022636e-08;
+        p = 3.43273939e-07 + p * w;
+        p = -3.5233877e-06 + p * w;
+        p = -4.39150654e-06 + p * w;
+        p = 0.00021858087 + p * w;
+        p = -0.00125372503 + p * w;
+        p = -0.00417768164 + p * w;
+        p = 0.246640727 + p * w;
+        p = 1.50140941 + p * w;
+    }
+    else
+    {
+        w = sqrt(w) - 3.000000;
+        p = -0.000200214257;
+        p = 0.000100950558 + p * w;
+        p = 0.00134934322 + p * w;
+        p = -0.00367342844 + p * w;
+        p = 0.00573950773 + p * w;
+        p = -0.0076224613 + p * w;
+        p = 0.00943887047 + p * w;
+        p = 1.00167406 + p * w;
+        p = 2.83297682 + p * w;
+    }
+    return p * x;
+}
+
+//=========================================================================================================================
+//================================================== Hash function ========================================================
+//================================================== Inigo Quilez =========================================================
+//====================================== https://www.shadertoy.com/view/llGSzw ============================================
+//=========================================================================================================================
+float hashIQ(uint n)
+{
+    // integer hash copied from Hugo Elias
+    n = (n << 13U) ^ n;
+    n = n * (n * n * 15731U + 789221U) + 1376312589U;
+    return float(n & 0x7fffffffU) / float(0x7fffffff);
+}
+
+//=========================================================================================================================
+//========================================= Sampling from a normal distribution ===========================================
+//=========================================================================================================================
+float sampleNormalDistribution(float U, float mu, float sigma)
+{
+    float x = sigma * 1.414213f * erfinv(2.0f * U - 1.0f) + mu;
+    return x;
+}
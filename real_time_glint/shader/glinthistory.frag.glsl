@@ -0,0 +1,17 @@
+#version 410
+
+// Passes of GlintHistory: the frame of the stochastic variant of glint.frag.glsl, blended into the history, then the
+// gamma of the history, the one glint.frag.glsl applies without history
+
+uniform sampler2D Source; // Linear radiance
+uniform bool Gamma;
+
+layout(location = 0) out vec4 FragColor;
+
+void main()
+{
+    vec3 radiance = texelFetch(Source, ivec2(gl_FragCoord.xy), 0).rgb;
+    if (Gamma)
+        radiance = pow(radiance, vec3(1.0 / 2.2));
+    FragColor = vec4(radiance, 1);
+}
@@ -0,0 +1,171 @@
+// Benchmark the packet kernels of the glint BRDF against the scalar reference
+//
+// Usage: brdfbench <dictionary-name> <nlevels> <ndists-per-channel> <alpha> [<evaluations>]
+// The dictionary is loaded as GlintDictionary::load does. Random lanes (directions over the hemisphere, texture
+// coordinates of a unit square, pixel footprints from 2^-14 to 2^-6) are evaluated by GlintBRDF::f_P, then by f_P
+// scanning its two LODs one after the other, none skipped (fusedLevels off, lodBlendCutoff 0), then by each
+// instruction set of GlintPacketEvaluator supported by the CPU, on one thread, then by f_P at the other quality presets
+// (the reference runs the high one). Prints the evaluations per second per core, the speedup over the scalar
+// reference, and the error of the results against it.
+// Example: brdfbench media/dictionary/dict_16_192_64_0p5_0p02 16 64 0.5
+
+#include "glintpacket.h"
+#include "glintquality.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	glm::vec3 sampleHemisphere(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		float z = uniform(rng);
+		float r = std::sqrt(std::max(0.f, 1.f - z * z));
+		float phi = 2.f * 3.14159265f * uniform(rng);
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	}
+
+	// Packets of random lanes
+	std::vector<GlintPacket> makePackets(size_t evaluations)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		std::vector<GlintPacket> packets((evaluations + GlintPacket::Size - 1) / GlintPacket::Size);
+		for (GlintPacket& packet : packets) {
+			for (int k = 0; k < GlintPacket::Size; ++k) {
+				// Mostly reflections close to the specular direction, where the glints are
+				glm::vec3 wo = sampleHemisphere(rng);
+				glm::vec3 wi = glm::normalize(glm::vec3(-wo.x, -wo.y, wo.z) + 0.3f * sampleHemisphere(rng));
+				float major = std::exp2(-14.f + 8.f * uniform(rng));
+				float minor = major * (0.05f + 0.95f * uniform(rng));
+				float angle = 2.f * 3.14159265f * uniform(rng);
+				glm::vec2 dst0(major * std::cos(angle), major * std::sin(angle));
+				glm::vec2 dst1(-minor * std::sin(angle), minor * std::cos(angle));
+				packet.set(k, wo, wi, glm::vec2(uniform(rng), uniform(rng)), dst0, dst1);
+			}
+		}
+		return packets;
+	}
+
+	template <typename F>
+	double seconds(const F& f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 5) {
+		std::cerr << "Usage: brdfbench <dictionary-name> <nlevels> <ndists-per-channel> <alpha> [<evaluations>]" << std::endl;
+		return 1;
+	}
+	size_t evaluations = argc > 5 ? size_t(std::atol(argv[5])) : size_t(1) << 18;
+
+	GlintDictionary dictionary;
+	if (!dictionary.load(argv[1], unsigned(std::atoi(argv[2])), std::atoi(argv[3]), float(std::atof(argv[4])))) {
+		std::cerr << "Unable to load the dictionary " << argv[1] << std::endl;
+		return 1;
+	}
+	GlintBRDF brdf(&dictionary);
+	std::vector<GlintPacket> packets = makePackets(evaluations);
+	evaluations = packets.size() * GlintPacket::Size;
+
+	// Scalar reference
+	std::vector<float> reference(evaluations);
+	auto evaluateScalar = [&](std::vector<float>& values) {
+		return seconds([&]() {
+			for (size_t p = 0; p < packets.size(); ++p) {
+				const GlintPacket& packet = packets[p];
+				for (int k = 0; k < GlintPacket::Size; ++k)
+					values[p * GlintPacket::Size + k] = brdf.f_P(glm::vec3(packet.woX[k], packet.woY[k], packet.woZ[k]),
+						glm::vec3(packet.wiX[k], packet.wiY[k], packet.wiZ[k]), glm::vec2(packet.s[k], packet.t[k]),
+						glm::vec2(packet.dst0S[k], packet.dst0T[k]), glm::vec2(packet.dst1S[k], packet.dst1T[k])).x;
+			}
+		});
+	};
+	double referenceSeconds = evaluateScalar(reference);
+	double referenceRate = evaluations / referenceSeconds;
+	float peak = 0.f;
+	for (float f : reference)
+		if (std::isfinite(f))
+			peak = std::max(peak, f);
+
+	// Error relative to the largest value; the lanes off by more than 1e-3 of it come from cells whose
+	// random attributes round the other way (see GlintPacketEvaluator), or from the skipped LODs
+	auto printError = [&](const std::vector<float>& result) {
+		double maxError = 0.;
+		size_t mismatches = 0;
+		for (size_t e = 0; e < evaluations; ++e) {
+			bool bothNaN = std::isnan(result[e]) && std::isnan(reference[e]);
+			double error = bothNaN ? 0. : std::abs(double(result[e]) - double(reference[e])) / peak;
+			if (std::isnan(error) || error > 1e-3)
+				++mismatches;
+			else
+				maxError = std::max(maxError, error);
+		}
+		std::cout << std::scientific << std::setprecision(2) << std::setw(12) << maxError << std::setw(12) << mismatches << std::endl;
+	};
+
+	std::cout << evaluations << " evaluations of f_P, one thread, best kernel " << GlintISAs::name(GlintISAs::best()) << std::endl;
+	std::cout << std::left << std::setw(12) << "kernel" << std::right << std::setw(8) << "lanes" << std::setw(14) << "evals/s"
+		<< std::setw(10) << "speedup" << std::setw(12) << "max error" << std::setw(12) << "mismatches" << std::endl;
+	std::cout << std::left << std::setw(12) << "reference" << std::right << std::setw(8) << 1
+		<< std::fixed << std::setprecision(0) << std::setw(14) << referenceRate << std::endl;
+
+	// The LODs scanned one after the other, and not skipped
+	std::vector<float> result(evaluations);
+	brdf.fusedLevels = false;
+	brdf.lodBlendCutoff = 0.f;
+	double twoScansSeconds = evaluateScalar(result);
+	brdf.fusedLevels = true;
+	brdf.lodBlendCutoff = GlintBRDF::DefaultLodBlendCutoff;
+	std::cout << std::left << std::setw(12) << "two scans" << std::right << std::setw(8) << 1 << std::fixed << std::setprecision(0)
+		<< std::setw(14) << evaluations / twoScansSeconds << std::setprecision(2) << std::setw(9) << referenceSeconds / twoScansSeconds << "x";
+	printError(result);
+
+	for (int k = 0; k < GlintISAs::Count; ++k) {
+		GlintISA isa = static_cast<GlintISA>(k);
+		std::cout << std::left << std::setw(12) << GlintISAs::name(isa) << std::right;
+		if (!GlintISAs::isSupported(isa)) {
+			std::cout << "  unsupported" << std::endl;
+			continue;
+		}
+		GlintPacketEvaluator evaluator(brdf, isa);
+		double elapsed = seconds([&]() {
+			for (size_t p = 0; p < packets.size(); ++p)
+				evaluator.f_P(packets[p], GlintPacket::Size, &result[p * GlintPacket::Size]);
+		});
+
+		std::cout << std::setw(8) << evaluator.width() << std::fixed << std::setprecision(0) << std::setw(14) << evaluations / elapsed
+			<< std::setprecision(2) << std::setw(9) << referenceSeconds / elapsed << "x";
+		printError(result);
+	}
+
+	// The scalar reference at the other quality presets
+	std::cout << "quality presets, against the high one" << std::endl;
+	for (int k = 0; k < GlintQualities::Count; ++k) {
+		GlintQuality quality = static_cast<GlintQuality>(k);
+		if (quality == GlintQuality::High)
+			continue;
+		GlintQualitySettings settings = GlintQualities::settings(quality);
+		brdf.cellBudget = settings.cellBudget;
+		brdf.maxAnisotropy = settings.maxAnisotropy;
+		brdf.lodBias = settings.lodBias;
+		double elapsed = evaluateScalar(result);
+		std::cout << std::left << std::setw(12) << GlintQualities::name(quality) << std::right << std::setw(8) << 1 << std::fixed
+			<< std::setprecision(0) << std::setw(14) << evaluations / elapsed << std::setprecision(2) << std::setw(9)
+			<< referenceSeconds / elapsed << "x";
+		printError(result);
+	}
+	return 0;
+}
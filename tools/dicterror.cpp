@@ -0,0 +1,116 @@
+// Report the error of the dictionary encodings against the floats of an EXR set
+//
+// Usage: dicterror <exr-base-name> <nlevels> <ndists-per-channel> [<pack.dict> ...]
+// Each encoding (RGB half, unorm16 and unorm8) is computed in memory and compared with the decoded EXR files.
+// The given packs are compared too, they must hold the same set.
+// Errors are absolute, and relative to the maximum of each distribution, which is what the shader scales.
+// Example: dicterror media/dictionary/dict_16_192_64_0p5_0p02 16 64
+
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	struct ErrorStats {
+		double maxAbs = 0.;
+		double sumAbs = 0.;
+		double maxRel = 0.;
+		double sumRel = 0.;
+		size_t count = 0;
+	};
+
+	// Compare the rows of a pack with the RGBA floats of the EXR set
+	ErrorStats compare(const std::vector<float>& rows, const DictionaryHeader& header, const void* values, const float* scaleOffset)
+	{
+		ErrorStats stats;
+		int width = int(header.width);
+		std::vector<float> rgb(size_t(width) * 3);
+		for (size_t row = 0; row < header.layerCount(); ++row) {
+			DictionaryIO::decodeRow(header, values, scaleOffset, row, rgb.data());
+			const float* source = &rows[row * width * 4];
+			for (int c = 0; c < 3; ++c) {
+				float peak = 0.f;
+				for (int t = 0; t < width; ++t)
+					peak = std::max(peak, std::abs(source[4 * t + c]));
+				for (int t = 0; t < width; ++t) {
+					double error = std::abs(double(rgb[3 * t + c]) - double(source[4 * t + c]));
+					double relative = peak > 0.f ? error / peak : 0.;
+					stats.maxAbs = std::max(stats.maxAbs, error);
+					stats.sumAbs += error;
+					stats.maxRel = std::max(stats.maxRel, relative);
+					stats.sumRel += relative;
+					++stats.count;
+				}
+			}
+		}
+		return stats;
+	}
+
+	void print(const std::string& name, size_t bytes, const ErrorStats& stats)
+	{
+		std::cout << std::left << std::setw(24) << name << std::right << std::setw(10) << bytes
+			<< std::scientific << std::setprecision(3)
+			<< std::setw(12) << stats.maxAbs << std::setw(12) << stats.sumAbs / stats.count
+			<< std::setw(12) << stats.maxRel << std::setw(12) << stats.sumRel / stats.count
+			<< std::defaultfloat << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4) {
+		std::cerr << "Usage: dicterror <exr-base-name> <nlevels> <ndists-per-channel> [<pack.dict> ...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string baseName = argv[1];
+	int nlevels = std::atoi(argv[2]);
+	int ndists = std::atoi(argv[3]);
+	if (nlevels <= 0 || ndists <= 0) {
+		std::cerr << "Invalid dictionary parameters" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<float> rows;
+	int width;
+	if (!DictionaryIO::loadEXRSet(baseName, nlevels, ndists, rows, width))
+		return EXIT_FAILURE;
+
+	std::cout << std::left << std::setw(24) << "encoding" << std::right << std::setw(10) << "bytes"
+		<< std::setw(12) << "max abs" << std::setw(12) << "mean abs"
+		<< std::setw(12) << "max rel" << std::setw(12) << "mean rel" << std::endl;
+
+	const DictionaryValueType valueTypes[] = { DictionaryValueType::Float16, DictionaryValueType::UNorm16, DictionaryValueType::UNorm8 };
+	for (DictionaryValueType valueType : valueTypes) {
+		DictionaryHeader header = DictionaryIO::makeHeader(nlevels, ndists, width, 0.f, valueType, DictionaryIO::channelCount(valueType));
+		std::vector<unsigned char> values;
+		std::vector<float> scaleOffset;
+		DictionaryIO::encodeRows(header, rows, values, scaleOffset);
+		print(DictionaryIO::valueTypeName(valueType), header.dataSize + header.scaleOffsetSize(),
+			compare(rows, header, values.data(), scaleOffset.data()));
+	}
+
+	int status = EXIT_SUCCESS;
+	for (int a = 4; a < argc; ++a) {
+		MappedDictionary pack;
+		if (!pack.open(argv[a])) {
+			std::cerr << "Unable to open: " << argv[a] << std::endl;
+			status = EXIT_FAILURE;
+			continue;
+		}
+		const DictionaryHeader& header = pack.header();
+		if (header.nlevels != uint32_t(nlevels) || header.ndists != uint32_t(ndists) || header.width != uint32_t(width)) {
+			std::cerr << argv[a] << ": not a pack of " << baseName << std::endl;
+			status = EXIT_FAILURE;
+			continue;
+		}
+		print(argv[a], header.dataSize + header.scaleOffsetSize(), compare(rows, header, pack.data(), pack.scaleOffset()));
+	}
+	return status;
+}
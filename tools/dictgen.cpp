@@ -0,0 +1,164 @@
+// Generate a packed dictionary (.dict) of multiscale marginal distributions, on all the cores.
+// Replaces https://github.com/ASTex-ICube/real_time_glint_dictgenerator, the pack is loaded as is by the renderer.
+//
+// Usage: dictgen [--float | --unorm16 | --unorm8] [--seed <n>] <nlevels> <ndists-per-channel> <width> <alpha> <lobe-sigma> <output.dict>
+// Example, the dictionary of the paper: dictgen 16 64 64 0.5 0.02 media/dictionary/dict_16_192_64_0p5_0p02.dict
+//
+// Each of the 3 * ndists distributions is a mixture of Gaussian lobes of standard deviation lobe-sigma,
+// centered on microfacet slopes sampled from the Beckmann marginal of roughness alpha, N(0, alpha / sqrt(2)).
+// The level l mixes the first 2^l lobes: finer levels hold more microfacets, each level refining the previous one.
+// Distributions are symmetric, a row stores the positive half, [0, 4 alpha / sqrt(2)], binned in width texels
+// and normalized to integrate to 0.5.
+
+#include "dictionary.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	// splitmix64: the same seed gives the same dictionary on every platform
+	struct Random {
+		uint64_t state;
+
+		explicit Random(uint64_t seed) : state(seed) {}
+
+		uint64_t next()
+		{
+			uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		}
+
+		// Uniform in (0, 1]
+		double uniform() { return double((next() >> 11) + 1) * (1. / 9007199254740992.); }
+
+		// Box-Muller
+		double normal() { return std::sqrt(-2. * std::log(uniform())) * std::cos(6.283185307179586 * uniform()); }
+	};
+
+	struct Parameters {
+		int nlevels;
+		int ndists;
+		int width;
+		double alpha;
+		double lobeSigma;
+		uint64_t seed;
+	};
+
+	// Add the mass of the lobe N(mu, sigma) to the bins it covers, up to 6 standard deviations
+	void binLobe(std::vector<double>& bins, double mu, double sigma, double dx)
+	{
+		int width = int(bins.size());
+		int b0 = std::max(0, int(std::floor((mu - 6. * sigma) / dx)));
+		int b1 = std::min(width - 1, int(std::floor((mu + 6. * sigma) / dx)));
+		double invSigma = 1. / (sigma * std::sqrt(2.));
+		double cdf = std::erf((b0 * dx - mu) * invSigma);
+		for (int b = b0; b <= b1; ++b) {
+			double next = std::erf(((b + 1) * dx - mu) * invSigma);
+			bins[b] += 0.5 * (next - cdf);
+			cdf = next;
+		}
+	}
+
+	// Distribution d of all the levels: row l * ndists + d / 3, channel d % 3
+	void generateDistribution(const Parameters& p, int d, std::vector<float>& rows)
+	{
+		Random random(p.seed * 0x2545f4914f6cdd1dull + uint64_t(d));
+		double slopeSigma = p.alpha / std::sqrt(2.);
+		double dx = 4. * slopeSigma / p.width;
+
+		std::vector<double> bins(p.width, 0.);
+		size_t lobeCount = 0;
+		for (int l = 0; l < p.nlevels; ++l) {
+			// Microfacets of the level, the lobes of the previous levels are kept
+			for (size_t levelLobes = size_t(1) << l; lobeCount < levelLobes; ++lobeCount) {
+				double mu = random.normal() * slopeSigma;
+				binLobe(bins, mu, p.lobeSigma, dx);
+				binLobe(bins, -mu, p.lobeSigma, dx);
+			}
+
+			double mass = 0.;
+			for (double b : bins)
+				mass += b;
+			double scale = mass > 0. ? 0.5 / (mass * dx) : 0.;
+
+			size_t row = size_t(l) * p.ndists + d / 3;
+			float* texels = &rows[row * p.width * 4];
+			for (int b = 0; b < p.width; ++b)
+				texels[4 * b + d % 3] = float(bins[b] * scale);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	DictionaryValueType valueType = DictionaryValueType::Float16;
+	Parameters p;
+	p.seed = 1;
+	bool usage = false;
+	while (argc > 1 && std::string(argv[1]).compare(0, 2, "--") == 0) {
+		std::string option = argv[1];
+		if (option == "--float")
+			valueType = DictionaryValueType::Float32;
+		else if (option == "--unorm16")
+			valueType = DictionaryValueType::UNorm16;
+		else if (option == "--unorm8")
+			valueType = DictionaryValueType::UNorm8;
+		else if (option == "--seed" && argc > 2) {
+			p.seed = std::strtoull(argv[2], nullptr, 10);
+			--argc;
+			++argv;
+		}
+		else
+			usage = true;
+		--argc;
+		++argv;
+	}
+	if (usage || argc != 7) {
+		std::cerr << "Usage: dictgen [--float | --unorm16 | --unorm8] [--seed <n>] <nlevels> <ndists-per-channel> <width> <alpha> <lobe-sigma> <output.dict>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	p.nlevels = std::atoi(argv[1]);
+	p.ndists = std::atoi(argv[2]);
+	p.width = std::atoi(argv[3]);
+	p.alpha = std::atof(argv[4]);
+	p.lobeSigma = std::atof(argv[5]);
+	std::string outName = argv[6];
+
+	// The finest level holds 2^(nlevels - 1) lobes per distribution, the streamer loads up to 32 levels
+	if (p.nlevels <= 0 || p.nlevels > 24 || p.ndists <= 0 || p.width <= 0 || p.alpha <= 0. || p.lobeSigma <= 0.) {
+		std::cerr << "Invalid dictionary parameters" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	// Alpha is 1, as in the EXR sets
+	std::vector<float> rows(size_t(p.width) * 4 * p.nlevels * p.ndists, 0.f);
+	for (size_t t = 3; t < rows.size(); t += 4)
+		rows[t] = 1.f;
+	Parallel::forEachIndex(size_t(3) * p.ndists, [&](size_t d) {
+		generateDistribution(p, int(d), rows);
+	});
+	std::chrono::duration<double, std::milli> generationTime = std::chrono::steady_clock::now() - start;
+
+	DictionaryHeader header = DictionaryIO::makeHeader(p.nlevels, p.ndists, p.width, float(p.alpha),
+		valueType, DictionaryIO::channelCount(valueType));
+	std::vector<unsigned char> values;
+	std::vector<float> scaleOffset;
+	DictionaryIO::encodeRows(header, rows, values, scaleOffset);
+	if (!DictionaryIO::writePack(outName, header, values.data(), scaleOffset.data()))
+		return EXIT_FAILURE;
+
+	std::cout << outName << ": " << 3 * p.ndists << " distributions, " << p.nlevels << " levels, "
+		<< p.width << " texels, " << DictionaryIO::valueTypeName(valueType)
+		<< ", generated in " << generationTime.count() << " ms on " << Parallel::threadCount() << " threads" << std::endl;
+	return EXIT_SUCCESS;
+}
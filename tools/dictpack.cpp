@@ -0,0 +1,66 @@
+// Build a packed dictionary (.dict) from an EXR set generated by
+// https://github.com/ASTex-ICube/real_time_glint_dictgenerator
+//
+// Usage: dictpack [--float | --unorm16 | --unorm8] <exr-base-name> <nlevels> <ndists-per-channel> <alpha> <output.dict>
+// Rows are stored as RGB halves, the format of the texture, as the decoded RGBA floats with --float,
+// or as normalized integers rescaled per row with --unorm16 and --unorm8 (see dicterror for their error).
+// Example: dictpack media/dictionary/dict_16_192_64_0p5_0p02 16 64 0.5 media/dictionary/dict_16_192_64_0p5_0p02.dict
+
+#include "dictionary.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+	DictionaryValueType valueType = DictionaryValueType::Float16;
+	if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") == 0) {
+		std::string option = argv[1];
+		if (option == "--float")
+			valueType = DictionaryValueType::Float32;
+		else if (option == "--unorm16")
+			valueType = DictionaryValueType::UNorm16;
+		else if (option == "--unorm8")
+			valueType = DictionaryValueType::UNorm8;
+		else
+			argc = 0;
+		--argc;
+		++argv;
+	}
+	if (argc != 6) {
+		std::cerr << "Usage: dictpack [--float | --unorm16 | --unorm8] <exr-base-name> <nlevels> <ndists-per-channel> <alpha> <output.dict>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string baseName = argv[1];
+	int nlevels = std::atoi(argv[2]);
+	int ndists = std::atoi(argv[3]);
+	float alpha = float(std::atof(argv[4]));
+	std::string outName = argv[5];
+
+	if (nlevels <= 0 || ndists <= 0 || alpha <= 0.f) {
+		std::cerr << "Invalid dictionary parameters" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<float> rows;
+	int width;
+	if (!DictionaryIO::loadEXRSet(baseName, nlevels, ndists, rows, width))
+		return EXIT_FAILURE;
+	// Files are decoded in per thread arenas: the count does not grow with the number of files
+	std::cout << baseName << ": " << nlevels * ndists << " files decoded, "
+		<< DictionaryIO::exrAllocationCount() << " decode allocations" << std::endl;
+
+	DictionaryHeader header = DictionaryIO::makeHeader(nlevels, ndists, width, alpha, valueType, DictionaryIO::channelCount(valueType));
+	std::vector<unsigned char> values;
+	std::vector<float> scaleOffset;
+	DictionaryIO::encodeRows(header, rows, values, scaleOffset);
+	if (!DictionaryIO::writePack(outName, header, values.data(), scaleOffset.data()))
+		return EXIT_FAILURE;
+
+	std::cout << outName << ": " << header.layerCount() << " rows of " << width << " texels, "
+		<< DictionaryIO::valueTypeName(valueType) << " (" << header.dataSize + header.scaleOffsetSize() << " bytes)" << std::endl;
+	return EXIT_SUCCESS;
+}
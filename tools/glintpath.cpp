@@ -0,0 +1,172 @@
+// Path trace the glint scene without GPU, progressively (see GlintPathTracer)
+//
+// Usage: glintpath [options] <output.exr|output.png>
+//   --size <width> <height>       Framebuffer, 1600 800 by default (the window of the glint scene)
+//   --threads <count>             Rendering threads, all the cores by default
+//   --iterations <count>          Samples per pixel, one per iteration, 64 by default
+//   --bounces <count>             Maximum bounces after the camera ray, 4 by default
+//   --environment <r> <g> <b>     Radiance of the uniform environment, black by default (only the point light)
+//   --reference <file.exr>        Print the RMSE of each iteration against this image, to follow the convergence
+//   --mesh <file>                 media/sphere/sphere.obj by default
+//   --dictionary <name> <nlevels> <ndists-per-channel> <alpha>
+//                                 media/dictionary/dict_16_192_64_0p5_0p02 16 64 0.5 by default
+//   --orientation <radians>       Rotation of the sphere around y
+//   --alpha <x> <y>               Roughness
+//   --density <log>               Log microfacet density
+//   --area <relative-area>        Microfacet relative area
+//   --quality <preset>            low, medium, high (default) or reference, see GlintQualities
+// Paths are relative to the build directory. The EXR holds the linear radiance, the PNG the gamma of the shader.
+// Each iteration prints its time and samples per second.
+// Example: glintpath --iterations 256 --environment 0.2 0.2 0.2 glint.exr
+
+#include "glintpathtracer.h"
+#include "model.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+	void usage()
+	{
+		std::cerr << "Usage: glintpath [--size <width> <height>] [--threads <count>] [--iterations <count>] [--bounces <count>]" << std::endl
+			<< "       [--environment <r> <g> <b>] [--reference <file.exr>] [--mesh <file>]" << std::endl
+			<< "       [--dictionary <name> <nlevels> <ndists-per-channel> <alpha>] [--orientation <radians>]" << std::endl
+			<< "       [--alpha <x> <y>] [--density <log>] [--area <relative-area>]" << std::endl
+			<< "       [--quality <low|medium|high|reference>] <output.exr|output.png>" << std::endl;
+	}
+
+	double rmse(const GlintImage& a, const GlintImage& b)
+	{
+		double sum = 0.;
+		for (size_t k = 0; k < a.rgb.size(); ++k) {
+			double difference = double(a.rgb[k]) - double(b.rgb[k]);
+			sum += difference * difference;
+		}
+		return std::sqrt(sum / double(a.rgb.size()));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	GlintView view;
+	unsigned int threads = 0;
+	int iterations = 64;
+	int bounces = 4;
+	glm::vec3 environment(0.f);
+	std::string referenceName;
+	std::string meshName = "media/sphere/sphere.obj";
+	std::string dictionaryName = "media/dictionary/dict_16_192_64_0p5_0p02";
+	unsigned int nlevels = 16;
+	int ndists = 64;
+	float dictionaryAlpha = 0.5f;
+	std::string output;
+
+	for (int a = 1; a < argc; ++a) {
+		std::string option = argv[a];
+		auto has = [&](int count) { return a + count < argc; };
+		if (option == "--size" && has(2)) {
+			view.width = std::atoi(argv[++a]);
+			view.height = std::atoi(argv[++a]);
+		}
+		else if (option == "--threads" && has(1))
+			threads = unsigned(std::atoi(argv[++a]));
+		else if (option == "--iterations" && has(1))
+			iterations = std::atoi(argv[++a]);
+		else if (option == "--bounces" && has(1))
+			bounces = std::atoi(argv[++a]);
+		else if (option == "--environment" && has(3)) {
+			environment.x = float(std::atof(argv[++a]));
+			environment.y = float(std::atof(argv[++a]));
+			environment.z = float(std::atof(argv[++a]));
+		}
+		else if (option == "--reference" && has(1))
+			referenceName = argv[++a];
+		else if (option == "--mesh" && has(1))
+			meshName = argv[++a];
+		else if (option == "--dictionary" && has(4)) {
+			dictionaryName = argv[++a];
+			nlevels = unsigned(std::atoi(argv[++a]));
+			ndists = std::atoi(argv[++a]);
+			dictionaryAlpha = float(std::atof(argv[++a]));
+		}
+		else if (option == "--orientation" && has(1))
+			view.objectOrientation = float(std::atof(argv[++a]));
+		else if (option == "--alpha" && has(2)) {
+			view.alpha_x = float(std::atof(argv[++a]));
+			view.alpha_y = float(std::atof(argv[++a]));
+		}
+		else if (option == "--density" && has(1))
+			view.logMicrofacetDensity = float(std::atof(argv[++a]));
+		else if (option == "--area" && has(1))
+			view.microfacetRelativeArea = float(std::atof(argv[++a]));
+		else if (option == "--quality" && has(1)) {
+			GlintQuality quality;
+			if (!GlintQualities::parse(argv[++a], quality)) {
+				usage();
+				return 1;
+			}
+			view.setQuality(quality);
+		}
+		else if (option.compare(0, 2, "--") != 0 && output.empty())
+			output = option;
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (output.empty() || view.width <= 0 || view.height <= 0 || iterations <= 0 || bounces < 0) {
+		usage();
+		return 1;
+	}
+
+	GlintImage reference;
+	if (!referenceName.empty()) {
+		if (!reference.loadEXR(referenceName))
+			return 1;
+		if (reference.width != view.width || reference.height != view.height) {
+			std::cerr << referenceName << " is " << reference.width << "x" << reference.height << ", not "
+				<< view.width << "x" << view.height << std::endl;
+			return 1;
+		}
+	}
+
+	Model model(meshName, false);
+	if (model.getMeshes().empty()) {
+		std::cerr << "No mesh with tangents in " << meshName << std::endl;
+		return 1;
+	}
+	GlintDictionary dictionary;
+	if (!dictionary.load(dictionaryName, nlevels, ndists, dictionaryAlpha)) {
+		std::cerr << "Unable to load the dictionary " << dictionaryName << std::endl;
+		return 1;
+	}
+	GlintBRDF brdf(&dictionary);
+	GlintPathTracer pathTracer(model.getMeshes());
+	pathTracer.setEnvironment(environment);
+	pathTracer.setMaxBounces(bounces);
+	pathTracer.setView(view, brdf);
+	std::cout << view.width << "x" << view.height << ", " << (threads ? threads : Parallel::threadCount()) << " threads" << std::endl;
+
+	std::cout << std::setw(10) << "iteration" << std::setw(12) << "ms" << std::setw(14) << "Msamples/s";
+	if (!referenceName.empty())
+		std::cout << std::setw(14) << "RMSE";
+	std::cout << std::endl;
+	double total = 0.;
+	double samples = double(view.width) * double(view.height);
+	for (int i = 1; i <= iterations; ++i) {
+		double seconds = pathTracer.iterate(threads);
+		total += seconds;
+		std::cout << std::setw(10) << i << std::fixed << std::setprecision(1) << std::setw(12) << seconds * 1e3
+			<< std::setprecision(3) << std::setw(14) << samples / seconds * 1e-6;
+		if (!referenceName.empty())
+			std::cout << std::scientific << std::setprecision(4) << std::setw(14) << rmse(pathTracer.image(), reference);
+		std::cout << std::defaultfloat << std::endl;
+	}
+	std::cout << std::fixed << std::setprecision(1) << iterations << " samples per pixel in " << total * 1e3 << " ms, "
+		<< std::setprecision(3) << samples * iterations / total * 1e-6 << " Msamples/s" << std::endl;
+	return pathTracer.image().save(output) ? 0 : 1;
+}
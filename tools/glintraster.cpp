@@ -0,0 +1,144 @@
+// Render the glint scene without GPU (see GlintRasterizer)
+//
+// Usage: glintraster [options] <output.exr|output.png>
+//   --size <width> <height>       Framebuffer, 1600 800 by default (the window of the glint scene)
+//   --threads <count>             Rendering threads, all the cores by default
+//   --scaling                     Render with 1, 2, 4... threads up to all the cores and print the speedups
+//   --mesh <file>                 media/sphere/sphere.obj by default
+//   --dictionary <name> <nlevels> <ndists-per-channel> <alpha>
+//                                 media/dictionary/dict_16_192_64_0p5_0p02 16 64 0.5 by default
+//   --orientation <radians>       Rotation of the sphere around y
+//   --alpha <x> <y>               Roughness
+//   --density <log>               Log microfacet density
+//   --area <relative-area>        Microfacet relative area
+//   --quality <preset>            low, medium, high (default) or reference, see GlintQualities
+// Paths are relative to the build directory. The EXR holds the linear radiance, the PNG the gamma of the shader.
+// Example: glintraster --scaling glint.png
+
+#include "glintrasterizer.h"
+#include "model.h"
+#include "parallel.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	void usage()
+	{
+		std::cerr << "Usage: glintraster [--size <width> <height>] [--threads <count>] [--scaling] [--mesh <file>]" << std::endl
+			<< "       [--dictionary <name> <nlevels> <ndists-per-channel> <alpha>] [--orientation <radians>]" << std::endl
+			<< "       [--alpha <x> <y>] [--density <log>] [--area <relative-area>]" << std::endl
+			<< "       [--quality <low|medium|high|reference>] <output.exr|output.png>" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	GlintView view;
+	unsigned int threads = 0;
+	bool scaling = false;
+	std::string meshName = "media/sphere/sphere.obj";
+	std::string dictionaryName = "media/dictionary/dict_16_192_64_0p5_0p02";
+	unsigned int nlevels = 16;
+	int ndists = 64;
+	float dictionaryAlpha = 0.5f;
+	std::string output;
+
+	for (int a = 1; a < argc; ++a) {
+		std::string option = argv[a];
+		auto has = [&](int count) { return a + count < argc; };
+		if (option == "--size" && has(2)) {
+			view.width = std::atoi(argv[++a]);
+			view.height = std::atoi(argv[++a]);
+		}
+		else if (option == "--threads" && has(1))
+			threads = unsigned(std::atoi(argv[++a]));
+		else if (option == "--scaling")
+			scaling = true;
+		else if (option == "--mesh" && has(1))
+			meshName = argv[++a];
+		else if (option == "--dictionary" && has(4)) {
+			dictionaryName = argv[++a];
+			nlevels = unsigned(std::atoi(argv[++a]));
+			ndists = std::atoi(argv[++a]);
+			dictionaryAlpha = float(std::atof(argv[++a]));
+		}
+		else if (option == "--orientation" && has(1))
+			view.objectOrientation = float(std::atof(argv[++a]));
+		else if (option == "--alpha" && has(2)) {
+			view.alpha_x = float(std::atof(argv[++a]));
+			view.alpha_y = float(std::atof(argv[++a]));
+		}
+		else if (option == "--density" && has(1))
+			view.logMicrofacetDensity = float(std::atof(argv[++a]));
+		else if (option == "--area" && has(1))
+			view.microfacetRelativeArea = float(std::atof(argv[++a]));
+		else if (option == "--quality" && has(1)) {
+			GlintQuality quality;
+			if (!GlintQualities::parse(argv[++a], quality)) {
+				usage();
+				return 1;
+			}
+			view.setQuality(quality);
+		}
+		else if (option.compare(0, 2, "--") != 0 && output.empty())
+			output = option;
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (output.empty() || view.width <= 0 || view.height <= 0) {
+		usage();
+		return 1;
+	}
+
+	Model model(meshName, false);
+	if (model.getMeshes().empty()) {
+		std::cerr << "No mesh with tangents in " << meshName << std::endl;
+		return 1;
+	}
+	GlintDictionary dictionary;
+	if (!dictionary.load(dictionaryName, nlevels, ndists, dictionaryAlpha)) {
+		std::cerr << "Unable to load the dictionary " << dictionaryName << std::endl;
+		return 1;
+	}
+	GlintBRDF brdf(&dictionary);
+	GlintRasterizer rasterizer(model.getMeshes());
+	std::cout << view.width << "x" << view.height << ", " << GlintISAs::name(GlintISAs::best()) << " kernel" << std::endl;
+
+	GlintImage image;
+	if (scaling) {
+		// 1, 2, 4... threads, then all the cores; the first render warms the caches
+		std::vector<unsigned int> counts;
+		for (unsigned int count = 1; count < Parallel::threadCount(); count *= 2)
+			counts.push_back(count);
+		counts.push_back(Parallel::threadCount());
+		rasterizer.render(view, brdf, counts.back());
+		std::cout << std::setw(8) << "threads" << std::setw(12) << "setup ms" << std::setw(12) << "shading ms"
+			<< std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+		double reference = 0.;
+		for (unsigned int count : counts) {
+			image = rasterizer.render(view, brdf, count);
+			const GlintRasterizer::Timings& timings = rasterizer.timings();
+			double total = timings.setup + timings.shading;
+			if (count == 1)
+				reference = total;
+			std::cout << std::setw(8) << count << std::fixed << std::setprecision(1)
+				<< std::setw(12) << timings.setup * 1e3 << std::setw(12) << timings.shading * 1e3
+				<< std::setprecision(2) << std::setw(9) << reference / total << "x"
+				<< std::setw(11) << 100. * reference / total / count << "%" << std::endl;
+		}
+	}
+	else {
+		image = rasterizer.render(view, brdf, threads);
+		const GlintRasterizer::Timings& timings = rasterizer.timings();
+		std::cout << std::fixed << std::setprecision(1) << "Rendered in " << (timings.setup + timings.shading) * 1e3
+			<< " ms (setup " << timings.setup * 1e3 << " ms, shading " << timings.shading * 1e3 << " ms) on "
+			<< (threads ? threads : Parallel::threadCount()) << " threads" << std::endl;
+	}
+	return image.save(output) ? 0 : 1;
+}